@@ -5,60 +5,97 @@
 #include <random>
 #include <tuple>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "photon_camera.h"
+#include "photon_heatmap_renderer.h"
+#include "photon_live.h"
+#include "photon_transport.h"
+#include "photon_trail_renderer.h"
 
 #define SCREEN_WIDTH 800
 #define SCREEN_HEIGHT 1056
 #define PADDING 3.0f // Increased padding around the edges in meters
-#define SENSOR_MARGIN 0.5f // Minimum distance from sensors to the edge
-
-// Define M_PI if it is not defined
-#ifndef M_PI
-    #define M_PI 3.14159265358979323846
-#endif
+#define SEGMENTS_PER_FRAME 2048 // Most new trail segments taken from the simulation per frame
+#define FLUENCE_CELLS_X 125 // Fluence grid of the heatmap, 0.2m cells
+#define FLUENCE_CELLS_Y 165
+#define SENSOR_MIN_SIDES 4 // Sides of a sensor only a pixel or two across
+#define SENSOR_MAX_SIDES 64 // Sides of a sensor filling the window
+#define GRID_MIN_PIXELS 24.0f // Closest spacing of the grid lines on screen
+#define ZOOM_STEP 1.2f // Zoom factor per scroll-wheel notch or +/- key press
+#define PAN_STEP 0.1f // Fraction of the view an arrow key moves it by
+#define TRAIL_LINE_WIDTH 2.0f // Pixels
 
 // Global variables
-const GLfloat sensorRadius = 0.075f; // Radius of the sensors (0.15m diameter)
-const GLfloat meanFreePath = 7.0f; // Mean free path for scattering in meters
-const GLfloat absorptionLength = 11.0f; // Mean free path for absorption in meters
-const GLfloat absorptionProbability = 0.1f; // Probability of absorption at each scattering event
-
-struct Photon {
-    std::vector<std::pair<GLfloat, GLfloat>> path; // Store the path of the photon
-    GLfloat angle; // Current angle of movement
-    bool active; // Whether the photon is still moving
-    Photon(GLfloat startX, GLfloat startY, GLfloat angle) : angle(angle), active(true) {
-        path.emplace_back(startX, startY);
-    }
-};
+TransportConfig config; // Optical properties and geometry shared with the headless engine
 
-const GLfloat emitterX = 12.0f;
-const GLfloat emitterY = 17.0f;
-const GLfloat photonSpeed = 1.0f; // Speed of the photon beam
-std::vector<Photon> photons;
+const GLfloat emitterX = config.emitterX;
+const GLfloat emitterY = config.emitterY;
+LiveTracer live; // Transport running on worker threads, publishing segments to the render loop
+TrailRenderer trails; // The most recent segments traced, kept on the GPU
+HeatmapRenderer heatmap; // Fluence of every photon traced so far
+bool showHeatmap = true; // H switches between the fluence heatmap and the ray trails
 
-std::mt19937 rng;
-std::uniform_real_distribution<GLfloat> angleDist(0.0f, 2.0f * M_PI);
-std::exponential_distribution<GLfloat> scatteringDist(1.0f / meanFreePath);
-std::exponential_distribution<GLfloat> absorptionDist(1.0f / absorptionLength);
+ViewCamera camera; // World rectangle shown; the projection is set from it every frame
+bool dragging = false; // Left button held: the view follows the cursor
+double dragX, dragY; // Cursor position at the last drag event, in window coordinates
 
-std::vector<std::pair<GLfloat, GLfloat>> sensor_centers;
+SensorCenters sensor_centers;
+SensorIndex sensor_index; // Grid over sensor_centers used by the transport
 
-void drawCircle(GLfloat x, GLfloat y, GLfloat z, GLfloat radius, GLint numberOfSides);
-void drawGridOfCircles(int N, GLfloat radius, GLint numberOfSides);
+void drawSensors(const SensorIndex& sensors, GLfloat pixelSize);
 void drawBox();
-void drawGridLines();
+void drawGridLines(GLfloat pixelSize);
 void drawEmitter(GLfloat x, GLfloat y);
-void drawPhotonRay(const Photon& photon);
 void drawScatterEffect(GLfloat x, GLfloat y, GLfloat angle);
 void drawAbsorptionEffect(GLfloat x, GLfloat y);
-std::tuple<bool, std::pair<GLfloat, GLfloat>> check_walls(GLfloat prev_x, GLfloat prev_y, GLfloat curr_x, GLfloat curr_y);
-std::tuple<std::pair<GLfloat, GLfloat>, int> check_sensors(GLfloat prev_x, GLfloat prev_y, GLfloat curr_x, GLfloat curr_y, GLfloat r = sensorRadius);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void cursor_position_callback(GLFWwindow* window, double xpos, double ypos);
+
+static void printUsage()
+{
+    std::cout << "Usage: LightPropagation [options]\n"
+              << "  --sensors N   N x N sensor grid (default 10)\n"
+              << "  --trails P    Paths to show: last, hits (reached a sensor) or decimated (default last)\n"
+              << "  Scroll to zoom at the cursor, drag or use the arrow keys to pan, +/- to zoom,\n"
+              << "  R to show the whole box again, H to switch between the heatmap and the trails\n";
+}
 
-int main(void)
+int main(int argc, char** argv)
 {
+    int sensorsPerSide = 10;
+    PathRetention retention = KEEP_LAST;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sensors" && hasValue) sensorsPerSide = std::atoi(argv[++i]);
+        else if (arg == "--trails" && hasValue) {
+            std::string policy = argv[++i];
+            if (policy == "last") retention = KEEP_LAST;
+            else if (policy == "hits") retention = KEEP_SENSOR_HITS;
+            else if (policy == "decimated") retention = KEEP_DECIMATED;
+            else {
+                printUsage();
+                return -1;
+            }
+        }
+        else {
+            printUsage();
+            return -1;
+        }
+    }
+    if (sensorsPerSide < 2) {
+        printUsage();
+        return -1;
+    }
+
     // Initialize random number generator
-    rng.seed(std::random_device()());
+    config.seed = std::random_device()();
 
     GLFWwindow *window;
 
@@ -80,37 +117,52 @@ int main(void)
     // Make the window's context current
     glfwMakeContextCurrent(window);
 
+    if (glewInit() != GLEW_OK)
+    {
+        std::cout << "Failed to initialize GLEW" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
     // Set the framebuffer size callback to maintain aspect ratio
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-
-    glViewport(0.0f, 0.0f, SCREEN_WIDTH, SCREEN_HEIGHT); // specifies the part of the window to which OpenGL will draw (in pixels), convert from normalized to pixels
-    glMatrixMode(GL_PROJECTION); // projection matrix defines the properties of the camera that views the objects in the world coordinate frame. Here you typically set the zoom factor, aspect ratio and the near and far clipping planes
-    glLoadIdentity(); // replace the current matrix with the identity matrix and starts us a fresh because matrix transforms such as glOrtho and glRotate cumulate, basically puts us at (0, 0, 0)
-    glOrtho(-PADDING, 25.0f + PADDING, -PADDING, 33.0f + PADDING, 0.0f, 1.0f); // essentially set coordinate system to match real-world dimensions in meters with padding
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetCursorPosCallback(window, cursor_position_callback);
+
+    // The framebuffer can be larger than the window on high-density displays
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    glViewport(0, 0, framebufferWidth, framebufferHeight); // specifies the part of the window to which OpenGL will draw (in pixels), convert from normalized to pixels
+    initCamera(camera, config.boxWidth, config.boxHeight, PADDING, framebufferWidth, framebufferHeight);
     glMatrixMode(GL_MODELVIEW); // (default matrix mode) modelview matrix defines how your objects are transformed (meaning translation, rotation and scaling) in your world
-    glLoadIdentity(); // same as above comment
+    glLoadIdentity(); // replace the current matrix with the identity matrix and starts us a fresh because matrix transforms such as glOrtho and glRotate cumulate, basically puts us at (0, 0, 0)
 
     // Set background color to light gray
     glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
 
     // Initialize sensor centers
-    for (int i = 0; i < 10; ++i)
+    sensor_centers = makeSensorGrid(sensorsPerSide, config.boxWidth, config.boxHeight, SENSOR_MARGIN);
+    sensor_index = buildSensorIndex(sensor_centers, config.sensorRadius);
+
+    if (!initTrailRenderer(trails, config.boxWidth, config.boxHeight) ||
+        !initHeatmapRenderer(heatmap, FLUENCE_CELLS_X, FLUENCE_CELLS_Y))
     {
-        for (int j = 0; j < 10; ++j)
-        {
-            GLfloat spacingX = (25.0f - 2 * SENSOR_MARGIN) / 9;
-            GLfloat spacingY = (33.0f - 2 * SENSOR_MARGIN) / 9;
-            GLfloat x = SENSOR_MARGIN + j * spacingX;
-            GLfloat y = SENSOR_MARGIN + i * spacingY;
-            sensor_centers.emplace_back(x, y);
-        }
+        glfwTerminate();
+        return -1;
     }
 
-    // Set the initial photon
-    photons.emplace_back(emitterX, emitterY, angleDist(rng));
+    // Start the simulation; it runs at full speed regardless of the frame rate
+    config.fluenceCellsX = FLUENCE_CELLS_X;
+    config.fluenceCellsY = FLUENCE_CELLS_Y;
+    startLiveTracer(live, config, sensor_index, 0, retention);
+    std::vector<TraceSegment> drained(SEGMENTS_PER_FRAME);
 
     // Set the initial time
     double lastTime = glfwGetTime();
+    double lastTitleTime = lastTime;
+    uint64_t lastTitlePhotons = 0;
 
     // Loop until the user closes the window
     while (!glfwWindowShouldClose(window))
@@ -120,70 +172,66 @@ int main(void)
         double dt = currentTime - lastTime;
         lastTime = currentTime;
 
-        // Update the position of the current photon
-        if (!photons.empty() && photons.back().active) {
-            Photon& photon = photons.back();
-            if (photon.active) {
-                GLfloat prev_x = photon.path.back().first;
-                GLfloat prev_y = photon.path.back().second;
-
-                // Sample distances for scattering and absorption
-                GLfloat samp_sca = scatteringDist(rng);
-                GLfloat samp_abs = absorptionDist(rng);
-                GLfloat samp_dist = std::min(samp_sca, samp_abs);
-
-                GLfloat dx = samp_dist * std::cos(photon.angle);
-                GLfloat dy = samp_dist * std::sin(photon.angle);
-                GLfloat next_x = prev_x + dx;
-                GLfloat next_y = prev_y + dy;
-
-                auto wall_result = check_walls(prev_x, prev_y, next_x, next_y);
-                bool hit_wall = std::get<0>(wall_result);
-                std::pair<GLfloat, GLfloat> wall_intersection = std::get<1>(wall_result);
-
-                auto sensor_result = check_sensors(prev_x, prev_y, next_x, next_y);
-                std::pair<GLfloat, GLfloat> sensor_intersection = std::get<0>(sensor_result);
-                int sensor_index = std::get<1>(sensor_result);
-
-                if (hit_wall) {
-                    photon.path.emplace_back(wall_intersection);
-                    photon.active = false;
-                    drawAbsorptionEffect(wall_intersection.first, wall_intersection.second);
-                } else if (sensor_index >= 0) {
-                    photon.path.emplace_back(sensor_intersection);
-                    photon.active = false;
-                    drawAbsorptionEffect(sensor_intersection.first, sensor_intersection.second);
-                } else {
-                    photon.path.emplace_back(next_x, next_y);
-                    if (samp_dist == samp_abs) {
-                        photon.active = false;
-                        drawAbsorptionEffect(next_x, next_y);
-                    } else {
-                        drawScatterEffect(next_x, next_y, photon.angle);
-                        photon.angle = angleDist(rng);
-                    }
-                }
-            }
-        } else {
-            // Emit a new photon if the previous one is no longer active
-            photons.emplace_back(emitterX, emitterY, angleDist(rng));
+        // Take only what this frame can draw; paths the workers publish meanwhile wait in their queues
+        size_t drainedCount = drainLiveSegments(live, drained.data(), drained.size());
+        for (size_t i = 0; i < drainedCount; ++i) {
+            addTrailSegment(trails, drained[i].x0, drained[i].y0, drained[i].x1, drained[i].y1);
+        }
+        collectLiveFluence(live);
+
+        // Show the simulation rate once a second
+        if (currentTime - lastTitleTime >= 1.0) {
+            uint64_t photons = live.photons.load();
+            char title[192];
+            std::snprintf(title, sizeof(title),
+                          "Sensor Alignment - %.0f photons/s, %llu traced, %llu shown, zoom %.1fx%s",
+                          (photons - lastTitlePhotons) / (currentTime - lastTitleTime),
+                          static_cast<unsigned long long>(photons),
+                          static_cast<unsigned long long>(live.published.load()), camera.zoom,
+                          !showHeatmap && trails.drewDensity ? ", trail density" : "");
+            glfwSetWindowTitle(window, title);
+            lastTitleTime = currentTime;
+            lastTitlePhotons = photons;
         }
 
         glClear(GL_COLOR_BUFFER_BIT);
 
-        // Draw the grid and box
-        drawGridLines();
+        // Projection from the camera, which the input callbacks may have moved
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(camera.left, camera.right, camera.bottom, camera.top, 0.0f, 1.0f);
+        glMatrixMode(GL_MODELVIEW);
+        GLfloat pixelSize = cameraPixelSize(camera);
+
+        // Draw the grid, the fluence and the box
+        drawGridLines(pixelSize);
+        if (showHeatmap) {
+            drawHeatmap(heatmap, live.fluence, config.boxWidth, config.boxHeight, camera.left, camera.right,
+                        camera.bottom, camera.top);
+        }
         drawBox();
 
-        // Render sensors
-        drawGridOfCircles(10, sensorRadius, 100); // 10x10 grid of sensors with radius 0.075m (diameter 0.15m)
+        // Render the sensors in view
+        drawSensors(sensor_index, pixelSize);
 
         // Draw the emitter
         drawEmitter(emitterX, emitterY);
 
-        // Draw the photon rays
-        for (const auto& photon : photons) {
-            drawPhotonRay(photon);
+        // Draw the photon rays (yellow) in view, as a density texture when there are too many to draw as lines
+        if (!showHeatmap) {
+            glLineWidth(TRAIL_LINE_WIDTH); // Thicker line for the photon beam
+            drawTrails(trails, camera.left, camera.right, camera.bottom, camera.top, pixelSize, TRAIL_LINE_WIDTH,
+                       0.7f, 0.7f, 0.1f);
+        }
+
+        // Mark the newest step drawn
+        if (!showHeatmap && drainedCount > 0) {
+            const TraceSegment& newest = drained[drainedCount - 1];
+            if (newest.fate == PHOTON_ACTIVE) {
+                drawScatterEffect(newest.x1, newest.y1, newest.angle);
+            } else {
+                drawAbsorptionEffect(newest.x1, newest.y1);
+            }
         }
 
         // Swap front and back buffers
@@ -193,78 +241,66 @@ int main(void)
         glfwPollEvents();
     }
 
+    stopLiveTracer(live);
+    destroyHeatmapRenderer(heatmap);
+    destroyTrailRenderer(trails);
     glfwTerminate();
 
     return 0;
 }
 
-void drawGridOfCircles(int N, GLfloat radius, GLint numberOfSides)
+void drawSensors(const SensorIndex& sensors, GLfloat pixelSize)
 {
-    GLfloat spacingX = (25.0f - 2 * SENSOR_MARGIN) / static_cast<GLfloat>(N - 1); // Spacing in meters
-    GLfloat spacingY = (33.0f - 2 * SENSOR_MARGIN) / static_cast<GLfloat>(N - 1); // Spacing in meters
-
-    for (int i = 0; i < N; ++i)
+    static std::vector<uint32_t> visible; // Reused every frame
+    static std::vector<GLfloat> outline;
+    static std::vector<GLfloat> fill;
+    sensorsInRect(sensors, camera.left, camera.right, camera.bottom, camera.top, visible);
+    if (visible.empty())
     {
-        for (int j = 0; j < N; ++j)
-        {
-            GLfloat x = SENSOR_MARGIN + j * spacingX;
-            GLfloat y = SENSOR_MARGIN + i * spacingY;
-            drawCircle(x, y, 0.0f, radius, numberOfSides);
-        }
+        return;
     }
-}
-
-void drawCircle(GLfloat x, GLfloat y, GLfloat z, GLfloat radius, GLint numberOfSides)
-{
-    int numberOfVertices = numberOfSides + 2;
 
+    // About one side per two pixels of rim, so close-ups stay round and far views stay cheap
+    GLfloat radiusPixels = sensors.radius / pixelSize;
+    int numberOfSides = std::min(SENSOR_MAX_SIDES, std::max(SENSOR_MIN_SIDES, static_cast<int>(M_PI * radiusPixels)));
     GLfloat twicePi = 2.0f * M_PI;
-
-    // Use dynamic allocation to avoid non-constant array sizes
-    GLfloat* circleVerticesX = new GLfloat[numberOfVertices];
-    GLfloat* circleVerticesY = new GLfloat[numberOfVertices];
-    GLfloat* circleVerticesZ = new GLfloat[numberOfVertices];
-
-    circleVerticesX[0] = x;
-    circleVerticesY[0] = y;
-    circleVerticesZ[0] = z;
-
-    for (int i = 1; i < numberOfVertices; i++)
+    std::vector<GLfloat> rimX(numberOfSides + 1), rimY(numberOfSides + 1);
+    for (int k = 0; k <= numberOfSides; k++)
     {
-        circleVerticesX[i] = x + static_cast<GLfloat>(radius * std::cos(i * twicePi / numberOfSides));
-        circleVerticesY[i] = y + static_cast<GLfloat>(radius * std::sin(i * twicePi / numberOfSides));
-        circleVerticesZ[i] = z;
+        rimX[k] = sensors.radius * std::cos(k * twicePi / numberOfSides);
+        rimY[k] = sensors.radius * std::sin(k * twicePi / numberOfSides);
     }
 
-    // Use dynamic allocation for allCircleVertices
-    GLfloat* allCircleVertices = new GLfloat[numberOfVertices * 3];
-
-    for (int i = 0; i < numberOfVertices; i++)
+    // All visible sensors in one batch of triangles, with their rims as lines once they are big enough to show one
+    bool drawOutline = radiusPixels >= 2.0f;
+    outline.clear();
+    fill.clear();
+    for (uint32_t i : visible)
     {
-        allCircleVertices[i * 3] = circleVerticesX[i];
-        allCircleVertices[(i * 3) + 1] = circleVerticesY[i];
-        allCircleVertices[(i * 3) + 2] = circleVerticesZ[i];
+        GLfloat x = sensors.centers[i].first;
+        GLfloat y = sensors.centers[i].second;
+        for (int k = 0; k < numberOfSides; k++)
+        {
+            GLfloat triangle[6] = { x, y, x + rimX[k], y + rimY[k], x + rimX[k + 1], y + rimY[k + 1] };
+            fill.insert(fill.end(), triangle, triangle + 6);
+            if (drawOutline)
+            {
+                outline.insert(outline.end(), triangle + 2, triangle + 6);
+            }
+        }
     }
 
-    // Draw the outline
-    glColor3f(0.6f, 0.6f, 0.6f); // Gray color for outline
     glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, allCircleVertices);
-    glDrawArrays(GL_LINE_LOOP, 0, numberOfVertices);
-    glDisableClientState(GL_VERTEX_ARRAY);
-
-    // Draw the filled circle
+    if (!outline.empty())
+    {
+        glColor3f(0.6f, 0.6f, 0.6f); // Gray color for outline
+        glVertexPointer(2, GL_FLOAT, 0, outline.data());
+        glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(outline.size() / 2));
+    }
     glColor3f(0.0f, 0.0f, 1.0f); // Blue color for circle
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, allCircleVertices);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, numberOfVertices);
+    glVertexPointer(2, GL_FLOAT, 0, fill.data());
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(fill.size() / 2));
     glDisableClientState(GL_VERTEX_ARRAY);
-
-    // Clean up dynamically allocated memory
-    delete[] circleVerticesX;
-    delete[] circleVerticesY;
-    delete[] circleVerticesZ;
-    delete[] allCircleVertices;
 }
 
 void drawEmitter(GLfloat x, GLfloat y)
@@ -280,22 +316,6 @@ void drawEmitter(GLfloat x, GLfloat y)
     glEnd();
 }
 
-void drawPhotonRay(const Photon& photon)
-{
-    if (photon.path.size() < 2) return;
-
-    glColor3f(0.7f, 0.7f, 0.1f); // Yellow color for the photon beam
-
-    glLineWidth(2.0f); // Thicker line for the photon beam
-
-    glBegin(GL_LINES);
-    for (size_t i = 0; i < photon.path.size() - 1; ++i) {
-        glVertex2f(photon.path[i].first, photon.path[i].second);
-        glVertex2f(photon.path[i + 1].first, photon.path[i + 1].second);
-    }
-    glEnd();
-}
-
 void drawScatterEffect(GLfloat x, GLfloat y, GLfloat angle)
 {
     glColor3f(0.0f, 1.0f, 0.0f); // Green color for scattering
@@ -336,132 +356,122 @@ void drawBox()
     glEnd();
 }
 
-std::tuple<bool, std::pair<GLfloat, GLfloat>> check_walls(GLfloat prev_x, GLfloat prev_y, GLfloat curr_x, GLfloat curr_y) {
-    const GLfloat left_wall = 0.0f;
-    const GLfloat right_wall = 25.0f;
-    const GLfloat bottom_wall = 0.0f;
-    const GLfloat top_wall = 33.0f;
-
-    std::vector<std::pair<GLfloat, GLfloat>> intersects;
-
-    if (curr_x < left_wall) {
-        GLfloat t = (left_wall - prev_x) / (curr_x - prev_x);
-        GLfloat y_intersect = prev_y + t * (curr_y - prev_y);
-        if (0 <= t && t <= 1 && bottom_wall <= y_intersect && y_intersect <= top_wall) {
-            intersects.emplace_back(left_wall, y_intersect);
-        }
-    }
-
-    if (curr_x > right_wall) {
-        GLfloat t = (right_wall - prev_x) / (curr_x - prev_x);
-        GLfloat y_intersect = prev_y + t * (curr_y - prev_y);
-        if (0 <= t && t <= 1 && bottom_wall <= y_intersect && y_intersect <= top_wall) {
-            intersects.emplace_back(right_wall, y_intersect);
-        }
-    }
-
-    if (curr_y < bottom_wall) {
-        GLfloat t = (bottom_wall - prev_y) / (curr_y - prev_y);
-        GLfloat x_intersect = prev_x + t * (curr_x - prev_x);
-        if (0 <= t && t <= 1 && left_wall <= x_intersect && x_intersect <= right_wall) {
-            intersects.emplace_back(x_intersect, bottom_wall);
-        }
-    }
-
-    if (curr_y > top_wall) {
-        GLfloat t = (top_wall - prev_y) / (curr_y - prev_y);
-        GLfloat x_intersect = prev_x + t * (curr_x - prev_x);
-        if (0 <= t && t <= 1 && left_wall <= x_intersect && x_intersect <= right_wall) {
-            intersects.emplace_back(x_intersect, top_wall);
-        }
-    }
-
-    if (!intersects.empty()) {
-        return std::make_tuple(true, intersects.front());  // Return the first valid intersection
-    }
-
-    return std::make_tuple(false, std::make_pair(0.0f, 0.0f));
-}
-
-std::tuple<std::pair<GLfloat, GLfloat>, int> check_sensors(GLfloat prev_x, GLfloat prev_y, GLfloat curr_x, GLfloat curr_y, GLfloat r) {
-    for (size_t i = 0; i < sensor_centers.size(); ++i) {
-        GLfloat x_cent = sensor_centers[i].first;
-        GLfloat y_cent = sensor_centers[i].second;
-
-        GLfloat A = prev_x - x_cent;
-        GLfloat B = curr_x - prev_x;
-        GLfloat C = prev_y - y_cent;
-        GLfloat D = curr_y - prev_y;
-
-        GLfloat a = B * B + D * D;
-        GLfloat b = 2 * (A * B + C * D);
-        GLfloat c = A * A + C * C - r * r;
-
-        GLfloat discriminant = b * b - 4 * a * c;
-
-        if (discriminant < 0) {
-            continue;
-        }
-
-        GLfloat sqrt_discriminant = std::sqrt(discriminant);
-
-        GLfloat t1 = (-b - sqrt_discriminant) / (2 * a);
-        GLfloat t2 = (-b + sqrt_discriminant) / (2 * a);
-
-        if ((0 <= t1 && t1 <= 1) || (0 <= t2 && t2 <= 1)) {
-            return { {x_cent, y_cent}, static_cast<int>(i) };
-        }
+void drawGridLines(GLfloat pixelSize)
+{
+    // Spacing of 1, 2 or 5 times a power of ten meters, the finest at least GRID_MIN_PIXELS apart
+    // (1 m at the full view)
+    GLfloat minSpacing = GRID_MIN_PIXELS * pixelSize;
+    GLfloat spacing = std::pow(10.0f, std::floor(std::log10(minSpacing)));
+    if (spacing < minSpacing) spacing *= 2.0f;
+    if (spacing < minSpacing) spacing *= 2.5f;
+    if (spacing < minSpacing) spacing *= 2.0f;
+
+    // Only the part of the box in view
+    GLfloat left = std::max(0.0f, camera.left);
+    GLfloat right = std::min(25.0f, camera.right);
+    GLfloat bottom = std::max(0.0f, camera.bottom);
+    GLfloat top = std::min(33.0f, camera.top);
+    if (left > right || bottom > top)
+    {
+        return;
     }
-    return { {0.0f, 0.0f}, -2 };
-}
 
-void drawGridLines()
-{
     glColor4f(0.8f, 0.8f, 0.8f, 0.5f); // Light gray color for grid lines with lower alpha value
 
     glLineWidth(1.0f); // Thinner line for grid
 
     glBegin(GL_LINES);
     // Vertical grid lines
-    for (int i = 0; i <= 25; ++i)
+    for (int i = static_cast<int>(std::ceil(left / spacing)); i <= static_cast<int>(std::floor(right / spacing)); ++i)
     {
-        glVertex2f(static_cast<GLfloat>(i), 0.0f);
-        glVertex2f(static_cast<GLfloat>(i), 33.0f);
+        glVertex2f(i * spacing, bottom);
+        glVertex2f(i * spacing, top);
     }
     // Horizontal grid lines
-    for (int i = 0; i <= 33; ++i)
+    for (int i = static_cast<int>(std::ceil(bottom / spacing)); i <= static_cast<int>(std::floor(top / spacing)); ++i)
     {
-        glVertex2f(0.0f, static_cast<GLfloat>(i));
-        glVertex2f(25.0f, static_cast<GLfloat>(i));
+        glVertex2f(left, i * spacing);
+        glVertex2f(right, i * spacing);
     }
     glEnd();
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    // Maintain aspect ratio
+    // Keep the zoom and center; the camera widens the view along one axis to the new aspect ratio
     glViewport(0, 0, width, height);
+    resizeCamera(camera, width, height);
+}
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-
-    // Calculate aspect ratio
-    float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
-    float worldWidth = 25.0f + 2 * PADDING;
-    float worldHeight = 33.0f + 2 * PADDING;
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS && action != GLFW_REPEAT)
+    {
+        return;
+    }
+    if (key == GLFW_KEY_H && action == GLFW_PRESS)
+    {
+        showHeatmap = !showHeatmap;
+    }
+    else if (key == GLFW_KEY_R)
+    {
+        resetCamera(camera);
+    }
+    else if (key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT)
+    {
+        panCamera(camera, key == GLFW_KEY_LEFT ? -PAN_STEP : PAN_STEP, 0.0f);
+    }
+    else if (key == GLFW_KEY_DOWN || key == GLFW_KEY_UP)
+    {
+        panCamera(camera, 0.0f, key == GLFW_KEY_DOWN ? -PAN_STEP : PAN_STEP);
+    }
+    else if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD)
+    {
+        zoomCamera(camera, ZOOM_STEP, 0.5f, 0.5f);
+    }
+    else if (key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT)
+    {
+        zoomCamera(camera, 1.0f / ZOOM_STEP, 0.5f, 0.5f);
+    }
+}
 
-    if (aspectRatio > worldWidth / worldHeight)
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    // Zoom at the cursor, in window coordinates (y down), which may differ from framebuffer pixels
+    double xpos, ypos;
+    int width, height;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    glfwGetWindowSize(window, &width, &height);
+    if (width <= 0 || height <= 0)
     {
-        float newWidth = worldHeight * aspectRatio;
-        float halfWidthDiff = (newWidth - worldWidth) / 2.0f;
-        glOrtho(-halfWidthDiff, worldWidth + halfWidthDiff, -PADDING, 33.0f + PADDING, 0.0f, 1.0f);
+        return;
     }
-    else
+    zoomCamera(camera, static_cast<float>(std::pow(ZOOM_STEP, yoffset)), static_cast<float>(xpos / width),
+               static_cast<float>(1.0 - ypos / height));
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT)
     {
-        float newHeight = worldWidth / aspectRatio;
-        float halfHeightDiff = (newHeight - worldHeight) / 2.0f;
-        glOrtho(-PADDING, 25.0f + PADDING, -halfHeightDiff, worldHeight + halfHeightDiff, 0.0f, 1.0f);
+        dragging = action == GLFW_PRESS;
+        glfwGetCursorPos(window, &dragX, &dragY);
     }
+}
 
-    glMatrixMode(GL_MODELVIEW);
+void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
+{
+    if (!dragging)
+    {
+        return;
+    }
+    // The world point under the cursor follows it
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    if (width > 0 && height > 0)
+    {
+        panCamera(camera, static_cast<float>(-(xpos - dragX) / width), static_cast<float>((ypos - dragY) / height));
+    }
+    dragX = xpos;
+    dragY = ypos;
 }
@@ -0,0 +1,34 @@
+#ifndef PHOTON_BINARY_IO_H
+#define PHOTON_BINARY_IO_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Native-endian binary fields of the engine's own files (checkpoints, response tables)
+
+template <typename T>
+inline void writeValue(FILE* file, const T& value) {
+    std::fwrite(&value, sizeof(T), 1, file);
+}
+
+template <typename T>
+inline void writeArray(FILE* file, const std::vector<T>& values) {
+    writeValue<uint64_t>(file, values.size());
+    std::fwrite(values.data(), sizeof(T), values.size(), file);
+}
+
+template <typename T>
+inline bool readValue(FILE* file, T& value) {
+    return std::fread(&value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+inline bool readArray(FILE* file, std::vector<T>& values) {
+    uint64_t count;
+    if (!readValue(file, count) || count > (1u << 30)) return false;
+    values.resize(static_cast<size_t>(count));
+    return std::fread(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+#endif // PHOTON_BINARY_IO_H
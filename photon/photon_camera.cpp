@@ -0,0 +1,78 @@
+#include "photon_camera.h"
+
+#include <algorithm>
+
+// Half the size of the rectangle shown at zoom 1: the padded box, widened along one axis to the
+// viewport's aspect ratio
+static void fittedHalfSize(const ViewCamera& camera, float& halfWidth, float& halfHeight) {
+    float worldWidth = camera.boxWidth + 2 * camera.padding;
+    float worldHeight = camera.boxHeight + 2 * camera.padding;
+    float aspectRatio = static_cast<float>(std::max(camera.pixelsX, 1)) /
+                        static_cast<float>(std::max(camera.pixelsY, 1));
+    if (aspectRatio > worldWidth / worldHeight) {
+        halfHeight = worldHeight / 2;
+        halfWidth = halfHeight * aspectRatio;
+    } else {
+        halfWidth = worldWidth / 2;
+        halfHeight = halfWidth / aspectRatio;
+    }
+}
+
+static void updateRect(ViewCamera& camera) {
+    camera.zoom = std::min(std::max(camera.zoom, CAMERA_MIN_ZOOM), CAMERA_MAX_ZOOM);
+    camera.centerX = std::min(std::max(camera.centerX, -camera.padding), camera.boxWidth + camera.padding);
+    camera.centerY = std::min(std::max(camera.centerY, -camera.padding), camera.boxHeight + camera.padding);
+
+    float halfWidth, halfHeight;
+    fittedHalfSize(camera, halfWidth, halfHeight);
+    halfWidth /= camera.zoom;
+    halfHeight /= camera.zoom;
+    camera.left = camera.centerX - halfWidth;
+    camera.right = camera.centerX + halfWidth;
+    camera.bottom = camera.centerY - halfHeight;
+    camera.top = camera.centerY + halfHeight;
+}
+
+void initCamera(ViewCamera& camera, float boxWidth, float boxHeight, float padding, int pixelsX, int pixelsY) {
+    camera.boxWidth = boxWidth;
+    camera.boxHeight = boxHeight;
+    camera.padding = padding;
+    camera.pixelsX = pixelsX;
+    camera.pixelsY = pixelsY;
+    resetCamera(camera);
+}
+
+void resizeCamera(ViewCamera& camera, int pixelsX, int pixelsY) {
+    camera.pixelsX = pixelsX;
+    camera.pixelsY = pixelsY;
+    updateRect(camera);
+}
+
+void resetCamera(ViewCamera& camera) {
+    camera.centerX = camera.boxWidth / 2;
+    camera.centerY = camera.boxHeight / 2;
+    camera.zoom = 1.0f;
+    updateRect(camera);
+}
+
+void panCamera(ViewCamera& camera, float fractionX, float fractionY) {
+    camera.centerX += fractionX * (camera.right - camera.left);
+    camera.centerY += fractionY * (camera.top - camera.bottom);
+    updateRect(camera);
+}
+
+void zoomCamera(ViewCamera& camera, float factor, float fractionX, float fractionY) {
+    float anchorX = camera.left + fractionX * (camera.right - camera.left);
+    float anchorY = camera.bottom + fractionY * (camera.top - camera.bottom);
+    float zoom = std::min(std::max(camera.zoom * factor, CAMERA_MIN_ZOOM), CAMERA_MAX_ZOOM);
+    // The anchor's offset from the center shrinks by the same ratio as the rectangle
+    float shrink = camera.zoom / zoom;
+    camera.centerX = anchorX + (camera.centerX - anchorX) * shrink;
+    camera.centerY = anchorY + (camera.centerY - anchorY) * shrink;
+    camera.zoom = zoom;
+    updateRect(camera);
+}
+
+float cameraPixelSize(const ViewCamera& camera) {
+    return (camera.top - camera.bottom) / static_cast<float>(std::max(camera.pixelsY, 1));
+}
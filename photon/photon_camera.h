@@ -0,0 +1,38 @@
+#ifndef PHOTON_CAMERA_H
+#define PHOTON_CAMERA_H
+
+#define CAMERA_MIN_ZOOM 0.5f // Farthest zoom, relative to the fitted box
+#define CAMERA_MAX_ZOOM 500.0f // Closest zoom, about a centimetre across the window for the default box
+
+// Pan and zoom over a 2D box. Zoom 1 fits the box and its padding in the viewport; larger values
+// magnify around center. The rectangle always has the aspect ratio of the viewport, and the
+// center stays over the padded box, so the view cannot be lost.
+struct ViewCamera {
+    float boxWidth;
+    float boxHeight;
+    float padding;
+    float centerX; // World point at the middle of the viewport
+    float centerY;
+    float zoom;
+    int pixelsX; // Framebuffer size
+    int pixelsY;
+    // World rectangle shown, kept up to date by the functions below
+    float left;
+    float right;
+    float bottom;
+    float top;
+};
+
+void initCamera(ViewCamera& camera, float boxWidth, float boxHeight, float padding, int pixelsX, int pixelsY);
+void resizeCamera(ViewCamera& camera, int pixelsX, int pixelsY);
+// Back to the whole box
+void resetCamera(ViewCamera& camera);
+// Move the view by fractions of its width and height
+void panCamera(ViewCamera& camera, float fractionX, float fractionY);
+// Multiply the zoom by factor, keeping the world point at (fractionX, fractionY) of the viewport
+// (from the lower left) in place, as under the cursor for a scroll-wheel zoom
+void zoomCamera(ViewCamera& camera, float factor, float fractionX, float fractionY);
+// World meters per framebuffer pixel
+float cameraPixelSize(const ViewCamera& camera);
+
+#endif // PHOTON_CAMERA_H
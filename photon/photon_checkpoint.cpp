@@ -0,0 +1,240 @@
+#include "photon_checkpoint.h"
+#include "photon_binary_io.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+#define CHECKPOINT_MAGIC "PHOTCKP8"
+#define CHECKPOINT_END "CKPTEND1"
+
+void writeTransportConfig(FILE* file, const TransportConfig& c) {
+    writeValue(file, c.boxWidth);
+    writeValue(file, c.boxHeight);
+    writeValue(file, c.emitterX);
+    writeValue(file, c.emitterY);
+    writeValue(file, c.sensorRadius);
+    writeValue(file, c.meanFreePath);
+    writeValue(file, c.absorptionLength);
+    writeValue(file, c.absorptionProbability);
+    writeValue(file, c.photonSpeed);
+    writeValue(file, c.seed);
+    writeValue<int32_t>(file, c.mode);
+    writeValue(file, c.rouletteThreshold);
+    writeValue(file, c.rouletteSurvival);
+    writeValue<int32_t>(file, c.timeBins);
+    writeValue(file, c.timeBinWidth);
+    writeValue<int32_t>(file, c.phase);
+    writeValue(file, c.anisotropy);
+    writeValue<int32_t>(file, c.fluenceCellsX);
+    writeValue<int32_t>(file, c.fluenceCellsY);
+    writeValue<int32_t>(file, c.sampling);
+    writeValue<int32_t>(file, c.scene ? 1 : 0);
+    if (c.scene) {
+        writeValue<int32_t>(file, c.scene->wallMaterial);
+        writeValue(file, c.scene->wallReflectance);
+        writeArray(file, c.scene->edges);
+    }
+}
+
+bool readTransportConfig(FILE* file, TransportConfig& c) {
+    int32_t mode = 0;
+    int32_t phase = 0;
+    int32_t sampling = 0;
+    float anisotropy = 0.0f;
+    bool ok = readValue(file, c.boxWidth) && readValue(file, c.boxHeight) && readValue(file, c.emitterX) &&
+              readValue(file, c.emitterY) && readValue(file, c.sensorRadius) && readValue(file, c.meanFreePath) &&
+              readValue(file, c.absorptionLength) && readValue(file, c.absorptionProbability) &&
+              readValue(file, c.photonSpeed) && readValue(file, c.seed) && readValue(file, mode) &&
+              readValue(file, c.rouletteThreshold) && readValue(file, c.rouletteSurvival) &&
+              readValue(file, c.timeBins) && readValue(file, c.timeBinWidth) && readValue(file, phase) &&
+              readValue(file, anisotropy) && readValue(file, c.fluenceCellsX) && readValue(file, c.fluenceCellsY) &&
+              readValue(file, sampling);
+    // Enums from a damaged or foreign file must not reach the switch statements of the transport
+    ok = ok && mode >= TRANSPORT_ANALOG && mode <= TRANSPORT_WEIGHTED && phase >= PHASE_ISOTROPIC &&
+         phase <= PHASE_HENYEY_GREENSTEIN && sampling >= SAMPLING_PSEUDO && sampling <= SAMPLING_SOBOL;
+    int32_t hasScene = 0;
+    ok = ok && readValue(file, hasScene) && (hasScene == 0 || hasScene == 1);
+    c.scene.reset();
+    if (ok && hasScene) {
+        int32_t wallMaterial = 0;
+        float wallReflectance = 1.0f;
+        std::vector<SceneEdge> edges;
+        ok = readValue(file, wallMaterial) && readValue(file, wallReflectance) && readArray(file, edges) &&
+             wallMaterial >= SURFACE_ABSORBING && wallMaterial <= SURFACE_DIFFUSE;
+        for (size_t i = 0; ok && i < edges.size(); ++i) {
+            ok = edges[i].material >= SURFACE_ABSORBING && edges[i].material <= SURFACE_DIFFUSE;
+        }
+        if (ok) {
+            std::shared_ptr<Scene> scene = std::make_shared<Scene>(buildScene(edges));
+            scene->wallMaterial = static_cast<SurfaceMaterial>(wallMaterial);
+            scene->wallReflectance = wallReflectance;
+            c.scene = scene;
+        }
+    }
+    c.mode = ok ? static_cast<TransportMode>(mode) : TRANSPORT_ANALOG;
+    c.sampling = ok ? static_cast<SamplingMode>(sampling) : SAMPLING_PSEUDO;
+    setPhaseFunction(c, ok ? static_cast<PhaseFunction>(phase) : PHASE_ISOTROPIC, anisotropy);
+    return ok;
+}
+
+// Built scenes keep their edges in a canonical order, so equal scenes have equal edge arrays
+static bool sameScene(const Scene* a, const Scene* b) {
+    if (!a || !b) return a == b;
+    if (a->wallMaterial != b->wallMaterial || a->wallReflectance != b->wallReflectance ||
+        a->edges.size() != b->edges.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a->edges.size(); ++i) {
+        const SceneEdge& ea = a->edges[i];
+        const SceneEdge& eb = b->edges[i];
+        if (ea.x0 != eb.x0 || ea.y0 != eb.y0 || ea.x1 != eb.x1 || ea.y1 != eb.y1 || ea.material != eb.material ||
+            ea.reflectance != eb.reflectance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameTransportConfig(const TransportConfig& a, const TransportConfig& b) {
+    return a.boxWidth == b.boxWidth && a.boxHeight == b.boxHeight && a.emitterX == b.emitterX &&
+           a.emitterY == b.emitterY && a.sensorRadius == b.sensorRadius && a.meanFreePath == b.meanFreePath &&
+           a.absorptionLength == b.absorptionLength && a.absorptionProbability == b.absorptionProbability &&
+           a.photonSpeed == b.photonSpeed && a.seed == b.seed && a.mode == b.mode &&
+           a.rouletteThreshold == b.rouletteThreshold && a.rouletteSurvival == b.rouletteSurvival &&
+           a.timeBins == b.timeBins && a.timeBinWidth == b.timeBinWidth && a.phase == b.phase &&
+           a.anisotropy == b.anisotropy && a.fluenceCellsX == b.fluenceCellsX && a.fluenceCellsY == b.fluenceCellsY &&
+           a.sampling == b.sampling && sameScene(a.scene.get(), b.scene.get());
+}
+
+bool saveCheckpoint(const std::string& path, const Checkpoint& checkpoint) {
+    std::string temp = path + ".tmp";
+    FILE* file = std::fopen(temp.c_str(), "wb");
+    if (!file) return false;
+
+    std::fwrite(CHECKPOINT_MAGIC, 1, 8, file);
+    writeTransportConfig(file, checkpoint.config);
+
+    writeArray(file, checkpoint.sensors);
+
+    const BatchResult& t = checkpoint.tallies;
+    writeValue(file, t.firstPhoton);
+    writeValue(file, t.photons);
+    writeValue(file, t.steps);
+    writeValue(file, t.wallLosses);
+    writeValue(file, t.absorbed);
+    writeValue(file, t.wallWeight);
+    writeArray(file, t.sensorHits);
+    writeArray(file, t.sensorWeight);
+    writeArray(file, t.sensorWeightSq);
+    writeValue<int32_t>(file, t.timeBins);
+    writeArray(file, t.arrivalWeight);
+    writeArray(file, t.fluence);
+
+    writeValue(file, checkpoint.photonTarget);
+    writeValue(file, checkpoint.eventBytes);
+    writeValue(file, checkpoint.eventCount);
+    writeValue(file, checkpoint.runPhotons);
+    writeValue(file, checkpoint.shardCount);
+    std::fwrite(CHECKPOINT_END, 1, 8, file);
+
+    // On disk before the rename, or a power loss could leave an empty file under the real name
+    bool ok = std::fflush(file) == 0 && !std::ferror(file);
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(file)) == 0;
+#else
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::remove(temp.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    return MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+#endif
+}
+
+bool loadCheckpoint(const std::string& path, Checkpoint& checkpoint) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    char magic[8];
+    bool ok = std::fread(magic, 1, 8, file) == 8 && std::memcmp(magic, CHECKPOINT_MAGIC, 8) == 0;
+
+    ok = ok && readTransportConfig(file, checkpoint.config);
+
+    ok = ok && readArray(file, checkpoint.sensors);
+
+    BatchResult& t = checkpoint.tallies;
+    t = BatchResult();
+    ok = ok && readValue(file, t.firstPhoton) && readValue(file, t.photons) && readValue(file, t.steps) &&
+         readValue(file, t.wallLosses) && readValue(file, t.absorbed) && readValue(file, t.wallWeight) &&
+         readArray(file, t.sensorHits) && readArray(file, t.sensorWeight) && readArray(file, t.sensorWeightSq) &&
+         readValue(file, t.timeBins) && readArray(file, t.arrivalWeight) && readArray(file, t.fluence);
+
+    ok = ok && readValue(file, checkpoint.photonTarget) && readValue(file, checkpoint.eventBytes) &&
+         readValue(file, checkpoint.eventCount) && readValue(file, checkpoint.runPhotons) &&
+         readValue(file, checkpoint.shardCount) && checkpoint.shardCount > 0;
+    ok = ok && std::fread(magic, 1, 8, file) == 8 && std::memcmp(magic, CHECKPOINT_END, 8) == 0;
+
+    std::fclose(file);
+    return ok;
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& path)
+    : path(path), hasPending(false), writing(false), stopping(false), failed(0) {
+    thread = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void CheckpointWriter::submit(Checkpoint& checkpoint) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(pending, checkpoint);
+        hasPending = true;
+    }
+    wake.notify_one();
+}
+
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return !hasPending && !writing; });
+}
+
+void CheckpointWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return hasPending || stopping; });
+        if (!hasPending) break;
+
+        Checkpoint snapshot;
+        std::swap(snapshot, pending);
+        hasPending = false;
+        writing = true;
+        lock.unlock();
+        bool saved = saveCheckpoint(path, snapshot);
+        lock.lock();
+        writing = false;
+        if (!saved) failed++;
+        idle.notify_all();
+    }
+}
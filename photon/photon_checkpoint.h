@@ -0,0 +1,67 @@
+#ifndef PHOTON_CHECKPOINT_H
+#define PHOTON_CHECKPOINT_H
+
+#include "photon_transport.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Everything needed to continue a batch run. The random streams are keyed by (seed, photon index),
+// so the tallies of photons [tallies.firstPhoton, tallies.firstPhoton + tallies.photons) plus the
+// seed in config fully describe the engine state; chunks still in flight when the checkpoint was
+// taken are simply traced again. The tally file of a shard is the checkpoint of its slice.
+struct Checkpoint {
+    TransportConfig config;
+    SensorCenters sensors;
+    BatchResult tallies; // Merged prefix of the run, always a whole number of chunks
+    uint64_t photonTarget; // Photons the run was asked for, counted from tallies.firstPhoton
+    uint64_t eventBytes; // Valid length of the event file, 0 without one
+    uint64_t eventCount;
+    uint64_t runPhotons; // Photons of the whole run, all slices of a sharded one
+    uint32_t shardCount; // Slices the run was split into, 1 when it was not sharded
+
+    Checkpoint() : photonTarget(0), eventBytes(0), eventCount(0), runPhotons(0), shardCount(1) {}
+};
+
+// Every field of a config, as stored in checkpoints and response tables; reading rebuilds the phase table
+void writeTransportConfig(FILE* file, const TransportConfig& config);
+bool readTransportConfig(FILE* file, TransportConfig& config);
+
+// Field by field equality, the test for tallies that may be combined
+bool sameTransportConfig(const TransportConfig& a, const TransportConfig& b);
+
+// Write to path + ".tmp" and rename over path, so a crash mid-write keeps the previous checkpoint
+bool saveCheckpoint(const std::string& path, const Checkpoint& checkpoint);
+bool loadCheckpoint(const std::string& path, Checkpoint& checkpoint);
+
+// Saves checkpoints on a background thread. submit() only swaps the snapshot in; a snapshot that
+// arrives while the previous one is still being written replaces any older pending one.
+struct CheckpointWriter {
+    explicit CheckpointWriter(const std::string& path);
+    ~CheckpointWriter(); // Writes the last pending snapshot
+
+    void submit(Checkpoint& checkpoint); // Takes over checkpoint
+    void flush(); // Wait until every submitted snapshot is on disk
+    uint64_t failures() const { return failed; }
+
+private:
+    std::string path;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    Checkpoint pending;
+    bool hasPending;
+    bool writing;
+    bool stopping;
+    std::atomic<uint64_t> failed;
+    std::thread thread;
+
+    void run();
+};
+
+#endif // PHOTON_CHECKPOINT_H
@@ -0,0 +1,84 @@
+#include "photon_convergence.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#define CONVERGENCE_MARGIN 1.1 // Overshoot the extrapolated photon count a little
+#define CONVERGENCE_MIN_ROUND 65536 // Smallest batch traced between checks
+
+uint64_t photonsToConverge(const BatchResult& result, size_t sensor, const ConvergenceCriteria& criteria) {
+    SensorEstimate estimate = sensorEstimate(result, sensor);
+    if (result.sensorHits[sensor] == 0 || estimate.stdError <= 0.0) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    // Standard error falls as 1/sqrt(N), so the photons needed scale with the squared ratio
+    double ratio = 0.0;
+    if (criteria.targetRelativeError > 0.0) {
+        ratio = std::max(ratio, estimate.stdError / estimate.mean / criteria.targetRelativeError);
+    }
+    if (criteria.targetInterval > 0.0) {
+        ratio = std::max(ratio, 2.0 * criteria.confidenceZ * estimate.stdError / criteria.targetInterval);
+    }
+    if (ratio <= 1.0) {
+        return 0;
+    }
+    double needed = static_cast<double>(result.photons) * ratio * ratio;
+    if (needed >= static_cast<double>(std::numeric_limits<uint64_t>::max())) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    return static_cast<uint64_t>(needed);
+}
+
+ConvergenceResult traceUntilConverged(const TransportConfig& config, const SensorIndex& sensors,
+                                      const ConvergenceCriteria& criteria, unsigned threads, TraceKernel kernel,
+                                      const TraceHooks& hooks) {
+    std::vector<int> watched = criteria.sensors;
+    if (watched.empty()) {
+        for (size_t i = 0; i < sensors.size(); ++i) {
+            watched.push_back(static_cast<int>(i));
+        }
+    }
+    for (int sensor : watched) {
+        assert(sensor >= 0 && static_cast<size_t>(sensor) < sensors.size());
+        (void)sensor;
+    }
+
+    ConvergenceResult run;
+    initBatchResult(run.tallies, sensors.size());
+    run.converged = false;
+    run.rounds = 0;
+    run.worstRelativeError = std::numeric_limits<double>::infinity();
+
+    uint64_t target = std::min(std::max<uint64_t>(criteria.minPhotons, CONVERGENCE_MIN_ROUND), criteria.maxPhotons);
+    while (run.tallies.photons < target) {
+        continueBatch(config, sensors, run.tallies, target - run.tallies.photons, threads, kernel, hooks);
+        run.rounds++;
+
+        // The slowest watched sensor decides how far to go next
+        uint64_t needed = 0;
+        run.worstRelativeError = 0.0;
+        for (int sensor : watched) {
+            needed = std::max(needed, photonsToConverge(run.tallies, sensor, criteria));
+            SensorEstimate estimate = sensorEstimate(run.tallies, sensor);
+            double relative = estimate.mean > 0.0 ? estimate.stdError / estimate.mean
+                                                  : std::numeric_limits<double>::infinity();
+            run.worstRelativeError = std::max(run.worstRelativeError, relative);
+        }
+        if (needed == 0) {
+            run.converged = true;
+            break;
+        }
+
+        // Never more than double the run at once, so a poor early extrapolation cannot overshoot far
+        uint64_t photons = run.tallies.photons;
+        double extrapolated = static_cast<double>(needed) * CONVERGENCE_MARGIN;
+        uint64_t next = extrapolated >= static_cast<double>(2 * photons) ? 2 * photons
+                                                                         : static_cast<uint64_t>(extrapolated);
+        next = std::max<uint64_t>(next, photons + CONVERGENCE_MIN_ROUND);
+        target = std::min(next, criteria.maxPhotons);
+    }
+    return run;
+}
@@ -0,0 +1,40 @@
+#ifndef PHOTON_CONVERGENCE_H
+#define PHOTON_CONVERGENCE_H
+
+#include "photon_transport.h"
+
+#include <cstdint>
+#include <vector>
+
+// When to stop a run: every watched sensor must meet each target that is set (non-zero)
+struct ConvergenceCriteria {
+    double targetRelativeError; // stdError / mean
+    double targetInterval; // Full width of the confidence interval on the detected fraction
+    double confidenceZ; // z of the confidence interval (1.96 for 95%)
+    std::vector<int> sensors; // Sensors that must converge, each in [0, sensor count); empty means all of them
+    uint64_t minPhotons;
+    uint64_t maxPhotons; // Give up (converged = false) after this many photons
+
+    ConvergenceCriteria()
+        : targetRelativeError(0.01), targetInterval(0.0), confidenceZ(1.96),
+          minPhotons(1 << 18), maxPhotons(UINT64_C(1) << 36) {}
+};
+
+struct ConvergenceResult {
+    BatchResult tallies; // tallies.photons is the number of photons it took
+    bool converged;
+    int rounds; // Batches traced between convergence checks
+    double worstRelativeError; // Over the watched sensors when the run stopped
+};
+
+// Photons needed for one sensor to meet the criteria, extrapolated with error ~ 1/sqrt(N);
+// 0 when it already does, UINT64_MAX when it has no hits yet
+uint64_t photonsToConverge(const BatchResult& result, size_t sensor, const ConvergenceCriteria& criteria);
+
+// Trace rounds of photons, continuing the same photon index space, until every watched sensor
+// meets the criteria. The round sizes depend only on the tallies, so the run is reproducible.
+ConvergenceResult traceUntilConverged(const TransportConfig& config, const SensorIndex& sensors,
+                                      const ConvergenceCriteria& criteria, unsigned threads = 1,
+                                      TraceKernel kernel = TRACE_PACKET, const TraceHooks& hooks = TraceHooks());
+
+#endif // PHOTON_CONVERGENCE_H
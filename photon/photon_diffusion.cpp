@@ -0,0 +1,278 @@
+#include "photon_diffusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define DIFFUSION_MAX_ITERATIONS 200
+#define DIFFUSION_COARSEST 4 // Cells across the smaller side of the coarsest multigrid level
+#define DIFFUSION_COARSE_SWEEPS 20 // Smoothing sweeps that stand in for a solve on the coarsest level
+
+// Symmetric five-point operator on an nx x ny grid: row c is diag[c] phi[c] minus east[c] times its
+// neighbour c + 1 and north[c] times c + nx (and the transposed couplings of c - 1 and c - nx)
+struct DiffusionLevel {
+    int nx;
+    int ny;
+    std::vector<double> diag;
+    std::vector<double> east; // 0 in the last column
+    std::vector<double> north; // 0 in the last row
+    std::vector<double> x; // Scratch of the V-cycle: correction, right-hand side and residual
+    std::vector<double> b;
+    std::vector<double> r;
+};
+
+double diffusionCoefficient(const TransportConfig& config) {
+    double absorption = 1.0 / config.absorptionLength;
+    double reducedScattering = (1.0 - config.anisotropy) / config.meanFreePath;
+    return 1.0 / (2.0 * (absorption + reducedScattering));
+}
+
+// Bilinear weights of point (x, y) over the four nearest cell centres, for the source
+static void cellWeights(float x, float y, float cellWidth, float cellHeight, int nx, int ny, int cell[4],
+                        double weight[4]) {
+    double u = std::min(std::max(x / cellWidth - 0.5, 0.0), nx - 1.0);
+    double v = std::min(std::max(y / cellHeight - 0.5, 0.0), ny - 1.0);
+    int i = std::min(static_cast<int>(u), std::max(nx - 2, 0));
+    int j = std::min(static_cast<int>(v), std::max(ny - 2, 0));
+    double fu = u - i;
+    double fv = v - j;
+    int i1 = std::min(i + 1, nx - 1);
+    int j1 = std::min(j + 1, ny - 1);
+    cell[0] = j * nx + i;
+    cell[1] = j * nx + i1;
+    cell[2] = j1 * nx + i;
+    cell[3] = j1 * nx + i1;
+    weight[0] = (1 - fu) * (1 - fv);
+    weight[1] = fu * (1 - fv);
+    weight[2] = (1 - fu) * fv;
+    weight[3] = fu * fv;
+}
+
+static void multiply(const DiffusionLevel& level, const std::vector<double>& x, std::vector<double>& out) {
+    const int nx = level.nx;
+    const int n = nx * level.ny;
+    for (int c = 0; c < n; ++c) {
+        double sum = level.diag[c] * x[c];
+        if (c % nx + 1 < nx) sum -= level.east[c] * x[c + 1];
+        if (c % nx > 0) sum -= level.east[c - 1] * x[c - 1];
+        if (c + nx < n) sum -= level.north[c] * x[c + nx];
+        if (c >= nx) sum -= level.north[c - nx] * x[c - nx];
+        out[c] = sum;
+    }
+}
+
+// Gauss-Seidel update of the cells of one colour of the red-black checkerboard
+static void relaxColour(DiffusionLevel& level, int colour) {
+    const int nx = level.nx;
+    const int ny = level.ny;
+    for (int j = 0; j < ny; ++j) {
+        for (int i = (j + colour) & 1; i < nx; i += 2) {
+            int c = j * nx + i;
+            double sum = level.b[c];
+            if (i + 1 < nx) sum += level.east[c] * level.x[c + 1];
+            if (i > 0) sum += level.east[c - 1] * level.x[c - 1];
+            if (j + 1 < ny) sum += level.north[c] * level.x[c + nx];
+            if (j > 0) sum += level.north[c - nx] * level.x[c - nx];
+            level.x[c] = sum / level.diag[c];
+        }
+    }
+}
+
+// Galerkin coarsening with 2 x 2 aggregates: the coarse operator is P^T A P for the piecewise
+// constant prolongation P, which again is a five-point operator
+static DiffusionLevel coarsen(const DiffusionLevel& fine) {
+    DiffusionLevel coarse;
+    coarse.nx = (fine.nx + 1) / 2;
+    coarse.ny = (fine.ny + 1) / 2;
+    size_t n = static_cast<size_t>(coarse.nx) * coarse.ny;
+    coarse.diag.assign(n, 0.0);
+    coarse.east.assign(n, 0.0);
+    coarse.north.assign(n, 0.0);
+    for (int j = 0; j < fine.ny; ++j) {
+        for (int i = 0; i < fine.nx; ++i) {
+            int c = j * fine.nx + i;
+            int C = (j / 2) * coarse.nx + i / 2;
+            coarse.diag[C] += fine.diag[c];
+            if (i + 1 < fine.nx) {
+                if ((i & 1) == 0) coarse.diag[C] -= 2.0 * fine.east[c]; // Inside the aggregate
+                else coarse.east[C] += fine.east[c];
+            }
+            if (j + 1 < fine.ny) {
+                if ((j & 1) == 0) coarse.diag[C] -= 2.0 * fine.north[c];
+                else coarse.north[C] += fine.north[c];
+            }
+        }
+    }
+    coarse.x.resize(n);
+    coarse.b.resize(n);
+    coarse.r.resize(n);
+    return coarse;
+}
+
+// One V-cycle for levels[l].x from levels[l].b, starting at zero; red-black before the descent and
+// black-red after it, so the cycle is a symmetric preconditioner
+static void vcycle(std::vector<DiffusionLevel>& levels, size_t l) {
+    DiffusionLevel& level = levels[l];
+    std::fill(level.x.begin(), level.x.end(), 0.0);
+    if (l + 1 == levels.size()) {
+        for (int sweep = 0; sweep < DIFFUSION_COARSE_SWEEPS; ++sweep) {
+            relaxColour(level, 0);
+            relaxColour(level, 1);
+        }
+        for (int sweep = 0; sweep < DIFFUSION_COARSE_SWEEPS; ++sweep) {
+            relaxColour(level, 1);
+            relaxColour(level, 0);
+        }
+        return;
+    }
+
+    relaxColour(level, 0);
+    relaxColour(level, 1);
+    multiply(level, level.x, level.r);
+    DiffusionLevel& coarse = levels[l + 1];
+    std::fill(coarse.b.begin(), coarse.b.end(), 0.0);
+    for (int j = 0; j < level.ny; ++j) {
+        for (int i = 0; i < level.nx; ++i) {
+            int c = j * level.nx + i;
+            coarse.b[(j / 2) * coarse.nx + i / 2] += level.b[c] - level.r[c];
+        }
+    }
+    vcycle(levels, l + 1);
+    for (int j = 0; j < level.ny; ++j) {
+        for (int i = 0; i < level.nx; ++i) {
+            level.x[j * level.nx + i] += coarse.x[(j / 2) * coarse.nx + i / 2];
+        }
+    }
+    relaxColour(level, 1);
+    relaxColour(level, 0);
+}
+
+static double dot(const std::vector<double>& a, const std::vector<double>& b) {
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+DiffusionResult solveDiffusion(const TransportConfig& config, const SensorCenters& sensors, int cellsX, int cellsY,
+                               double tolerance) {
+    const float cellWidth = config.boxWidth / cellsX;
+    const float cellHeight = config.boxHeight / cellsY;
+    const double D = diffusionCoefficient(config);
+    const double extrapolation = M_PI * D / 2.0; // Where the linear fluence profile reaches zero outside the wall
+    const double area = static_cast<double>(cellWidth) * cellHeight;
+    const size_t n = static_cast<size_t>(cellsX) * cellsY;
+
+    std::vector<DiffusionLevel> levels(1);
+    DiffusionLevel& fine = levels[0];
+    fine.nx = cellsX;
+    fine.ny = cellsY;
+    fine.diag.assign(n, area / config.absorptionLength);
+    fine.east.assign(n, 0.0);
+    fine.north.assign(n, 0.0);
+    fine.x.resize(n);
+    fine.b.resize(n);
+    fine.r.resize(n);
+    const double eastConductance = D * cellHeight / cellWidth;
+    const double northConductance = D * cellWidth / cellHeight;
+    const double sideWall = D * cellHeight / (cellWidth / 2.0 + extrapolation);
+    const double floorWall = D * cellWidth / (cellHeight / 2.0 + extrapolation);
+    for (int j = 0; j < cellsY; ++j) {
+        for (int i = 0; i < cellsX; ++i) {
+            size_t c = static_cast<size_t>(j) * cellsX + i;
+            if (i + 1 < cellsX) {
+                fine.east[c] = eastConductance;
+                fine.diag[c] += eastConductance;
+                fine.diag[c + 1] += eastConductance;
+            }
+            if (j + 1 < cellsY) {
+                fine.north[c] = northConductance;
+                fine.diag[c] += northConductance;
+                fine.diag[c + cellsX] += northConductance;
+            }
+            if (i == 0) fine.diag[c] += sideWall;
+            if (i + 1 == cellsX) fine.diag[c] += sideWall;
+            if (j == 0) fine.diag[c] += floorWall;
+            if (j + 1 == cellsY) fine.diag[c] += floorWall;
+        }
+    }
+
+    // Each sensor drains its cell through the well index of Peaceman: the cell value is the fluence
+    // at the equivalent radius 0.14 sqrt(hx^2 + hy^2) from a point sink, and between there and the
+    // disc the flow meets the diffusion resistance ln(r_eq / r) / (2 pi D) in series with the
+    // sensor's own 1 / (2 r). Where the cells are finer than the sensor the log turns negative; it
+    // is kept to half the sensor's resistance so the sink stays finite.
+    const double equivalentRadius = 0.14 * std::sqrt(static_cast<double>(cellWidth) * cellWidth +
+                                                     static_cast<double>(cellHeight) * cellHeight);
+    const double sensorResistance = 1.0 / (2.0 * config.sensorRadius);
+    const double wellResistance = std::max(std::log(equivalentRadius / config.sensorRadius) / (2.0 * M_PI * D),
+                                           -0.5 * sensorResistance);
+    const double sensorConductance = 1.0 / (sensorResistance + wellResistance);
+    std::vector<int> sensorCells(sensors.size());
+    for (size_t s = 0; s < sensors.size(); ++s) {
+        int i = std::min(cellsX - 1, std::max(0, static_cast<int>(sensors[s].first / cellWidth)));
+        int j = std::min(cellsY - 1, std::max(0, static_cast<int>(sensors[s].second / cellHeight)));
+        sensorCells[s] = j * cellsX + i;
+        fine.diag[sensorCells[s]] += sensorConductance;
+    }
+
+    std::vector<double> source(n, 0.0);
+    int emitterCells[4];
+    double emitterWeights[4];
+    cellWeights(config.emitterX, config.emitterY, cellWidth, cellHeight, cellsX, cellsY, emitterCells, emitterWeights);
+    for (int k = 0; k < 4; ++k) {
+        source[emitterCells[k]] += emitterWeights[k];
+    }
+
+    while (std::min(levels.back().nx, levels.back().ny) > DIFFUSION_COARSEST) {
+        levels.push_back(coarsen(levels.back()));
+    }
+
+    // Conjugate gradients on A phi = source, preconditioned by a V-cycle
+    DiffusionResult result;
+    result.cellsX = cellsX;
+    result.cellsY = cellsY;
+    result.fluence.assign(n, 0.0);
+    std::vector<double>& phi = result.fluence;
+    std::vector<double> residual = source;
+    std::vector<double> direction(n);
+    std::vector<double> product(n);
+    const double sourceNorm = std::sqrt(dot(source, source));
+    levels[0].b = residual;
+    vcycle(levels, 0);
+    direction = levels[0].x;
+    double rz = dot(residual, direction);
+    result.iterations = 0;
+    result.residual = 1.0;
+    while (result.iterations < DIFFUSION_MAX_ITERATIONS) {
+        multiply(levels[0], direction, product);
+        double alpha = rz / dot(direction, product);
+        for (size_t c = 0; c < n; ++c) {
+            phi[c] += alpha * direction[c];
+            residual[c] -= alpha * product[c];
+        }
+        result.iterations++;
+        result.residual = std::sqrt(dot(residual, residual)) / sourceNorm;
+        if (result.residual <= tolerance) break;
+
+        levels[0].b = residual;
+        vcycle(levels, 0);
+        double rzNext = dot(residual, levels[0].x);
+        double beta = rzNext / rz;
+        rz = rzNext;
+        for (size_t c = 0; c < n; ++c) {
+            direction[c] = levels[0].x[c] + beta * direction[c];
+        }
+    }
+
+    // The balance of each cell was written for one emitted photon, so phi is already the fluence
+    // per emitted photon; far from the emitter it can dip below zero within the tolerance
+    for (size_t c = 0; c < n; ++c) {
+        phi[c] = std::max(phi[c], 0.0);
+    }
+    result.sensorFraction.resize(sensors.size());
+    for (size_t s = 0; s < sensors.size(); ++s) {
+        result.sensorFraction[s] = sensorConductance * phi[sensorCells[s]];
+    }
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef PHOTON_DIFFUSION_H
+#define PHOTON_DIFFUSION_H
+
+#include "photon_transport.h"
+
+#include <vector>
+
+// Steady-state diffusion approximation of the 2D transport: the fluence solves
+//   -div(D grad phi) + mu_a phi + sensor sinks = point source at the emitter
+// with D = 1 / (2 (mu_a + (1 - g) mu_s)), the 2D diffusion coefficient, and the partial-current
+// condition phi + (pi D / 2) dphi/dn = 0 on the walls, which let photons out but never back in.
+// A sensor of radius r alone would take 2 r phi, the rate at which isotropic 2D flights enter a
+// disc; on the grid it becomes a sink in its cell, coupled through a Peaceman well index so the
+// result does not depend on the cell size; this holds while r is small against the transport mean
+// free path 1 / (mu_a + (1 - g) mu_s). The approximation needs many scatters per photon
+// (mean free path well below the box) and is off within a mean free path or two of the emitter.
+struct DiffusionResult {
+    int cellsX;
+    int cellsY;
+    std::vector<double> fluence; // Per emitted photon per unit area, rows from y = 0, x fastest (as fluenceValues())
+    std::vector<double> sensorFraction; // Fraction of the emitted photons each sensor detects
+    int iterations; // Preconditioned CG iterations
+    double residual; // Final residual relative to the source
+};
+
+// 2D diffusion coefficient of the config's medium
+double diffusionCoefficient(const TransportConfig& config);
+
+// Solve on a cellsX x cellsY cell-centred finite-volume grid over the box with conjugate gradients,
+// preconditioned by one geometric multigrid V-cycle per iteration, down to the relative residual
+// tolerance
+DiffusionResult solveDiffusion(const TransportConfig& config, const SensorCenters& sensors, int cellsX, int cellsY,
+                               double tolerance = 1e-8);
+
+#endif // PHOTON_DIFFUSION_H
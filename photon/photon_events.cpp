@@ -0,0 +1,274 @@
+#include "photon_events.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Position of file, 64-bit on every platform
+static uint64_t fileOffset(FILE* file) {
+#ifdef _WIN32
+    return static_cast<uint64_t>(_ftelli64(file));
+#else
+    return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+// Bytes of a block with count events, header and padding included
+static size_t blockBytes(uint32_t count) {
+    size_t bytes = sizeof(EventBlockHeader) + count * (sizeof(uint64_t) + 6 * sizeof(uint32_t));
+    return (bytes + 7) & ~static_cast<size_t>(7);
+}
+
+void PhotonEvents::clear() {
+    id.clear();
+    target.clear();
+    x.clear();
+    y.clear();
+    pathLength.clear();
+    scatters.clear();
+    weight.clear();
+}
+
+void PhotonEvents::reserve(size_t n) {
+    id.reserve(n);
+    target.reserve(n);
+    x.reserve(n);
+    y.reserve(n);
+    pathLength.reserve(n);
+    scatters.reserve(n);
+    weight.reserve(n);
+}
+
+void PhotonEvents::push(uint64_t id, int32_t target, float x, float y, float pathLength, uint32_t scatters,
+                        float weight) {
+    this->id.push_back(id);
+    this->target.push_back(target);
+    this->x.push_back(x);
+    this->y.push_back(y);
+    this->pathLength.push_back(pathLength);
+    this->scatters.push_back(scatters);
+    this->weight.push_back(weight);
+}
+
+EventStreamWriter::EventStreamWriter() : file(NULL), written(0), failed(false) {}
+
+EventStreamWriter::~EventStreamWriter() {
+    close();
+}
+
+bool EventStreamWriter::open(const std::string& path, uint64_t seed, uint32_t sensorCount) {
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    std::setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    EventFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, EVENT_FILE_MAGIC, sizeof(header.magic));
+    header.seed = seed;
+    header.sensorCount = sensorCount;
+    failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+
+    written = 0;
+    pending.clear();
+    pending.reserve(EVENT_BLOCK_CAPACITY);
+    return true;
+}
+
+bool EventStreamWriter::reopen(const std::string& path, uint64_t bytes, uint64_t events) {
+    close();
+    file = std::fopen(path.c_str(), "r+b");
+    if (!file) return false;
+#ifdef _WIN32
+    bool cut = _chsize_s(_fileno(file), static_cast<__int64>(bytes)) == 0;
+#else
+    bool cut = ftruncate(fileno(file), static_cast<off_t>(bytes)) == 0;
+#endif
+    if (!cut || std::fseek(file, 0, SEEK_END) != 0) {
+        close();
+        return false;
+    }
+    std::setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    written = events;
+    failed = false;
+    pending.clear();
+    pending.reserve(EVENT_BLOCK_CAPACITY);
+    return true;
+}
+
+void EventStreamWriter::append(const PhotonEvents& events) {
+    size_t offset = 0;
+    while (offset < events.size()) {
+        size_t take = std::min<size_t>(events.size() - offset, EVENT_BLOCK_CAPACITY - pending.size());
+        pending.id.insert(pending.id.end(), events.id.begin() + offset, events.id.begin() + offset + take);
+        pending.target.insert(pending.target.end(), events.target.begin() + offset,
+                              events.target.begin() + offset + take);
+        pending.x.insert(pending.x.end(), events.x.begin() + offset, events.x.begin() + offset + take);
+        pending.y.insert(pending.y.end(), events.y.begin() + offset, events.y.begin() + offset + take);
+        pending.pathLength.insert(pending.pathLength.end(), events.pathLength.begin() + offset,
+                                  events.pathLength.begin() + offset + take);
+        pending.scatters.insert(pending.scatters.end(), events.scatters.begin() + offset,
+                                events.scatters.begin() + offset + take);
+        pending.weight.insert(pending.weight.end(), events.weight.begin() + offset,
+                              events.weight.begin() + offset + take);
+        offset += take;
+        if (pending.size() == EVENT_BLOCK_CAPACITY) {
+            flushBlock();
+        }
+    }
+}
+
+void EventStreamWriter::flushBlock() {
+    if (!file || pending.size() == 0) return;
+
+    uint32_t count = static_cast<uint32_t>(pending.size());
+    EventBlockHeader header = { EVENT_BLOCK_MAGIC, count };
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && std::fwrite(pending.id.data(), sizeof(uint64_t), count, file) == count;
+    ok = ok && std::fwrite(pending.target.data(), sizeof(int32_t), count, file) == count;
+    ok = ok && std::fwrite(pending.x.data(), sizeof(float), count, file) == count;
+    ok = ok && std::fwrite(pending.y.data(), sizeof(float), count, file) == count;
+    ok = ok && std::fwrite(pending.pathLength.data(), sizeof(float), count, file) == count;
+    ok = ok && std::fwrite(pending.scatters.data(), sizeof(uint32_t), count, file) == count;
+    ok = ok && std::fwrite(pending.weight.data(), sizeof(float), count, file) == count;
+
+    static const char padding[8] = { 0 };
+    size_t used = sizeof(header) + count * (sizeof(uint64_t) + 6 * sizeof(uint32_t));
+    size_t pad = blockBytes(count) - used;
+    ok = ok && std::fwrite(padding, 1, pad, file) == pad;
+    failed = failed || !ok;
+
+    written += count;
+    pending.clear();
+}
+
+uint64_t EventStreamWriter::sync() {
+    if (!file) return 0;
+    flushBlock();
+    failed = failed || std::fflush(file) != 0;
+    return fileOffset(file);
+}
+
+bool EventStreamWriter::close() {
+    if (!file) return !failed;
+    flushBlock();
+    failed = failed || std::fclose(file) != 0;
+    file = NULL;
+    return !failed;
+}
+
+EventStreamReader::EventStreamReader() : data(NULL), bytes(0), events(0) {
+#ifdef _WIN32
+    fileHandle = NULL;
+    mappingHandle = NULL;
+#endif
+}
+
+EventStreamReader::~EventStreamReader() {
+    close();
+}
+
+bool EventStreamReader::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    bytes = static_cast<size_t>(size.QuadPart);
+    HANDLE mapping = bytes ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    fileHandle = file;
+    mappingHandle = mapping;
+    if (!view) {
+        close();
+        return false;
+    }
+    data = static_cast<const unsigned char*>(view);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    bytes = static_cast<size_t>(info.st_size);
+    void* view = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the file alive
+    if (view == MAP_FAILED) {
+        bytes = 0;
+        return false;
+    }
+    madvise(view, bytes, MADV_SEQUENTIAL);
+    data = static_cast<const unsigned char*>(view);
+#endif
+
+    if (bytes < sizeof(EventFileHeader) || std::memcmp(data, EVENT_FILE_MAGIC, 8) != 0) {
+        close();
+        return false;
+    }
+
+    // Walk the block headers; a torn block at the end is ignored
+    size_t offset = sizeof(EventFileHeader);
+    while (offset + sizeof(EventBlockHeader) <= bytes) {
+        EventBlockHeader block;
+        std::memcpy(&block, data + offset, sizeof(block));
+        if (block.magic != EVENT_BLOCK_MAGIC || offset + blockBytes(block.count) > bytes) break;
+        blockOffsets.push_back(offset);
+        events += block.count;
+        offset += blockBytes(block.count);
+    }
+    return true;
+}
+
+void EventStreamReader::close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mappingHandle) CloseHandle(static_cast<HANDLE>(mappingHandle));
+    if (fileHandle) CloseHandle(static_cast<HANDLE>(fileHandle));
+    fileHandle = NULL;
+    mappingHandle = NULL;
+#else
+    if (data) munmap(const_cast<unsigned char*>(data), bytes);
+#endif
+    data = NULL;
+    bytes = 0;
+    blockOffsets.clear();
+    events = 0;
+}
+
+EventBlockView EventStreamReader::block(size_t i) const {
+    const unsigned char* p = data + blockOffsets[i];
+    EventBlockView view;
+    view.count = reinterpret_cast<const EventBlockHeader*>(p)->count;
+    p += sizeof(EventBlockHeader);
+    view.id = reinterpret_cast<const uint64_t*>(p);
+    p += view.count * sizeof(uint64_t);
+    view.target = reinterpret_cast<const int32_t*>(p);
+    p += view.count * sizeof(int32_t);
+    view.x = reinterpret_cast<const float*>(p);
+    p += view.count * sizeof(float);
+    view.y = reinterpret_cast<const float*>(p);
+    p += view.count * sizeof(float);
+    view.pathLength = reinterpret_cast<const float*>(p);
+    p += view.count * sizeof(float);
+    view.scatters = reinterpret_cast<const uint32_t*>(p);
+    p += view.count * sizeof(uint32_t);
+    view.weight = reinterpret_cast<const float*>(p);
+    return view;
+}
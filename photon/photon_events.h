@@ -0,0 +1,121 @@
+#ifndef PHOTON_EVENTS_H
+#define PHOTON_EVENTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Target column values other than a sensor index
+#define EVENT_WALL -1
+#define EVENT_ABSORBED -2
+
+#define EVENT_BLOCK_CAPACITY 65536 // Events per block written by EventStreamWriter
+#define EVENT_FILE_MAGIC "PHOTEVT1"
+#define EVENT_BLOCK_MAGIC 0x4b4c4250u // "PBLK"
+
+// Terminal events of a range of photons, one column per field
+struct PhotonEvents {
+    std::vector<uint64_t> id;
+    std::vector<int32_t> target; // Sensor index, EVENT_WALL or EVENT_ABSORBED
+    std::vector<float> x; // Where the photon stopped
+    std::vector<float> y;
+    std::vector<float> pathLength;
+    std::vector<uint32_t> scatters;
+    std::vector<float> weight; // Detected weight, always 1 in analog mode
+
+    size_t size() const { return id.size(); }
+    void clear();
+    void reserve(size_t n);
+    void push(uint64_t id, int32_t target, float x, float y, float pathLength, uint32_t scatters, float weight);
+};
+
+// File layout (little endian, every column aligned to its element size):
+//   EventFileHeader
+//   blocks of { EventBlockHeader, id[count], target[count], x[count], y[count], pathLength[count],
+//               scatters[count], weight[count], padding to 8 bytes }
+// A block is only valid once complete, so a file cut short by a crash reads up to its last whole block.
+struct EventFileHeader {
+    char magic[8]; // EVENT_FILE_MAGIC
+    uint64_t seed; // Stream key of the run that wrote the file
+    uint32_t sensorCount;
+    uint32_t reserved;
+    uint64_t reserved2;
+};
+
+struct EventBlockHeader {
+    uint32_t magic; // EVENT_BLOCK_MAGIC
+    uint32_t count;
+};
+
+// Appends events to a file in blocks of EVENT_BLOCK_CAPACITY. Events are copied into the pending
+// block column by column and written with one fwrite per column when the block is full. A failed
+// write (a full disk, an I/O error) is remembered until the next open; check good() or close().
+struct EventStreamWriter {
+    EventStreamWriter();
+    ~EventStreamWriter();
+
+    bool open(const std::string& path, uint64_t seed, uint32_t sensorCount);
+    bool reopen(const std::string& path, uint64_t bytes, uint64_t events); // Continue a file cut back to bytes
+    void append(const PhotonEvents& events);
+    uint64_t sync(); // Writes the pending events as a short block and returns the file size
+    bool close(); // Writes the partial last block; false if any write since open failed
+
+    bool isOpen() const { return file != NULL; }
+    bool good() const { return !failed; } // Every write since open reached the file
+    uint64_t eventCount() const { return written + pending.size(); }
+
+private:
+    FILE* file;
+    PhotonEvents pending;
+    uint64_t written;
+    bool failed;
+
+    void flushBlock();
+
+    EventStreamWriter(const EventStreamWriter&);
+    EventStreamWriter& operator=(const EventStreamWriter&);
+};
+
+// Columns of one block, pointing into the mapped file
+struct EventBlockView {
+    uint32_t count;
+    const uint64_t* id;
+    const int32_t* target;
+    const float* x;
+    const float* y;
+    const float* pathLength;
+    const uint32_t* scatters;
+    const float* weight;
+};
+
+// Memory-maps an event file. Only the block headers are touched on open; the columns are paged in
+// by the OS as they are read, so files larger than memory can be scanned block by block.
+struct EventStreamReader {
+    EventStreamReader();
+    ~EventStreamReader();
+
+    bool open(const std::string& path);
+    void close();
+
+    const EventFileHeader& header() const { return *reinterpret_cast<const EventFileHeader*>(data); }
+    size_t blockCount() const { return blockOffsets.size(); }
+    EventBlockView block(size_t i) const;
+    uint64_t eventCount() const { return events; }
+
+private:
+    const unsigned char* data;
+    size_t bytes;
+    std::vector<size_t> blockOffsets;
+    uint64_t events;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+
+    EventStreamReader(const EventStreamReader&);
+    EventStreamReader& operator=(const EventStreamReader&);
+};
+
+#endif // PHOTON_EVENTS_H
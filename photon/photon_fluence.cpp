@@ -0,0 +1,66 @@
+#include "photon_fluence.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+void tallyTrack(std::vector<double>& grid, const TransportConfig& config, float x0, float y0, float x1, float y1,
+                float weight) {
+    const int cellsX = config.fluenceCellsX;
+    const int cellsY = config.fluenceCellsY;
+    const float cellWidth = config.boxWidth / cellsX;
+    const float cellHeight = config.boxHeight / cellsY;
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if (length <= 0.0f) return;
+
+    // Walk the cells along the segment (Amanatides-Woo), t running from 0 to 1
+    int ix = std::min(cellsX - 1, std::max(0, static_cast<int>(x0 / cellWidth)));
+    int iy = std::min(cellsY - 1, std::max(0, static_cast<int>(y0 / cellHeight)));
+    const float inf = std::numeric_limits<float>::infinity();
+    int stepX = dx > 0.0f ? 1 : -1;
+    int stepY = dy > 0.0f ? 1 : -1;
+    float tDeltaX = dx != 0.0f ? cellWidth / std::fabs(dx) : inf;
+    float tDeltaY = dy != 0.0f ? cellHeight / std::fabs(dy) : inf;
+    float tMaxX = dx != 0.0f ? ((ix + (dx > 0.0f)) * cellWidth - x0) / dx : inf;
+    float tMaxY = dy != 0.0f ? ((iy + (dy > 0.0f)) * cellHeight - y0) / dy : inf;
+
+    double scale = static_cast<double>(length) * weight;
+    float t = 0.0f;
+    while (true) {
+        float next = std::min(1.0f, std::min(tMaxX, tMaxY));
+        grid[static_cast<size_t>(iy) * cellsX + ix] += (next - t) * scale;
+        t = next;
+        if (t >= 1.0f) break;
+        if (tMaxX < tMaxY) {
+            ix += stepX;
+            tMaxX += tDeltaX;
+        } else {
+            iy += stepY;
+            tMaxY += tDeltaY;
+        }
+        if (ix < 0 || ix >= cellsX || iy < 0 || iy >= cellsY) break; // Rounding at the wall
+    }
+}
+
+std::vector<float> fluenceValues(const BatchResult& result, const TransportConfig& config) {
+    std::vector<float> values(result.fluence.size(), 0.0f);
+    if (result.photons == 0 || result.fluence.empty()) return values;
+    double cellArea = static_cast<double>(config.boxWidth) / config.fluenceCellsX * config.boxHeight /
+                      config.fluenceCellsY;
+    double scale = 1.0 / (cellArea * static_cast<double>(result.photons));
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<float>(result.fluence[i] * scale);
+    }
+    return values;
+}
+
+bool writeFluenceRaw(const std::string& path, const BatchResult& result, const TransportConfig& config) {
+    std::vector<float> values = fluenceValues(result, config);
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(values.data(), sizeof(float), values.size(), file) == values.size();
+    return std::fclose(file) == 0 && ok;
+}
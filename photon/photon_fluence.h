@@ -0,0 +1,24 @@
+#ifndef PHOTON_FLUENCE_H
+#define PHOTON_FLUENCE_H
+
+#include "photon_transport.h"
+
+#include <string>
+#include <vector>
+
+// Fluence grid tally: the box is cut into config.fluenceCellsX x config.fluenceCellsY cells and
+// every flight adds its length inside each cell it crosses, times the packet weight it carried.
+// Cells are stored row by row from y = 0, x fastest. Each chunk (and each live worker) fills its
+// own grid, which is summed into the others afterwards, so no cell is ever shared between threads.
+
+// Add the flight from (x0, y0) to (x1, y1) inside the box to grid
+void tallyTrack(std::vector<double>& grid, const TransportConfig& config, float x0, float y0, float x1, float y1,
+                float weight);
+
+// Fluence per emitted photon, track length per unit area, one float per cell
+std::vector<float> fluenceValues(const BatchResult& result, const TransportConfig& config);
+
+// fluenceValues() as a raw array of native-endian 32-bit floats, fluenceCellsY rows of fluenceCellsX
+bool writeFluenceRaw(const std::string& path, const BatchResult& result, const TransportConfig& config);
+
+#endif // PHOTON_FLUENCE_H
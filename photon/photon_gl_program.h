@@ -0,0 +1,10 @@
+#ifndef PHOTON_GL_PROGRAM_H
+#define PHOTON_GL_PROGRAM_H
+
+#include <GL/glew.h>
+
+// Compile and link a vertex and a fragment shader into a program. Compiler and linker logs go to
+// stdout; ok is cleared on failure and left alone otherwise, so several builds can share one flag.
+GLuint buildProgram(const char* vertexSource, const char* fragmentSource, bool& ok);
+
+#endif // PHOTON_GL_PROGRAM_H
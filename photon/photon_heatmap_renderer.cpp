@@ -0,0 +1,106 @@
+#include "photon_heatmap_renderer.h"
+#include "photon_gl_program.h"
+
+#include <algorithm>
+
+// Vertex shader: a quad in world coordinates, with its texture coordinates
+static const char* heatmapVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec2 aPos;
+    layout (location = 1) in vec2 aCell;
+    uniform vec4 view; // left, right, bottom, top
+    out vec2 cell;
+    void main() {
+        vec2 ndc = 2.0 * (aPos - view.xz) / (view.yw - view.xz) - 1.0;
+        gl_Position = vec4(ndc, 0.0, 1.0);
+        cell = aCell;
+    }
+)glsl";
+
+// Log scale over three decades below the largest cell, black through red and yellow to white
+static const char* heatmapFragmentShaderSource = R"glsl(
+    #version 330 core
+    in vec2 cell;
+    out vec4 FragColor;
+    uniform sampler2D grid;
+    uniform float maxValue;
+    void main() {
+        float v = texture(grid, cell).r;
+        float t = maxValue > 0.0 ? log(1.0 + 1000.0 * v / maxValue) / log(1001.0) : 0.0;
+        vec3 color = clamp(vec3(3.0 * t, 3.0 * t - 1.0, 3.0 * t - 2.0), 0.0, 1.0);
+        FragColor = vec4(color, 1.0);
+    }
+)glsl";
+
+bool initHeatmapRenderer(HeatmapRenderer& heatmap, int cellsX, int cellsY) {
+    bool ok = true;
+    heatmap.program = buildProgram(heatmapVertexShaderSource, heatmapFragmentShaderSource, ok);
+
+    heatmap.viewLocation = glGetUniformLocation(heatmap.program, "view");
+    heatmap.maxLocation = glGetUniformLocation(heatmap.program, "maxValue");
+    heatmap.cellsX = cellsX;
+    heatmap.cellsY = cellsY;
+    heatmap.staging.assign(static_cast<size_t>(cellsX) * cellsY, 0.0f);
+
+    // One float per cell; linear filtering blends neighbouring cells
+    glGenTextures(1, &heatmap.texture);
+    glBindTexture(GL_TEXTURE_2D, heatmap.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, cellsX, cellsY, 0, GL_RED, GL_FLOAT, heatmap.staging.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The quad's corners are set at draw time, since they depend on the box size
+    glGenVertexArrays(1, &heatmap.vao);
+    glGenBuffers(1, &heatmap.vbo);
+    glBindVertexArray(heatmap.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, heatmap.vbo);
+    glBufferData(GL_ARRAY_BUFFER, 16 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return ok;
+}
+
+void drawHeatmap(HeatmapRenderer& heatmap, const std::vector<double>& grid, GLfloat width, GLfloat height,
+                 GLfloat left, GLfloat right, GLfloat bottom, GLfloat top) {
+    if (grid.size() != heatmap.staging.size()) return;
+
+    GLfloat maxValue = 0.0f;
+    for (size_t i = 0; i < grid.size(); ++i) {
+        heatmap.staging[i] = static_cast<GLfloat>(grid[i]);
+        maxValue = std::max(maxValue, heatmap.staging[i]);
+    }
+    glBindTexture(GL_TEXTURE_2D, heatmap.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, heatmap.cellsX, heatmap.cellsY, GL_RED, GL_FLOAT, heatmap.staging.data());
+
+    // Triangle strip: x, y, u, v per corner
+    GLfloat quad[16] = { 0.0f, 0.0f, 0.0f, 0.0f, width, 0.0f, 1.0f, 0.0f,
+                         0.0f, height, 0.0f, 1.0f, width, height, 1.0f, 1.0f };
+    glBindBuffer(GL_ARRAY_BUFFER, heatmap.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(quad), quad);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glUseProgram(heatmap.program);
+    glUniform4f(heatmap.viewLocation, left, right, bottom, top);
+    glUniform1f(heatmap.maxLocation, maxValue);
+    glBindVertexArray(heatmap.vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void destroyHeatmapRenderer(HeatmapRenderer& heatmap) {
+    glDeleteVertexArrays(1, &heatmap.vao);
+    glDeleteBuffers(1, &heatmap.vbo);
+    glDeleteTextures(1, &heatmap.texture);
+    glDeleteProgram(heatmap.program);
+    heatmap.staging.clear();
+}
@@ -0,0 +1,30 @@
+#ifndef PHOTON_HEATMAP_RENDERER_H
+#define PHOTON_HEATMAP_RENDERER_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// A cell grid shown as one textured quad. Every draw converts the grid to floats, uploads it with a
+// single glTexSubImage2D and colours it in the fragment shader on a log scale relative to the
+// largest cell, so the picture is independent of how many photons have been traced.
+struct HeatmapRenderer {
+    GLuint program;
+    GLuint vao;
+    GLuint vbo;
+    GLuint texture;
+    GLint viewLocation;
+    GLint maxLocation;
+    int cellsX;
+    int cellsY;
+    std::vector<GLfloat> staging; // Grid as floats, reused every frame
+};
+
+bool initHeatmapRenderer(HeatmapRenderer& heatmap, int cellsX, int cellsY);
+// Upload grid (cellsY rows of cellsX, from the bottom) and draw it over the world rectangle
+// [0, width] x [0, height], with [left, right] x [bottom, top] mapped to the viewport
+void drawHeatmap(HeatmapRenderer& heatmap, const std::vector<double>& grid, GLfloat width, GLfloat height,
+                 GLfloat left, GLfloat right, GLfloat bottom, GLfloat top);
+void destroyHeatmapRenderer(HeatmapRenderer& heatmap);
+
+#endif // PHOTON_HEATMAP_RENDERER_H
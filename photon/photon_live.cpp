@@ -0,0 +1,143 @@
+#include "photon_live.h"
+#include "photon_fluence.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// Add grid into share unless the render thread holds it; grid is cleared once handed over
+static void handOverFluence(std::vector<double>& grid, LiveFluence& share) {
+    std::unique_lock<std::mutex> lock(share.mutex, std::try_to_lock);
+    if (!lock.owns_lock()) return;
+    for (size_t i = 0; i < grid.size(); ++i) {
+        share.pending[i] += grid[i];
+    }
+    std::fill(grid.begin(), grid.end(), 0.0);
+}
+
+// Turn a kept path into segments; the angle of a step is the direction the photon leaves its end in
+static void pathSegments(const PathStore& store, const PathRecord& record, std::vector<TraceSegment>& segments) {
+    segments.clear();
+    for (size_t i = 0; i + 1 < record.count; ++i) {
+        TraceSegment segment;
+        segment.x0 = store.vertex(record, i).first;
+        segment.y0 = store.vertex(record, i).second;
+        segment.x1 = store.vertex(record, i + 1).first;
+        segment.y1 = store.vertex(record, i + 1).second;
+        size_t next = i + 2 < record.count ? i + 1 : i;
+        segment.angle = std::atan2(store.vertex(record, next + 1).second - store.vertex(record, next).second,
+                                   store.vertex(record, next + 1).first - store.vertex(record, next).first);
+        segment.fate = i + 2 < record.count ? PHOTON_ACTIVE : record.fate;
+        segments.push_back(segment);
+    }
+}
+
+static void runLiveWorker(LiveTracer& tracer, SegmentQueue& queue, LiveFluence& share) {
+    const TransportConfig& config = tracer.config;
+    PathStore store(tracer.retention, LIVE_PHOTON_BLOCK, LIVE_PATH_VERTICES, LIVE_DECIMATED_VERTICES);
+    std::vector<TraceSegment> path;
+    StepVariates variates;
+    std::vector<double> fluence(share.pending.size(), 0.0);
+    uint64_t blocks = 0;
+
+    while (tracer.running.load(std::memory_order_relaxed)) {
+        // Claim a block of indices, so the shared counters are touched once per block
+        uint64_t first = tracer.nextPhoton.fetch_add(LIVE_PHOTON_BLOCK, std::memory_order_relaxed);
+        uint64_t published = 0;
+        for (uint64_t n = first; n < first + LIVE_PHOTON_BLOCK; ++n) {
+            PhotonState photon = emitPhoton(config, n);
+            store.beginPath(n, photon.x, photon.y);
+            while (photon.fate == PHOTON_ACTIVE) {
+                uint32_t step = static_cast<uint32_t>(photon.scatters);
+                if (!variates.holds(n, step)) {
+                    fillStepVariates(variates, config.seed, n, step);
+                }
+                float x0 = photon.x;
+                float y0 = photon.y;
+                float weight = photon.weight;
+                stepPhoton(photon, config, tracer.sensors, variates.draws(step));
+                if (!fluence.empty()) {
+                    tallyTrack(fluence, config, x0, y0, photon.x, photon.y, weight);
+                }
+                store.appendVertex(photon.x, photon.y);
+            }
+            store.endPath(photon.fate, photon.sensor);
+
+            // The policy kept the path if it is now the newest in the store
+            size_t kept = store.pathCount();
+            if (kept == 0 || store.path(kept - 1).id != n) continue;
+            pathSegments(store, store.path(kept - 1), path);
+            if (queue.tryPush(path.data(), path.size())) {
+                published++;
+            }
+        }
+        tracer.photons.fetch_add(LIVE_PHOTON_BLOCK, std::memory_order_relaxed);
+        tracer.published.fetch_add(published, std::memory_order_relaxed);
+        if (!fluence.empty() && ++blocks % LIVE_FLUENCE_BLOCKS == 0) {
+            handOverFluence(fluence, share);
+        }
+    }
+}
+
+void startLiveTracer(LiveTracer& tracer, const TransportConfig& config, const SensorIndex& sensors,
+                     unsigned threads, PathRetention retention) {
+    if (threads == 0) {
+        threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+    tracer.config = config;
+    tracer.sensors = sensors;
+    tracer.retention = retention;
+    tracer.running = true;
+    tracer.nextQueue = 0;
+    size_t cells = static_cast<size_t>(config.fluenceCellsX) * config.fluenceCellsY;
+    tracer.fluence.assign(cells, 0.0);
+    for (unsigned i = 0; i < threads; ++i) {
+        tracer.queues.push_back(std::unique_ptr<SegmentQueue>(new SegmentQueue(LIVE_QUEUE_SEGMENTS)));
+        tracer.fluenceShares.push_back(std::unique_ptr<LiveFluence>(new LiveFluence()));
+        tracer.fluenceShares[i]->pending.assign(cells, 0.0);
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        tracer.workers.push_back(std::thread(runLiveWorker, std::ref(tracer), std::ref(*tracer.queues[i]),
+                                             std::ref(*tracer.fluenceShares[i])));
+    }
+}
+
+size_t drainLiveSegments(LiveTracer& tracer, TraceSegment* out, size_t maxCount) {
+    size_t queueCount = tracer.queues.size();
+    if (queueCount == 0) return 0;
+
+    // An even share per queue first, then whatever budget is left in turn, so a busy worker
+    // cannot crowd the others out of the view
+    size_t share = std::max<size_t>(1, maxCount / queueCount);
+    size_t count = 0;
+    for (size_t pass = 0; pass < 2 && count < maxCount; ++pass) {
+        for (size_t i = 0; i < queueCount && count < maxCount; ++i) {
+            SegmentQueue& queue = *tracer.queues[(tracer.nextQueue + i) % queueCount];
+            size_t limit = pass == 0 ? std::min(share, maxCount - count) : maxCount - count;
+            count += queue.pop(out + count, limit);
+        }
+    }
+    tracer.nextQueue = (tracer.nextQueue + 1) % queueCount;
+    return count;
+}
+
+void collectLiveFluence(LiveTracer& tracer) {
+    for (size_t w = 0; w < tracer.fluenceShares.size(); ++w) {
+        LiveFluence& share = *tracer.fluenceShares[w];
+        std::lock_guard<std::mutex> lock(share.mutex);
+        for (size_t i = 0; i < share.pending.size(); ++i) {
+            tracer.fluence[i] += share.pending[i];
+        }
+        std::fill(share.pending.begin(), share.pending.end(), 0.0);
+    }
+}
+
+void stopLiveTracer(LiveTracer& tracer) {
+    tracer.running = false;
+    for (size_t i = 0; i < tracer.workers.size(); ++i) {
+        tracer.workers[i].join();
+    }
+    tracer.workers.clear();
+    tracer.queues.clear();
+    tracer.fluenceShares.clear();
+}
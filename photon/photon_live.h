@@ -0,0 +1,64 @@
+#ifndef PHOTON_LIVE_H
+#define PHOTON_LIVE_H
+
+#include "photon_path_store.h"
+#include "photon_segment_queue.h"
+#include "photon_transport.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define LIVE_QUEUE_SEGMENTS (1 << 16) // Ring size of each worker's segment queue
+#define LIVE_PHOTON_BLOCK 256 // Photon indices a worker claims at a time
+#define LIVE_FLUENCE_BLOCKS 16 // Photon blocks a worker traces between hand-overs of its fluence grid
+#define LIVE_PATH_VERTICES (1 << 16) // Arena of each worker's PathStore
+#define LIVE_DECIMATED_VERTICES 16 // Vertices kept per path with KEEP_DECIMATED
+
+// Fluence a worker has handed over but the render thread has not collected yet
+struct LiveFluence {
+    std::mutex mutex;
+    std::vector<double> pending;
+};
+
+// Transport running on worker threads for a live view. Each worker traces photons as fast as it
+// can into its own PathStore, whose retention policy decides which paths are shown, and publishes
+// each kept path whole to its own SegmentQueue when the path fits; paths that find the queue full
+// are traced and counted but not shown, so the view gets a sample of the photons while the
+// simulation never waits for the renderer. With a fluence grid in the config,
+// every photon (shown or not) is tallied into the worker's private grid, which is added to its
+// LiveFluence every LIVE_FLUENCE_BLOCKS blocks when the render thread is not holding it.
+struct LiveTracer {
+    TransportConfig config;
+    SensorIndex sensors;
+    PathRetention retention; // Which traced paths the workers publish
+    std::vector<std::unique_ptr<SegmentQueue>> queues; // One per worker
+    std::vector<std::unique_ptr<LiveFluence>> fluenceShares; // One per worker
+    std::vector<double> fluence; // Collected weighted track length per grid cell (render thread only)
+    std::vector<std::thread> workers;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> nextPhoton; // Next unclaimed photon index
+    std::atomic<uint64_t> photons; // Photons traced to completion
+    std::atomic<uint64_t> published; // Photons whose path went to a queue
+    size_t nextQueue; // Queue the next drain starts with (consumer side only)
+
+    LiveTracer() : retention(KEEP_LAST), running(false), nextPhoton(0), photons(0), published(0), nextQueue(0) {}
+};
+
+// Start threads workers (0 = all cores but one, which is left to the render thread)
+void startLiveTracer(LiveTracer& tracer, const TransportConfig& config, const SensorIndex& sensors,
+                     unsigned threads = 0, PathRetention retention = KEEP_LAST);
+
+// Take up to maxCount published segments, visiting the worker queues in turn; render thread only
+size_t drainLiveSegments(LiveTracer& tracer, TraceSegment* out, size_t maxCount);
+
+// Add the fluence the workers handed over to tracer.fluence; render thread only
+void collectLiveFluence(LiveTracer& tracer);
+
+// Stop and join the workers; segments still queued are dropped
+void stopLiveTracer(LiveTracer& tracer);
+
+#endif // PHOTON_LIVE_H
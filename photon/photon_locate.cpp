@@ -0,0 +1,187 @@
+#include "photon_locate.h"
+#include "photon_binary_io.h"
+#include "photon_checkpoint.h"
+#include "photon_sweep.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define RESPONSE_MAGIC "PHOTRSP3"
+
+// Emitter position of grid node (ix, iy), also for fractional indices
+static float nodeX(const ResponseTable& table, float ix) {
+    return (ix + 0.5f) * table.config.boxWidth / table.cellsX;
+}
+
+static float nodeY(const ResponseTable& table, float iy) {
+    return (iy + 0.5f) * table.config.boxHeight / table.cellsY;
+}
+
+ResponseTable buildResponseTable(const TransportConfig& config, const SensorCenters& sensors, int cellsX, int cellsY,
+                                 uint64_t photonsPerPoint, unsigned threads, TraceKernel kernel) {
+    ResponseTable table;
+    table.config = config;
+    table.sensors = sensors;
+    table.cellsX = cellsX;
+    table.cellsY = cellsY;
+    table.photonsPerPoint = photonsPerPoint;
+
+    std::vector<TransportConfig> points;
+    for (int iy = 0; iy < cellsY; ++iy) {
+        for (int ix = 0; ix < cellsX; ++ix) {
+            TransportConfig point = config;
+            point.emitterX = nodeX(table, static_cast<float>(ix));
+            point.emitterY = nodeY(table, static_cast<float>(iy));
+            points.push_back(point);
+        }
+    }
+    std::vector<SweepResult> results = runSweep(points, sensors, photonsPerPoint, threads, kernel);
+
+    double floor = 0.5 / static_cast<double>(photonsPerPoint);
+    table.probability.resize(points.size() * sensors.size());
+    for (size_t p = 0; p < results.size(); ++p) {
+        for (size_t i = 0; i < sensors.size(); ++i) {
+            double mean = sensorEstimate(results[p].tallies, i).mean;
+            table.probability[p * sensors.size() + i] = static_cast<float>(std::max(mean, floor));
+        }
+    }
+    return table;
+}
+
+bool saveResponseTable(const std::string& path, const ResponseTable& table) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    std::fwrite(RESPONSE_MAGIC, 1, 8, file);
+    writeTransportConfig(file, table.config);
+    writeArray(file, table.sensors);
+    writeValue<int32_t>(file, table.cellsX);
+    writeValue<int32_t>(file, table.cellsY);
+    writeValue(file, table.photonsPerPoint);
+    writeArray(file, table.probability);
+    std::fwrite(RESPONSE_MAGIC, 1, 8, file); // A torn file fails to load and is built again
+    bool ok = std::fflush(file) == 0 && !std::ferror(file);
+    return std::fclose(file) == 0 && ok;
+}
+
+bool loadResponseTable(const std::string& path, ResponseTable& table) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char magic[8];
+    bool ok = std::fread(magic, 1, 8, file) == 8 && std::memcmp(magic, RESPONSE_MAGIC, 8) == 0;
+    ok = ok && readTransportConfig(file, table.config) && readArray(file, table.sensors) &&
+         readValue(file, table.cellsX) && readValue(file, table.cellsY) && readValue(file, table.photonsPerPoint) &&
+         readArray(file, table.probability);
+    ok = ok && std::fread(magic, 1, 8, file) == 8 && std::memcmp(magic, RESPONSE_MAGIC, 8) == 0;
+    ok = ok && table.probability.size() == static_cast<size_t>(table.cellsX) * table.cellsY * table.sensors.size();
+    std::fclose(file);
+    return ok;
+}
+
+ResponseTable cachedResponseTable(const std::string& path, const TransportConfig& config,
+                                  const SensorCenters& sensors, int cellsX, int cellsY, uint64_t photonsPerPoint,
+                                  unsigned threads, TraceKernel kernel, bool& built) {
+    ResponseTable table;
+    if (loadResponseTable(path, table)) {
+        // The emitter position is what the table varies, so it does not have to match
+        TransportConfig wanted = config;
+        wanted.emitterX = table.config.emitterX;
+        wanted.emitterY = table.config.emitterY;
+        if (sameTransportConfig(wanted, table.config) && table.sensors == sensors && table.cellsX == cellsX &&
+            table.cellsY == cellsY && table.photonsPerPoint == photonsPerPoint) {
+            built = false;
+            return table;
+        }
+    }
+    table = buildResponseTable(config, sensors, cellsX, cellsY, photonsPerPoint, threads, kernel);
+    saveResponseTable(path, table);
+    built = true;
+    return table;
+}
+
+// Bilinear interpolation of the table at fractional grid indices (u, v), one value per sensor
+static void responseAt(const ResponseTable& table, float u, float v, float* response) {
+    int ix = std::min(table.cellsX - 2, std::max(0, static_cast<int>(u)));
+    int iy = std::min(table.cellsY - 2, std::max(0, static_cast<int>(v)));
+    float fx = u - ix;
+    float fy = v - iy;
+    size_t sensorCount = table.sensors.size();
+    const float* p00 = &table.probability[(static_cast<size_t>(iy) * table.cellsX + ix) * sensorCount];
+    const float* p10 = p00 + sensorCount;
+    const float* p01 = p00 + table.cellsX * sensorCount;
+    const float* p11 = p01 + sensorCount;
+    for (size_t i = 0; i < sensorCount; ++i) {
+        response[i] = (1 - fy) * ((1 - fx) * p00[i] + fx * p10[i]) + fy * ((1 - fx) * p01[i] + fx * p11[i]);
+    }
+}
+
+// Profile log-likelihood sum h log p - H log sum p, with the intensity maximised out
+static double logLikelihood(const std::vector<float>& response, const std::vector<double>& hits, double hitTotal) {
+    double weighted = 0.0;
+    double total = 0.0;
+    for (size_t i = 0; i < response.size(); ++i) {
+        total += response[i];
+        if (hits[i] > 0) {
+            weighted += hits[i] * std::log(response[i]);
+        }
+    }
+    return weighted - hitTotal * std::log(total);
+}
+
+EmitterEstimate locateEmitter(const ResponseTable& table, const std::vector<double>& hits) {
+    double hitTotal = 0.0;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        hitTotal += hits[i];
+    }
+    std::vector<float> response(table.sensors.size());
+
+    // Best grid node; at whole indices the interpolation is the node itself
+    float bestU = 0.0f;
+    float bestV = 0.0f;
+    double best = -HUGE_VAL;
+    for (int iy = 0; iy < table.cellsY; ++iy) {
+        for (int ix = 0; ix < table.cellsX; ++ix) {
+            responseAt(table, static_cast<float>(ix), static_cast<float>(iy), response.data());
+            double value = logLikelihood(response, hits, hitTotal);
+            if (value > best) {
+                best = value;
+                bestU = static_cast<float>(ix);
+                bestV = static_cast<float>(iy);
+            }
+        }
+    }
+
+    // Pattern search on the interpolated surface, halving the step down to a thousandth of a cell
+    const float maxU = static_cast<float>(table.cellsX - 1);
+    const float maxV = static_cast<float>(table.cellsY - 1);
+    for (float step = 0.5f; step > 1e-3f;) {
+        bool moved = false;
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                float u = std::min(maxU, std::max(0.0f, bestU + dx * step));
+                float v = std::min(maxV, std::max(0.0f, bestV + dy * step));
+                responseAt(table, u, v, response.data());
+                double value = logLikelihood(response, hits, hitTotal);
+                if (value > best) {
+                    best = value;
+                    bestU = u;
+                    bestV = v;
+                    moved = true;
+                }
+            }
+        }
+        if (!moved) step *= 0.5f;
+    }
+
+    EmitterEstimate estimate;
+    estimate.x = nodeX(table, bestU);
+    estimate.y = nodeY(table, bestV);
+    estimate.logLikelihood = best;
+    responseAt(table, bestU, bestV, response.data());
+    double total = 0.0;
+    for (size_t i = 0; i < response.size(); ++i) {
+        total += response[i];
+    }
+    estimate.intensity = total > 0.0 ? hitTotal / total : 0.0;
+    return estimate;
+}
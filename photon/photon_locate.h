@@ -0,0 +1,46 @@
+#ifndef PHOTON_LOCATE_H
+#define PHOTON_LOCATE_H
+
+#include "photon_transport.h"
+
+#include <string>
+#include <vector>
+
+// Forward model for emitter localisation: the detection probability of every sensor for emitters
+// at the centres of a cellsX x cellsY grid over the box, traced once with runSweep()
+struct ResponseTable {
+    TransportConfig config; // Everything but the emitter position, which the table varies
+    SensorCenters sensors;
+    int cellsX;
+    int cellsY;
+    uint64_t photonsPerPoint;
+    std::vector<float> probability; // Row iy * cellsX + ix holds one entry per sensor; never 0, sensors
+                                    // that saw nothing get half a photon's worth
+};
+
+ResponseTable buildResponseTable(const TransportConfig& config, const SensorCenters& sensors, int cellsX, int cellsY,
+                                 uint64_t photonsPerPoint, unsigned threads = 0, TraceKernel kernel = TRACE_PACKET);
+
+bool saveResponseTable(const std::string& path, const ResponseTable& table);
+bool loadResponseTable(const std::string& path, ResponseTable& table);
+
+// The table at path if it was built with these settings, otherwise a new one, saved to path.
+// built tells which happened.
+ResponseTable cachedResponseTable(const std::string& path, const TransportConfig& config,
+                                  const SensorCenters& sensors, int cellsX, int cellsY, uint64_t photonsPerPoint,
+                                  unsigned threads, TraceKernel kernel, bool& built);
+
+struct EmitterEstimate {
+    float x;
+    float y;
+    double logLikelihood; // At the estimate, up to a constant
+    double intensity; // Emitted photons that explain the hit total
+};
+
+// Maximum likelihood emitter position for hit counts (one per table sensor). The counts are taken
+// as Poisson with an unknown source intensity, which is profiled out, so only the pattern of the
+// hits matters. The grid nodes are scanned first, then the best one is refined on the bilinear
+// interpolation of the table.
+EmitterEstimate locateEmitter(const ResponseTable& table, const std::vector<double>& hits);
+
+#endif // PHOTON_LOCATE_H
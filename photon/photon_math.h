@@ -0,0 +1,81 @@
+#ifndef PHOTON_MATH_H
+#define PHOTON_MATH_H
+
+#include <cstdint>
+#include <cstring>
+
+// Polynomial log and sincos used by the transport. The SIMD packet tracer evaluates the
+// same operations in the same order (photon_simd.h), so both paths give identical results.
+
+#define PHOTON_SQRTHF 0.707106781186547524f
+#define PHOTON_TWO_PI 6.28318530717958647692f
+
+inline int32_t floatBits(float f) {
+    int32_t i;
+    std::memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+inline float bitsFloat(int32_t i) {
+    float f;
+    std::memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+// Natural log for x in (0, 1] (Cephes logf)
+inline float photonLog(float x) {
+    int32_t bits = floatBits(x);
+    int32_t e = ((bits >> 23) & 0xff) - 126;
+    float m = bitsFloat((bits & 0x807fffff) | 0x3f000000); // Mantissa in [0.5, 1)
+
+    if (m < PHOTON_SQRTHF) {
+        e = e - 1;
+        m = m + m - 1.0f;
+    } else {
+        m = m - 1.0f;
+    }
+
+    float z = m * m;
+    float y = 7.0376836292E-2f;
+    y = y * m - 1.1514610310E-1f;
+    y = y * m + 1.1676998740E-1f;
+    y = y * m - 1.2420140846E-1f;
+    y = y * m + 1.4249322787E-1f;
+    y = y * m - 1.6668057665E-1f;
+    y = y * m + 2.0000714765E-1f;
+    y = y * m - 2.4999993993E-1f;
+    y = y * m + 3.3333331174E-1f;
+    y = y * m * z;
+
+    float fe = static_cast<float>(e);
+    y = y + -2.12194440e-4f * fe;
+    y = y + -0.5f * z;
+    return m + y + 0.693359375f * fe;
+}
+
+// sin and cos of 2 * pi * u for u in [0, 1); the reduction to [-pi/4, pi/4] is exact in u
+inline void photonSinCos2Pi(float u, float& s, float& c) {
+    int32_t q = static_cast<int32_t>(u * 4.0f + 0.5f); // Quadrant 0..4
+    float r = u - static_cast<float>(q) * 0.25f;
+    float x = r * PHOTON_TWO_PI;
+    float x2 = x * x;
+
+    float ps = -1.9515295891E-4f;
+    ps = ps * x2 + 8.3321608736E-3f;
+    ps = ps * x2 - 1.6666654611E-1f;
+    ps = ps * x2 * x + x;
+
+    float pc = 2.443315711809948E-5f;
+    pc = pc * x2 - 1.388731625493765E-3f;
+    pc = pc * x2 + 4.166664568298827E-2f;
+    pc = pc * x2 * x2 - 0.5f * x2 + 1.0f;
+
+    switch (q & 3) {
+    case 0: s = ps; c = pc; break;
+    case 1: s = pc; c = -ps; break;
+    case 2: s = -ps; c = -pc; break;
+    default: s = -pc; c = ps; break;
+    }
+}
+
+#endif // PHOTON_MATH_H
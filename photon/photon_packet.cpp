@@ -0,0 +1,270 @@
+#include "photon_transport.h"
+#include "photon_simd.h"
+
+#include <bitset>
+#include <cmath>
+#include <limits>
+
+#define PACKET_SENSOR_SCAN_MAX 100 // Layouts up to this size test every disc in SIMD; larger ones walk the grid
+
+int packetLanes() {
+#ifdef PHOTON_LANES
+    return PHOTON_LANES;
+#else
+    return 1;
+#endif
+}
+
+#ifdef PHOTON_LANES
+
+// Packet state in structure-of-arrays layout, one slot per SIMD lane
+struct PhotonPacket {
+    alignas(64) float x[PHOTON_LANES];
+    alignas(64) float y[PHOTON_LANES];
+    alignas(64) int32_t idLo[PHOTON_LANES];
+    alignas(64) int32_t idHi[PHOTON_LANES];
+    alignas(64) int32_t step[PHOTON_LANES];
+    alignas(64) int32_t active[PHOTON_LANES]; // -1 while the lane holds a moving photon
+    alignas(64) float nx[PHOTON_LANES]; // End of this step's segment
+    alignas(64) float ny[PHOTON_LANES];
+    alignas(64) float pathLength[PHOTON_LANES]; // Only kept up to date when events or arrival times are needed
+};
+
+// First valid wall crossing per lane, walls tested in the order of check_walls()
+static vmask packetWalls(vfloat px, vfloat py, vfloat nx, vfloat ny, float width, float height,
+                         vfloat& wx, vfloat& wy) {
+    vfloat zero = vset(0.0f);
+    vfloat one = vset(1.0f);
+    vfloat w = vset(width);
+    vfloat h = vset(height);
+
+    vfloat tl = (zero - px) / (nx - px);
+    vfloat yl = py + tl * (ny - py);
+    vmask left = (nx < zero) & (zero <= tl) & (tl <= one) & (zero <= yl) & (yl <= h);
+
+    vfloat tr = (w - px) / (nx - px);
+    vfloat yr = py + tr * (ny - py);
+    vmask right = (nx > w) & (zero <= tr) & (tr <= one) & (zero <= yr) & (yr <= h);
+
+    vfloat tb = (zero - py) / (ny - py);
+    vfloat xb = px + tb * (nx - px);
+    vmask bottom = (ny < zero) & (zero <= tb) & (tb <= one) & (zero <= xb) & (xb <= w);
+
+    vfloat tt = (h - py) / (ny - py);
+    vfloat xt = px + tt * (nx - px);
+    vmask top = (ny > h) & (zero <= tt) & (tt <= one) & (zero <= xt) & (xt <= w);
+
+    // Apply in reverse so the earliest wall in the scalar order wins
+    wx = select(top, xt, zero);
+    wy = select(top, h, zero);
+    wx = select(bottom, xb, wx);
+    wy = select(bottom, zero, wy);
+    wx = select(right, w, wx);
+    wy = select(right, yr, wy);
+    wx = select(left, zero, wx);
+    wy = select(left, yl, wy);
+    return left | right | bottom | top;
+}
+
+// Nearest sensor disc each lane's segment touches, as in check_sensors(): every disc is tested
+// with the arithmetic of segmentDiscHit(), and ties go to the lowest index
+static vmask packetSensors(vfloat px, vfloat py, vfloat nx, vfloat ny, const SensorIndex& sensors, vint& index,
+                           vfloat& hitX, vfloat& hitY) {
+    vfloat zero = vset(0.0f);
+    vfloat B = nx - px;
+    vfloat D = ny - py;
+    vfloat a = B * B + D * D;
+    vfloat twoA = vset(2.0f) * a;
+    vfloat fourA = vset(4.0f) * a;
+    vfloat rr = vset(sensors.radius * sensors.radius);
+    vmask moving = a > zero;
+
+    vmask found = zero < zero;
+    vfloat bestT = vset(std::numeric_limits<float>::infinity());
+    index = vseti(-2);
+    for (size_t i = 0; i < sensors.centers.size(); ++i) {
+        vfloat A = px - vset(sensors.centers[i].first);
+        vfloat C = py - vset(sensors.centers[i].second);
+        vfloat b = vset(2.0f) * (A * B + C * D);
+        vfloat c = A * A + C * C - rr;
+        vfloat discriminant = b * b - fourA * c;
+
+        vfloat sqrt_discriminant = vsqrt(discriminant);
+        vfloat n1 = zero - b - sqrt_discriminant;
+        vfloat n2 = zero - b + sqrt_discriminant;
+        vmask entry = (zero <= n1) & (n1 <= twoA);
+        vmask leave = (zero <= n2) & (n2 <= twoA);
+        vfloat t = select(entry, n1, n2) / twoA; // Entry point, or the exit point if the segment starts inside
+
+        vmask hit = moving & (discriminant >= zero) & (entry | leave) & (t < bestT);
+        bestT = select(hit, t, bestT);
+        index = select(hit, vseti(static_cast<int32_t>(i)), index);
+        found = found | hit;
+    }
+    hitX = px + bestT * B;
+    hitY = py + bestT * D;
+    return found;
+}
+
+void tracePacketRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t first, uint64_t count,
+                      BatchResult& result) {
+    if (config.mode != TRANSPORT_ANALOG || config.phaseTable || config.fluenceCellsX > 0 ||
+        config.sampling != SAMPLING_PSEUDO || config.scene) {
+        tracePhotonRange(config, sensors, first, count, result);
+        return;
+    }
+    prepareBatchResult(result, config, sensors.size());
+    bool trackPath = result.recordEvents || config.timeBins > 0;
+    bool scanSensors = sensors.size() <= PACKET_SENSOR_SCAN_MAX;
+
+    PhotonPacket packet;
+    uint64_t next = first;
+    uint64_t end = first + count;
+
+    // Put the next photon of the range into lane l, or retire the lane when the range is done
+    auto refill = [&](int l) {
+        if (next < end) {
+            packet.x[l] = config.emitterX;
+            packet.y[l] = config.emitterY;
+            packet.idLo[l] = static_cast<int32_t>(static_cast<uint32_t>(next));
+            packet.idHi[l] = static_cast<int32_t>(static_cast<uint32_t>(next >> 32));
+            packet.step[l] = 0;
+            packet.active[l] = -1;
+            packet.pathLength[l] = 0.0f;
+            next++;
+        } else {
+            packet.active[l] = 0;
+        }
+    };
+    for (int l = 0; l < PHOTON_LANES; ++l) {
+        refill(l);
+    }
+
+    const uint32_t seedLo = static_cast<uint32_t>(config.seed);
+    const uint32_t seedHi = static_cast<uint32_t>(config.seed >> 32);
+
+    while (true) {
+        vmask active = vloadi(packet.active) == vseti(-1);
+        int activeBits = maskBits(active);
+        if (activeBits == 0) break;
+
+        vfloat px = vload(packet.x);
+        vfloat py = vload(packet.y);
+        vint step = vloadi(packet.step);
+
+        // Same stream layout as stepPhoton(): block (seed, id, step)
+        vint block[4] = { vloadi(packet.idLo), vloadi(packet.idHi), step, vseti(0) };
+        vphilox4x32(block, seedLo, seedHi);
+
+        vfloat sin_angle, cos_angle;
+        vsincos2pi(vuniformFloat(block[2]), sin_angle, cos_angle);
+        vfloat samp_sca = vset(-config.meanFreePath) * vlog(vuniformOpenFloat(block[0]));
+        vfloat samp_abs = vset(-config.absorptionLength) * vlog(vuniformOpenFloat(block[1]));
+        vfloat samp_dist = vmin(samp_sca, samp_abs);
+        vmask absorbedDraw = samp_abs <= samp_sca;
+
+        vfloat nx = px + samp_dist * cos_angle;
+        vfloat ny = py + samp_dist * sin_angle;
+
+        vfloat wx, wy;
+        vmask wallHit = packetWalls(px, py, nx, ny, config.boxWidth, config.boxHeight, wx, wy);
+        vstore(packet.nx, nx);
+        vstore(packet.ny, ny);
+
+        // Small layouts test every disc on all lanes at once; larger ones walk the sensor grid,
+        // which branches per lane, so it runs on the lanes one at a time
+        alignas(64) int32_t sensorIndex[PHOTON_LANES];
+        alignas(64) float sensorX[PHOTON_LANES];
+        alignas(64) float sensorY[PHOTON_LANES];
+        vmask sensorHit;
+        if (scanSensors) {
+            vint index;
+            vfloat hitX, hitY;
+            sensorHit = packetSensors(px, py, nx, ny, sensors, index, hitX, hitY);
+            vstorei(sensorIndex, index);
+            vstore(sensorX, hitX);
+            vstore(sensorY, hitY);
+        } else {
+            alignas(64) int32_t sensorLanes[PHOTON_LANES];
+            for (int l = 0; l < PHOTON_LANES; ++l) {
+                sensorIndex[l] = -2;
+                if (activeBits & (1 << l)) {
+                    auto hit = check_sensors(packet.x[l], packet.y[l], packet.nx[l], packet.ny[l], sensors);
+                    sensorIndex[l] = std::get<1>(hit);
+                    sensorX[l] = std::get<0>(hit).first;
+                    sensorY[l] = std::get<0>(hit).second;
+                }
+                sensorLanes[l] = sensorIndex[l] >= 0 ? -1 : 0;
+            }
+            sensorHit = vloadi(sensorLanes) == vseti(-1);
+        }
+
+        vmask scatter = andNot(andNot(andNot(active, wallHit), sensorHit), absorbedDraw);
+        alignas(64) float wallX[PHOTON_LANES];
+        alignas(64) float wallY[PHOTON_LANES];
+        if (trackPath) {
+            // Same per-segment sums as stepPhoton(), so both kernels record the same path lengths
+            vfloat dx = nx - px;
+            vfloat dy = ny - py;
+            vfloat length = vsqrt(dx * dx + dy * dy);
+            vstore(packet.pathLength, vload(packet.pathLength) + select(scatter, length, vset(0.0f)));
+            vstore(wallX, wx);
+            vstore(wallY, wy);
+        }
+        vstore(packet.x, select(scatter, nx, px));
+        vstore(packet.y, select(scatter, ny, py));
+        vstorei(packet.step, select(scatter, step + vseti(1), step));
+
+        result.steps += std::bitset<32>(activeBits).count();
+
+        // Tally and refill the lanes whose photon stopped this step
+        int wallBits = maskBits(wallHit);
+        int doneBits = activeBits & ~maskBits(scatter);
+        for (int l = 0; l < PHOTON_LANES; ++l) {
+            if (!(doneBits & (1 << l))) continue;
+            int32_t target;
+            float endX, endY;
+            if (sensorIndex[l] >= 0) {
+                tallyPhoton(result, PHOTON_SENSOR, sensorIndex[l], 1.0f);
+                target = sensorIndex[l];
+                endX = sensorX[l];
+                endY = sensorY[l];
+            } else if (wallBits & (1 << l)) {
+                tallyPhoton(result, PHOTON_WALL, -1, 1.0f);
+                target = EVENT_WALL;
+                endX = wallX[l];
+                endY = wallY[l];
+            } else {
+                tallyPhoton(result, PHOTON_ABSORBED, -1, 1.0f);
+                target = EVENT_ABSORBED;
+                endX = packet.nx[l];
+                endY = packet.ny[l];
+            }
+            if (trackPath) {
+                float dx = endX - packet.x[l];
+                float dy = endY - packet.y[l];
+                float pathLength = packet.pathLength[l] + std::sqrt(dx * dx + dy * dy);
+                if (config.timeBins > 0 && target >= 0) {
+                    tallyArrival(result, config, target, pathLength, 1.0f);
+                }
+                if (result.recordEvents) {
+                    uint64_t id = static_cast<uint32_t>(packet.idLo[l]) |
+                                  static_cast<uint64_t>(static_cast<uint32_t>(packet.idHi[l])) << 32;
+                    result.events.push(id, target, endX, endY, pathLength, static_cast<uint32_t>(packet.step[l]),
+                                       1.0f);
+                }
+            }
+            refill(l);
+        }
+    }
+    result.photons += count;
+}
+
+#else
+
+void tracePacketRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t first, uint64_t count,
+                      BatchResult& result) {
+    tracePhotonRange(config, sensors, first, count, result);
+}
+
+#endif // PHOTON_LANES
@@ -0,0 +1,89 @@
+#include "photon_path_store.h"
+
+#include <algorithm>
+
+PathStore::PathStore(PathRetention retention, size_t maxPaths, size_t arenaVertices, size_t maxPathVertices)
+    : retention(retention), maxPathVertices(std::max<size_t>(2, maxPathVertices)),
+      arena(std::max<size_t>(2, arenaVertices)), records(std::max<size_t>(1, maxPaths)),
+      recordTail(0), recordCount(0), vertexTail(0), vertexCount(0), open(false) {
+    current.id = 0;
+    current.first = 0;
+    current.count = 0;
+    current.fate = PHOTON_ACTIVE;
+    current.sensor = -1;
+}
+
+void PathStore::dropOldest() {
+    const PathRecord& oldest = records[recordTail];
+    vertexTail = (vertexTail + oldest.count) % arena.size();
+    vertexCount -= oldest.count;
+    recordTail = (recordTail + 1) % records.size();
+    recordCount--;
+}
+
+void PathStore::beginPath(uint64_t id, float x, float y) {
+    if (open) {
+        endPath(PHOTON_ACTIVE, -1);
+    }
+    current.id = id;
+    current.first = (vertexTail + vertexCount) % arena.size();
+    current.count = 0;
+    current.fate = PHOTON_ACTIVE;
+    current.sensor = -1;
+    open = true;
+    appendVertex(x, y);
+}
+
+void PathStore::appendVertex(float x, float y) {
+    if (!open) return;
+
+    // Make room by dropping old trails; a single trail longer than the arena keeps moving its last vertex
+    while (vertexCount == arena.size() && recordCount > 0) {
+        dropOldest();
+    }
+    if (vertexCount == arena.size()) {
+        arena[(current.first + current.count - 1) % arena.size()] = std::make_pair(x, y);
+        return;
+    }
+
+    arena[(current.first + current.count) % arena.size()] = std::make_pair(x, y);
+    current.count++;
+    vertexCount++;
+}
+
+void PathStore::decimateCurrent() {
+    size_t n = current.count;
+    size_t m = maxPathVertices;
+    if (n <= m) return;
+
+    // Keep both ends and evenly spaced vertices in between; reads never fall behind writes
+    for (size_t j = 1; j < m; ++j) {
+        size_t src = (j * (n - 1) + (m - 1) / 2) / (m - 1);
+        arena[(current.first + j) % arena.size()] = arena[(current.first + src) % arena.size()];
+    }
+    current.count = m;
+    vertexCount -= n - m;
+}
+
+void PathStore::endPath(PhotonFate fate, int sensor) {
+    if (!open) return;
+    open = false;
+    current.fate = fate;
+    current.sensor = sensor;
+
+    if (retention == KEEP_SENSOR_HITS && fate != PHOTON_SENSOR) {
+        vertexCount -= current.count; // The trail is the newest data in the arena, so just rewind
+        current.count = 0;
+        return;
+    }
+    if (retention == KEEP_DECIMATED) {
+        decimateCurrent();
+    }
+
+    if (recordCount == records.size()) {
+        dropOldest();
+    }
+    records[(recordTail + recordCount) % records.size()] = current;
+    recordCount++;
+    current.count = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef PHOTON_PATH_STORE_H
+#define PHOTON_PATH_STORE_H
+
+#include "photon_transport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+enum PathRetention {
+    KEEP_LAST, // The most recent maxPaths photons
+    KEEP_SENSOR_HITS, // Only photons that stopped on a sensor
+    KEEP_DECIMATED // Every photon, thinned to at most maxPathVertices vertices
+};
+
+// Vertices of one photon inside the arena
+struct PathRecord {
+    uint64_t id;
+    size_t first; // Arena slot of the first vertex (the arena is a ring, so vertices may wrap)
+    size_t count;
+    PhotonFate fate;
+    int sensor;
+};
+
+// Photon trails kept in one preallocated vertex arena. Memory is fixed at construction:
+// when the arena or the record table is full the oldest trails are dropped.
+struct PathStore {
+    PathRetention retention;
+    size_t maxPathVertices; // Vertices kept per trail with KEEP_DECIMATED
+
+    PathStore(PathRetention retention, size_t maxPaths, size_t arenaVertices, size_t maxPathVertices = 16);
+
+    // Build the trail of the photon currently in flight
+    void beginPath(uint64_t id, float x, float y);
+    void appendVertex(float x, float y);
+    void endPath(PhotonFate fate, int sensor);
+
+    size_t pathCount() const { return recordCount; } // Finished trails, oldest first
+    const PathRecord& path(size_t i) const { return records[(recordTail + i) % records.size()]; }
+    const PathRecord& currentPath() const { return current; } // count is 0 when no photon is in flight
+    const std::pair<float, float>& vertex(const PathRecord& record, size_t i) const {
+        return arena[(record.first + i) % arena.size()];
+    }
+
+private:
+    std::vector<std::pair<float, float>> arena;
+    std::vector<PathRecord> records; // Ring of finished trails
+    size_t recordTail; // Oldest finished trail
+    size_t recordCount;
+    size_t vertexTail; // First arena slot still in use
+    size_t vertexCount; // Arena slots in use, including the trail in flight
+    PathRecord current;
+    bool open;
+
+    void dropOldest();
+    void decimateCurrent();
+};
+
+#endif // PHOTON_PATH_STORE_H
@@ -0,0 +1,61 @@
+#include "photon_phase.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define PHASE_INTEGRATION_STEPS (1 << 18) // Trapezoids the phase function is integrated over
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+// Unnormalised density of the deflection angle theta in the plane
+static double planarDensity(PhaseFunction function, double g, double theta) {
+    if (function == PHASE_ISOTROPIC) return 1.0;
+    return (1.0 - g * g) / (1.0 + g * g - 2.0 * g * std::cos(theta));
+}
+
+// Unnormalised density of the deflection cosine mu in the volume
+static double volumeDensity(PhaseFunction function, double g, double mu) {
+    if (function == PHASE_ISOTROPIC) return 1.0;
+    double d = 1.0 + g * g - 2.0 * g * mu;
+    return (1.0 - g * g) / (d * std::sqrt(d));
+}
+
+// Inverse CDF of density over [lower, upper] at PHASE_TABLE_SIZE + 1 probabilities, scaled by scale
+template <typename Density>
+static std::vector<float> invertDensity(Density density, double lower, double upper, double scale) {
+    const int steps = PHASE_INTEGRATION_STEPS;
+    double h = (upper - lower) / steps;
+    std::vector<double> cdf(steps + 1, 0.0);
+    double previous = density(lower);
+    for (int j = 1; j <= steps; ++j) {
+        double current = density(lower + j * h);
+        cdf[j] = cdf[j - 1] + 0.5 * h * (previous + current);
+        previous = current;
+    }
+
+    std::vector<float> inverse(PHASE_TABLE_SIZE + 1);
+    int j = 0;
+    for (int k = 0; k <= PHASE_TABLE_SIZE; ++k) {
+        double target = cdf[steps] * k / PHASE_TABLE_SIZE;
+        while (j < steps - 1 && cdf[j + 1] < target) ++j;
+        double width = cdf[j + 1] - cdf[j];
+        double f = width > 0.0 ? std::min(1.0, std::max(0.0, (target - cdf[j]) / width)) : 0.0;
+        inverse[k] = static_cast<float>((lower + (j + f) * h) * scale);
+    }
+    inverse[0] = static_cast<float>(lower * scale);
+    inverse[PHASE_TABLE_SIZE] = static_cast<float>(upper * scale);
+    return inverse;
+}
+
+PhaseTable buildPhaseTable(PhaseFunction function, float anisotropy) {
+    PhaseTable table;
+    table.function = function;
+    table.anisotropy = std::max(-0.99f, std::min(0.99f, anisotropy));
+    double g = table.anisotropy;
+    table.deflection = invertDensity([&](double theta) { return planarDensity(function, g, theta); },
+                                     -M_PI, M_PI, 0.5 / M_PI);
+    table.cosine = invertDensity([&](double mu) { return volumeDensity(function, g, mu); }, -1.0, 1.0, 1.0);
+    return table;
+}
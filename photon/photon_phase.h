@@ -0,0 +1,35 @@
+#ifndef PHOTON_PHASE_H
+#define PHOTON_PHASE_H
+
+#include <vector>
+
+#define PHASE_TABLE_SIZE 4096 // Intervals of the tabulated inverse CDFs
+
+enum PhaseFunction {
+    PHASE_ISOTROPIC, // Every scatter picks a fresh uniform direction
+    PHASE_HENYEY_GREENSTEIN // Forward (g > 0) or backward (g < 0) peaked, mean deflection cosine g
+};
+
+// Inverse CDFs of the deflection at a scatter, tabulated at PHASE_TABLE_SIZE + 1 evenly spaced
+// probabilities. Building integrates the phase function numerically once; sampling is then a
+// lookup and a linear interpolation, whatever the phase function.
+struct PhaseTable {
+    PhaseFunction function;
+    float anisotropy;
+    std::vector<float> deflection; // 2D: deflection angle in turns, in [-0.5, 0.5]
+    std::vector<float> cosine; // 3D: cosine of the deflection angle, in [-1, 1]
+};
+
+// In 2D Henyey-Greenstein is its planar form, p(theta) = (1 - g^2) / (2 pi (1 + g^2 - 2 g cos theta));
+// |anisotropy| is limited to 0.99
+PhaseTable buildPhaseTable(PhaseFunction function, float anisotropy);
+
+// Value of an inverse CDF at probability u in [0, 1)
+inline float samplePhase(const std::vector<float>& inverse, float u) {
+    float x = u * PHASE_TABLE_SIZE;
+    int i = static_cast<int>(x);
+    float f = x - static_cast<float>(i);
+    return inverse[i] + f * (inverse[i + 1] - inverse[i]);
+}
+
+#endif // PHOTON_PHASE_H
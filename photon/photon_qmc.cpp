@@ -0,0 +1,217 @@
+#include "photon_qmc.h"
+#include "photon_math.h"
+#include "photon_rng.h"
+#include "photon_simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+// Primitive polynomial degree, coefficients and initial direction numbers of dimensions 2 to
+// SOBOL_DIMENSIONS (Joe and Kuo, new-joe-kuo-6.21201); dimension 1 is the van der Corput sequence
+struct SobolPolynomial {
+    int degree;
+    uint32_t coefficients;
+    uint32_t initial[6];
+};
+
+static const SobolPolynomial SOBOL_POLYNOMIALS[SOBOL_DIMENSIONS - 1] = {
+    { 1, 0, { 1 } },
+    { 2, 1, { 1, 3 } },
+    { 3, 1, { 1, 3, 1 } },
+    { 3, 2, { 1, 1, 1 } },
+    { 4, 1, { 1, 1, 3, 3 } },
+    { 4, 4, { 1, 3, 5, 13 } },
+    { 5, 2, { 1, 1, 5, 5, 17 } },
+    { 5, 4, { 1, 1, 5, 5, 5 } },
+    { 5, 7, { 1, 1, 7, 11, 19 } },
+    { 5, 11, { 1, 1, 5, 1, 1 } },
+    { 5, 13, { 1, 1, 1, 3, 11 } },
+};
+
+static uint32_t reverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Direction numbers, bit-reversed: row b is XORed in for bit b of the Gray-coded index
+struct SobolDirections {
+    uint32_t v[32][SOBOL_DIMENSIONS];
+
+    SobolDirections() {
+        uint32_t m[32];
+        for (int d = 0; d < SOBOL_DIMENSIONS; ++d) {
+            // m[bit] is the direction number with its leading bit at position 31 - bit
+            if (d == 0) {
+                for (int bit = 0; bit < 32; ++bit) {
+                    m[bit] = 1u << (31 - bit);
+                }
+            } else {
+                const SobolPolynomial& p = SOBOL_POLYNOMIALS[d - 1];
+                for (int bit = 0; bit < p.degree; ++bit) {
+                    m[bit] = p.initial[bit] << (31 - bit);
+                }
+                for (int bit = p.degree; bit < 32; ++bit) {
+                    m[bit] = m[bit - p.degree] ^ (m[bit - p.degree] >> p.degree);
+                    for (int k = 1; k < p.degree; ++k) {
+                        if ((p.coefficients >> (p.degree - 1 - k)) & 1u) m[bit] ^= m[bit - k];
+                    }
+                }
+            }
+            for (int bit = 0; bit < 32; ++bit) {
+                v[bit][d] = reverseBits(m[bit]);
+            }
+        }
+    }
+};
+
+static const SobolDirections SOBOL_DIRECTIONS;
+
+static int lowestSetBit(uint32_t x) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, x);
+    return static_cast<int>(bit);
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+SobolSampler::SobolSampler(uint64_t seed) : photon(UINT64_MAX) {
+    // Counter word 3 = 2 keeps these blocks apart from the photon streams (words 0 and 1)
+    for (int d = 0; d < SOBOL_DIMENSIONS; ++d) {
+        PhiloxBlock block = philox4x32(static_cast<uint32_t>(d), 0u, 0u, 2u, static_cast<uint32_t>(seed),
+                                       static_cast<uint32_t>(seed >> 32));
+        keys[d] = block.v[0];
+    }
+}
+
+void SobolSampler::moveTo(uint64_t id) {
+    uint32_t index = static_cast<uint32_t>(id);
+    if (photon != UINT64_MAX && index != 0 && index == static_cast<uint32_t>(photon) + 1) {
+        // Gray codes of index - 1 and index differ in the lowest set bit of index
+        const uint32_t* row = SOBOL_DIRECTIONS.v[lowestSetBit(index)];
+        for (int d = 0; d < SOBOL_DIMENSIONS; ++d) {
+            point[d] ^= row[d];
+        }
+    } else if (photon != id) {
+        for (int d = 0; d < SOBOL_DIMENSIONS; ++d) {
+            point[d] = 0;
+        }
+        for (uint32_t bits = index ^ (index >> 1); bits != 0; bits &= bits - 1) {
+            const uint32_t* row = SOBOL_DIRECTIONS.v[lowestSetBit(bits)];
+            for (int d = 0; d < SOBOL_DIMENSIONS; ++d) {
+                point[d] ^= row[d];
+            }
+        }
+    }
+    photon = id;
+}
+
+uint32_t SobolSampler::sample(int dimension) const {
+    // On the reversed bits every step only mixes a bit into higher ones, which is Owen's
+    // condition that each bit is flipped depending on the bits above it alone
+    uint32_t x = point[dimension] + keys[dimension];
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    return reverseBits(x);
+}
+
+// Direction, scattering and absorption draws of one step from the held point
+static void sobolStepDraws(const SobolSampler& sampler, uint32_t step, float& angle, float& sinAngle,
+                           float& cosAngle, float& scatter, float& absorb) {
+    int d = 3 * static_cast<int>(step);
+    angle = uniformFloat(sampler.sample(d));
+    photonSinCos2Pi(angle, sinAngle, cosAngle);
+    scatter = -photonLog(uniformOpenFloat(sampler.sample(d + 1)));
+    absorb = -photonLog(uniformOpenFloat(sampler.sample(d + 2)));
+}
+
+void applySobolDraws(StepDraws& draws, SobolSampler& sampler, uint64_t photon, uint32_t step) {
+    sampler.moveTo(photon);
+    sobolStepDraws(sampler, step, draws.angle, draws.sinAngle, draws.cosAngle, draws.scatter, draws.absorb);
+}
+
+void applySobolDraws(StepVariates& variates, SobolSampler& sampler) {
+    if (variates.firstStep >= SOBOL_STEPS) return;
+    sampler.moveTo(variates.photon);
+    uint32_t count = std::min<uint32_t>(SOBOL_STEPS - variates.firstStep, PHOTON_VARIATE_BLOCK);
+
+#ifdef PHOTON_LANES
+    // The scrambling is cheap; the logarithms and sines are not, so they run in one pass over
+    // the steps, as in fillStepVariates()
+    static_assert(SOBOL_STEPS <= PHOTON_LANES, "the Sobol steps of a photon must fit one register");
+    alignas(64) int32_t bits[3][PHOTON_LANES] = {};
+    for (uint32_t j = 0; j < count; ++j) {
+        int d = 3 * static_cast<int>(variates.firstStep + j);
+        for (int k = 0; k < 3; ++k) {
+            bits[k][j] = static_cast<int32_t>(sampler.sample(d + k));
+        }
+    }
+    alignas(64) float angle[PHOTON_LANES];
+    alignas(64) float sinAngle[PHOTON_LANES];
+    alignas(64) float cosAngle[PHOTON_LANES];
+    alignas(64) float scatter[PHOTON_LANES];
+    alignas(64) float absorb[PHOTON_LANES];
+    vfloat a = vuniformFloat(vloadi(bits[0]));
+    vfloat sa, ca;
+    vsincos2pi(a, sa, ca);
+    vstore(angle, a);
+    vstore(sinAngle, sa);
+    vstore(cosAngle, ca);
+    vstore(scatter, -vlog(vuniformOpenFloat(vloadi(bits[1]))));
+    vstore(absorb, -vlog(vuniformOpenFloat(vloadi(bits[2]))));
+    for (uint32_t j = 0; j < count; ++j) {
+        variates.angle[j] = angle[j];
+        variates.sinAngle[j] = sinAngle[j];
+        variates.cosAngle[j] = cosAngle[j];
+        variates.scatter[j] = scatter[j];
+        variates.absorb[j] = absorb[j];
+    }
+#else
+    for (uint32_t j = 0; j < count; ++j) {
+        sobolStepDraws(sampler, variates.firstStep + j, variates.angle[j], variates.sinAngle[j],
+                       variates.cosAngle[j], variates.scatter[j], variates.absorb[j]);
+    }
+#endif
+}
+
+ReplicateResult traceReplicates(const TransportConfig& config, const SensorIndex& sensors,
+                                uint64_t photonsPerReplicate, int replicates, unsigned threads, TraceKernel kernel) {
+    ReplicateResult run;
+    initBatchResult(run.tallies, sensors.size());
+    std::vector<double> sum(sensors.size(), 0.0);
+    std::vector<double> sumSq(sensors.size(), 0.0);
+    for (int r = 0; r < replicates; ++r) {
+        TransportConfig replicate = config;
+        replicate.seed = config.seed + static_cast<uint64_t>(r);
+        BatchResult tallies = traceBatch(replicate, sensors, photonsPerReplicate, threads, kernel);
+        for (size_t i = 0; i < sensors.size(); ++i) {
+            double mean = sensorEstimate(tallies, i).mean;
+            sum[i] += mean;
+            sumSq[i] += mean * mean;
+        }
+        if (r == 0) {
+            run.tallies = tallies;
+        } else {
+            mergeBatchResult(run.tallies, tallies);
+        }
+    }
+
+    run.estimates.resize(sensors.size());
+    for (size_t i = 0; i < sensors.size(); ++i) {
+        double mean = sum[i] / replicates;
+        double variance = replicates > 1 ? std::max(0.0, sumSq[i] - replicates * mean * mean) / (replicates - 1) : 0.0;
+        run.estimates[i].mean = mean;
+        run.estimates[i].stdError = std::sqrt(variance / replicates);
+    }
+    return run;
+}
@@ -0,0 +1,46 @@
+#ifndef PHOTON_QMC_H
+#define PHOTON_QMC_H
+
+#include "photon_sampler.h"
+#include "photon_transport.h"
+
+#include <cstdint>
+#include <vector>
+
+#define SOBOL_STEPS 4 // Leading steps of a photon that draw from the Sobol sequence in SAMPLING_SOBOL mode
+#define SOBOL_DIMENSIONS (3 * SOBOL_STEPS) // Per step: direction, scattering and absorption distance
+
+// Scrambled Sobol points for consecutive photons. Photon n takes point n of the sequence in
+// Gray-code order (the photon index modulo 2^32), so every aligned run of 2^k photons, such as a
+// PHOTON_CHUNK, gets a whole net. Moving to the next photon costs one row of XORs; any other jump
+// rebuilds the point from the index. The seed picks a nested uniform (Owen) scrambling, hashed per
+// dimension after Laine and Karras, which keeps the net structure and makes each point uniform.
+struct SobolSampler {
+    uint32_t keys[SOBOL_DIMENSIONS]; // Per-dimension scrambling keys
+    uint64_t photon; // Photon whose point is held, UINT64_MAX for none
+    uint32_t point[SOBOL_DIMENSIONS]; // Unscrambled point with the bits in reverse order
+
+    explicit SobolSampler(uint64_t seed);
+    void moveTo(uint64_t id);
+    uint32_t sample(int dimension) const; // Scrambled draw of the held point, as 32 bits
+};
+
+// Replace the draws of the steps below SOBOL_STEPS (direction, scattering and absorption) with the
+// Sobol point of the photon. Roulette draws and deeper steps keep their Philox values.
+void applySobolDraws(StepVariates& variates, SobolSampler& sampler);
+void applySobolDraws(StepDraws& draws, SobolSampler& sampler, uint64_t photon, uint32_t step);
+
+// Tallies of independent randomisations of one run, e.g. scramblings of the Sobol points
+struct ReplicateResult {
+    BatchResult tallies; // All replicates merged
+    std::vector<SensorEstimate> estimates; // Mean over the replicates, error from their spread
+};
+
+// Trace replicates runs of photonsPerReplicate photons, replicate r with config.seed + r. The
+// spread of the replicate estimates is an honest error bar for quasi-Monte Carlo, where the
+// per-photon variance of sensorEstimate() overstates the error.
+ReplicateResult traceReplicates(const TransportConfig& config, const SensorIndex& sensors,
+                                uint64_t photonsPerReplicate, int replicates, unsigned threads = 1,
+                                TraceKernel kernel = TRACE_PACKET);
+
+#endif // PHOTON_QMC_H
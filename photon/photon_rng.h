@@ -0,0 +1,68 @@
+#ifndef PHOTON_RNG_H
+#define PHOTON_RNG_H
+
+#include <cmath>
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+// Every draw is a pure function of (seed, photon index, step), so a photon
+// sees the same random numbers whichever thread traces it and in whatever order.
+
+struct PhiloxBlock {
+    uint32_t v[4];
+};
+
+inline uint32_t philoxMulHi(uint32_t a, uint32_t b, uint32_t& lo) {
+    uint64_t product = static_cast<uint64_t>(a) * b;
+    lo = static_cast<uint32_t>(product);
+    return static_cast<uint32_t>(product >> 32);
+}
+
+inline PhiloxBlock philox4x32(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1) {
+    const uint32_t M0 = 0xD2511F53u;
+    const uint32_t M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u;
+    const uint32_t W1 = 0xBB67AE85u;
+
+    for (int round = 0; round < 10; ++round) {
+        uint32_t lo0, lo1;
+        uint32_t hi0 = philoxMulHi(M0, c0, lo0);
+        uint32_t hi1 = philoxMulHi(M1, c2, lo1);
+        uint32_t n0 = hi1 ^ c1 ^ k0;
+        uint32_t n2 = hi0 ^ c3 ^ k1;
+        c0 = n0;
+        c1 = lo1;
+        c2 = n2;
+        c3 = lo0;
+        k0 += W0;
+        k1 += W1;
+    }
+
+    PhiloxBlock block = { { c0, c1, c2, c3 } };
+    return block;
+}
+
+// Uniform float in [0, 1) from the top 24 bits
+inline float uniformFloat(uint32_t bits) {
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// Uniform float in (0, 1], safe to pass to log()
+inline float uniformOpenFloat(uint32_t bits) {
+    return static_cast<float>((bits >> 8) + 1) * (1.0f / 16777216.0f);
+}
+
+// Random block for one scatter step of one photon
+inline PhiloxBlock photonStepBlock(uint64_t seed, uint64_t photonIndex, uint32_t step) {
+    return philox4x32(static_cast<uint32_t>(photonIndex), static_cast<uint32_t>(photonIndex >> 32), step, 0u,
+                      static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32));
+}
+
+// Random block for reflection number bounce of a flight that started at the given step. Word 3
+// past the step (0), 3D (1) and Sobol scrambling (2) blocks keeps the streams apart.
+inline PhiloxBlock photonBounceBlock(uint64_t seed, uint64_t photonIndex, uint32_t step, uint32_t bounce) {
+    return philox4x32(static_cast<uint32_t>(photonIndex), static_cast<uint32_t>(photonIndex >> 32), step, 3u + bounce,
+                      static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32));
+}
+
+#endif // PHOTON_RNG_H
@@ -0,0 +1,120 @@
+#include "photon_sampler.h"
+#include "photon_math.h"
+#include "photon_rng.h"
+#include "photon_simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+StepDraws StepVariates::draws(uint32_t step) const {
+    uint32_t j = step - firstStep;
+    StepDraws d = { angle[j], sinAngle[j], cosAngle[j], scatter[j], absorb[j], roulette[j], 0.0f, 1.0f };
+    return d;
+}
+
+StepDraws StepVariates::draws3D(uint32_t step) const {
+    uint32_t j = step - firstStep;
+    StepDraws d = { angle[j], sinAngle[j], cosAngle[j], scatter[j], absorb[j], roulette[j], cosPolar[j], sinPolar[j] };
+    return d;
+}
+
+StepDraws stepDraws(uint64_t seed, uint64_t photon, uint32_t step) {
+    // Word use per block: scattering and absorption distances, direction, roulette
+    PhiloxBlock block = photonStepBlock(seed, photon, step);
+    StepDraws d;
+    d.angle = uniformFloat(block.v[2]);
+    photonSinCos2Pi(d.angle, d.sinAngle, d.cosAngle);
+    d.scatter = -photonLog(uniformOpenFloat(block.v[0]));
+    d.absorb = -photonLog(uniformOpenFloat(block.v[1]));
+    d.roulette = uniformFloat(block.v[3]);
+    d.cosPolar = 0.0f;
+    d.sinPolar = 1.0f;
+    return d;
+}
+
+// cos(theta) uniform in (-1, 1] gives an isotropic direction together with a uniform azimuth
+static void polarFromBits(uint32_t bits, float& c, float& s) {
+    c = 1.0f - 2.0f * uniformFloat(bits);
+    s = std::sqrt(std::max(0.0f, 1.0f - c * c));
+}
+
+StepDraws stepDraws3D(uint64_t seed, uint64_t photon, uint32_t step) {
+    StepDraws d = stepDraws(seed, photon, step);
+    PhiloxBlock block = philox4x32(static_cast<uint32_t>(photon), static_cast<uint32_t>(photon >> 32), step, 1u,
+                                   static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32));
+    polarFromBits(block.v[0], d.cosPolar, d.sinPolar);
+    return d;
+}
+
+void fillStepVariates(StepVariates& variates, uint64_t seed, uint64_t photon, uint32_t firstStep) {
+    variates.photon = photon;
+    variates.firstStep = firstStep;
+
+#ifdef PHOTON_LANES
+    static_assert(PHOTON_VARIATE_BLOCK % PHOTON_LANES == 0, "a variate block must fill whole registers");
+    alignas(64) int32_t steps[PHOTON_LANES];
+    for (int l = 0; l < PHOTON_LANES; ++l) {
+        steps[l] = static_cast<int32_t>(firstStep + l);
+    }
+    const uint32_t seedLo = static_cast<uint32_t>(seed);
+    const uint32_t seedHi = static_cast<uint32_t>(seed >> 32);
+    for (int j = 0; j < PHOTON_VARIATE_BLOCK; j += PHOTON_LANES) {
+        // One lane per step: counter (photon, firstStep + j + lane, 0)
+        vint block[4] = { vseti(static_cast<int32_t>(static_cast<uint32_t>(photon))),
+                          vseti(static_cast<int32_t>(static_cast<uint32_t>(photon >> 32))),
+                          vloadi(steps) + vseti(j), vseti(0) };
+        vphilox4x32(block, seedLo, seedHi);
+
+        vfloat angle = vuniformFloat(block[2]);
+        vfloat s, c;
+        vsincos2pi(angle, s, c);
+        vstore(variates.angle + j, angle);
+        vstore(variates.sinAngle + j, s);
+        vstore(variates.cosAngle + j, c);
+        vstore(variates.scatter + j, -vlog(vuniformOpenFloat(block[0])));
+        vstore(variates.absorb + j, -vlog(vuniformOpenFloat(block[1])));
+        vstore(variates.roulette + j, vuniformFloat(block[3]));
+    }
+#else
+    for (int j = 0; j < PHOTON_VARIATE_BLOCK; ++j) {
+        StepDraws d = stepDraws(seed, photon, firstStep + j);
+        variates.angle[j] = d.angle;
+        variates.sinAngle[j] = d.sinAngle;
+        variates.cosAngle[j] = d.cosAngle;
+        variates.scatter[j] = d.scatter;
+        variates.absorb[j] = d.absorb;
+        variates.roulette[j] = d.roulette;
+    }
+#endif
+}
+
+void fillStepVariates3D(StepVariates& variates, uint64_t seed, uint64_t photon, uint32_t firstStep) {
+    fillStepVariates(variates, seed, photon, firstStep);
+
+#ifdef PHOTON_LANES
+    alignas(64) int32_t steps[PHOTON_LANES];
+    for (int l = 0; l < PHOTON_LANES; ++l) {
+        steps[l] = static_cast<int32_t>(firstStep + l);
+    }
+    const uint32_t seedLo = static_cast<uint32_t>(seed);
+    const uint32_t seedHi = static_cast<uint32_t>(seed >> 32);
+    for (int j = 0; j < PHOTON_VARIATE_BLOCK; j += PHOTON_LANES) {
+        vint block[4] = { vseti(static_cast<int32_t>(static_cast<uint32_t>(photon))),
+                          vseti(static_cast<int32_t>(static_cast<uint32_t>(photon >> 32))),
+                          vloadi(steps) + vseti(j), vseti(1) };
+        vphilox4x32(block, seedLo, seedHi);
+
+        vfloat c = vset(1.0f) - vset(2.0f) * vuniformFloat(block[0]);
+        vfloat s2 = vset(1.0f) - c * c;
+        vstore(variates.cosPolar + j, c);
+        vstore(variates.sinPolar + j, vsqrt(select(s2 > vset(0.0f), s2, vset(0.0f))));
+    }
+#else
+    for (int j = 0; j < PHOTON_VARIATE_BLOCK; ++j) {
+        PhiloxBlock block = philox4x32(static_cast<uint32_t>(photon), static_cast<uint32_t>(photon >> 32),
+                                       firstStep + j, 1u, static_cast<uint32_t>(seed),
+                                       static_cast<uint32_t>(seed >> 32));
+        polarFromBits(block.v[0], variates.cosPolar[j], variates.sinPolar[j]);
+    }
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef PHOTON_SAMPLER_H
+#define PHOTON_SAMPLER_H
+
+#include <cstdint>
+
+#define PHOTON_VARIATE_BLOCK 16 // Steps sampled per refill of a StepVariates block
+
+// Draws of one scatter step, already transformed for the transport loop
+struct StepDraws {
+    float angle; // Direction of the flight in turns, [0, 1)
+    float sinAngle;
+    float cosAngle;
+    float scatter; // Unit-mean exponential variate, -log(u), for the scattering distance
+    float absorb; // Unit-mean exponential variate for the absorption distance
+    float roulette; // Uniform in [0, 1) for Russian roulette
+    float cosPolar; // Polar angle of an isotropic 3D direction; 0 and 1 (in the plane) for 2D draws
+    float sinPolar;
+};
+
+// The draws of PHOTON_VARIATE_BLOCK consecutive steps of one photon. Slot j holds step
+// firstStep + j and is bit-identical to stepDraws() for that step: the block only changes
+// how the numbers are produced (all steps at once, in SIMD lanes when available).
+struct StepVariates {
+    alignas(64) float angle[PHOTON_VARIATE_BLOCK];
+    alignas(64) float sinAngle[PHOTON_VARIATE_BLOCK];
+    alignas(64) float cosAngle[PHOTON_VARIATE_BLOCK];
+    alignas(64) float scatter[PHOTON_VARIATE_BLOCK];
+    alignas(64) float absorb[PHOTON_VARIATE_BLOCK];
+    alignas(64) float roulette[PHOTON_VARIATE_BLOCK];
+    alignas(64) float cosPolar[PHOTON_VARIATE_BLOCK]; // Only filled by fillStepVariates3D()
+    alignas(64) float sinPolar[PHOTON_VARIATE_BLOCK];
+    uint64_t photon;
+    uint32_t firstStep;
+
+    StepVariates() : photon(UINT64_MAX), firstStep(0) {} // Holds nothing until filled
+    bool holds(uint64_t id, uint32_t step) const {
+        return id == photon && step - firstStep < PHOTON_VARIATE_BLOCK;
+    }
+    StepDraws draws(uint32_t step) const;
+    StepDraws draws3D(uint32_t step) const;
+};
+
+// Draws of one step computed directly from the photon's Philox stream
+StepDraws stepDraws(uint64_t seed, uint64_t photon, uint32_t step);
+
+// Draws of one step of a 3D photon: stepDraws() plus the polar angle, which comes from the
+// second block of the step (counter word 3 = 1)
+StepDraws stepDraws3D(uint64_t seed, uint64_t photon, uint32_t step);
+
+// Fill variates with steps [firstStep, firstStep + PHOTON_VARIATE_BLOCK) of photon
+void fillStepVariates(StepVariates& variates, uint64_t seed, uint64_t photon, uint32_t firstStep);
+
+// Same for a 3D photon, including the polar angles
+void fillStepVariates3D(StepVariates& variates, uint64_t seed, uint64_t photon, uint32_t firstStep);
+
+#endif // PHOTON_SAMPLER_H
@@ -0,0 +1,308 @@
+#include "photon_scene.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#define SCENE_BOX_SLACK 1.000001f // Relative widening of the box tests, so rounding never drops an edge
+
+// Strict total order on the edges by their centre along axis, so building does not depend on
+// the order the edges came in
+static bool edgeBefore(const SceneEdge& a, const SceneEdge& b, int axis) {
+    float ca = axis == 0 ? a.x0 + a.x1 : a.y0 + a.y1;
+    float cb = axis == 0 ? b.x0 + b.x1 : b.y0 + b.y1;
+    if (ca != cb) return ca < cb;
+    if (a.x0 != b.x0) return a.x0 < b.x0;
+    if (a.y0 != b.y0) return a.y0 < b.y0;
+    if (a.x1 != b.x1) return a.x1 < b.x1;
+    if (a.y1 != b.y1) return a.y1 < b.y1;
+    if (a.material != b.material) return a.material < b.material;
+    return a.reflectance < b.reflectance;
+}
+
+struct EdgeBounds {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+
+    EdgeBounds() : minX(1e30f), minY(1e30f), maxX(-1e30f), maxY(-1e30f) {}
+
+    void grow(const SceneEdge& e) {
+        minX = std::min(minX, std::min(e.x0, e.x1));
+        minY = std::min(minY, std::min(e.y0, e.y1));
+        maxX = std::max(maxX, std::max(e.x0, e.x1));
+        maxY = std::max(maxY, std::max(e.y0, e.y1));
+    }
+
+    // A random line crosses a convex region with probability proportional to its perimeter
+    float halfPerimeter() const { return (maxX - minX) + (maxY - minY); }
+};
+
+static void sortEdges(std::vector<SceneEdge>& edges, size_t begin, size_t end, int axis) {
+    std::sort(edges.begin() + begin, edges.begin() + end,
+              [axis](const SceneEdge& a, const SceneEdge& b) { return edgeBefore(a, b, axis); });
+}
+
+// Surface area heuristic: for both axes, sweep the edges in centre order and cut where the
+// children's perimeters weighted by their edge counts are smallest
+static uint32_t buildNode(std::vector<SceneEdge>& edges, std::vector<SceneNode>& nodes, size_t begin, size_t end) {
+    size_t count = end - begin;
+    EdgeBounds bounds;
+    for (size_t i = begin; i < end; ++i) bounds.grow(edges[i]);
+
+    float bestCost = 1e30f;
+    int bestAxis = 0;
+    size_t bestSplit = 0;
+    std::vector<float> rightCost(count);
+    for (int axis = 0; axis < 2; ++axis) {
+        sortEdges(edges, begin, end, axis);
+        EdgeBounds right;
+        for (size_t i = count; i > 1; --i) {
+            right.grow(edges[begin + i - 1]);
+            rightCost[i - 1] = right.halfPerimeter() * static_cast<float>(count - i + 1);
+        }
+        EdgeBounds left;
+        for (size_t i = 1; i < count; ++i) {
+            left.grow(edges[begin + i - 1]);
+            float cost = left.halfPerimeter() * static_cast<float>(i) + rightCost[i];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    SceneNode node;
+    node.minX = bounds.minX;
+    node.minY = bounds.minY;
+    node.maxX = bounds.maxX;
+    node.maxY = bounds.maxY;
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    float leafCost = bounds.halfPerimeter() * static_cast<float>(count);
+    if (count <= SCENE_LEAF_EDGES && leafCost <= bestCost + SCENE_NODE_COST * bounds.halfPerimeter()) {
+        sortEdges(edges, begin, end, 0); // Canonical order within the leaf
+        node.first = static_cast<uint32_t>(begin);
+        node.count = static_cast<uint32_t>(count);
+        nodes.push_back(node);
+        return index;
+    }
+
+    if (bestAxis != 1) sortEdges(edges, begin, end, bestAxis);
+    node.count = 0;
+    nodes.push_back(node);
+    buildNode(edges, nodes, begin, begin + bestSplit);
+    uint32_t second = buildNode(edges, nodes, begin + bestSplit, end); // Not assigned directly: the call grows nodes
+    nodes[index].first = second;
+    return index;
+}
+
+Scene buildScene(std::vector<SceneEdge> edges) {
+    Scene scene;
+    if (!edges.empty()) {
+        buildNode(edges, scene.nodes, 0, edges.size());
+    }
+    scene.edges.swap(edges);
+    return scene;
+}
+
+static bool parseMaterial(const std::string& name, SurfaceMaterial& material) {
+    if (name == "absorbing") material = SURFACE_ABSORBING;
+    else if (name == "specular") material = SURFACE_SPECULAR;
+    else if (name == "diffuse") material = SURFACE_DIFFUSE;
+    else return false;
+    return true;
+}
+
+bool loadScene(const std::string& path, float width, float height, Scene& scene, std::string& error) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        error = "cannot read " + path;
+        return false;
+    }
+
+    std::vector<SceneEdge> edges;
+    SceneEdge wall = { 0.0f, 0.0f, 0.0f, 0.0f, SURFACE_ABSORBING, 1.0f };
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string shape, materialName, token;
+        if (!(fields >> shape)) continue;
+        std::ostringstream where;
+        where << path << ":" << number << ": ";
+
+        SceneEdge style = { 0.0f, 0.0f, 0.0f, 0.0f, SURFACE_ABSORBING, 1.0f };
+        if (!(fields >> materialName) || !parseMaterial(materialName, style.material)) {
+            error = where.str() + "expected a material (absorbing, specular or diffuse)";
+            return false;
+        }
+        std::vector<float> xs, ys;
+        bool first = true;
+        while (fields >> token) {
+            float x, y;
+            char extra;
+            if (first && token.find(',') == std::string::npos) {
+                char* endPtr;
+                style.reflectance = std::strtof(token.c_str(), &endPtr);
+                if (*endPtr != '\0' || !(style.reflectance >= 0.0f && style.reflectance <= 1.0f)) {
+                    error = where.str() + "reflectance must be a number in [0, 1]";
+                    return false;
+                }
+            } else if (std::sscanf(token.c_str(), "%f,%f%c", &x, &y, &extra) == 2) {
+                if (!(x >= 0.0f && x <= width && y >= 0.0f && y <= height)) {
+                    std::ostringstream box;
+                    box << width << " x " << height;
+                    error = where.str() + "point '" + token + "' lies outside the " + box.str() + " box";
+                    return false;
+                }
+                xs.push_back(x);
+                ys.push_back(y);
+            } else {
+                error = where.str() + "bad point '" + token + "', expected x,y";
+                return false;
+            }
+            first = false;
+        }
+
+        if (shape == "walls") {
+            if (!xs.empty()) {
+                error = where.str() + "walls take no points";
+                return false;
+            }
+            wall = style;
+            continue;
+        }
+        bool closed = shape == "polygon";
+        if (!closed && shape != "polyline") {
+            error = where.str() + "unknown shape '" + shape + "'";
+            return false;
+        }
+        if (xs.size() < (closed ? 3u : 2u)) {
+            error = where.str() + (closed ? "a polygon needs 3 points" : "a polyline needs 2 points");
+            return false;
+        }
+        size_t count = closed ? xs.size() : xs.size() - 1;
+        for (size_t i = 0; i < count; ++i) {
+            size_t j = (i + 1) % xs.size();
+            SceneEdge edge = style;
+            edge.x0 = xs[i];
+            edge.y0 = ys[i];
+            edge.x1 = xs[j];
+            edge.y1 = ys[j];
+            if (edge.x0 != edge.x1 || edge.y0 != edge.y1) edges.push_back(edge);
+        }
+    }
+
+    scene = buildScene(edges);
+    scene.wallMaterial = wall.material;
+    scene.wallReflectance = wall.reflectance;
+    return true;
+}
+
+// Segment p + s * d against one edge: keeps the crossing in t when it comes before t (or at t on
+// a lower edge index, so ties resolve the same whatever order the edges are visited in)
+static inline void edgeHit(const SceneEdge& e, int index, float px, float py, float dx, float dy, SceneHit& hit) {
+    float ex = e.x1 - e.x0;
+    float ey = e.y1 - e.y0;
+    float denom = dx * ey - dy * ex;
+    if (denom == 0.0f) return; // Parallel, including grazing along the edge
+    float wx = e.x0 - px;
+    float wy = e.y0 - py;
+    float sNum = wx * ey - wy * ex; // s * denom, along the segment
+    float uNum = wx * dy - wy * dx; // u * denom, along the edge
+    // Reject on the numerators, so only crossings pay for the divisions
+    if (denom < 0.0f) {
+        denom = -denom;
+        sNum = -sNum;
+        uNum = -uNum;
+    }
+    if (sNum < 0.0f || uNum < 0.0f || uNum > denom) return;
+    float s = sNum / denom;
+    if (s < hit.t || (s == hit.t && (hit.edge < 0 || index < hit.edge))) {
+        hit.t = s;
+        hit.edge = index;
+    }
+}
+
+SceneHit intersectEdges(const std::vector<SceneEdge>& edges, float prev_x, float prev_y, float curr_x, float curr_y,
+                        int skipEdge) {
+    SceneHit hit = { 1.0f, -1 };
+    float dx = curr_x - prev_x;
+    float dy = curr_y - prev_y;
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (static_cast<int>(i) != skipEdge) edgeHit(edges[i], static_cast<int>(i), prev_x, prev_y, dx, dy, hit);
+    }
+    return hit;
+}
+
+// Parameter where the segment enters the node's box, or 1e30 when it misses it
+static inline float boxEntry(const SceneNode& node, float offX, float offY, float invX, float invY, float limit) {
+    float x0 = node.minX * invX + offX;
+    float x1 = node.maxX * invX + offX;
+    float y0 = node.minY * invY + offY;
+    float y1 = node.maxY * invY + offY;
+    float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), 0.0f);
+    float leave = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), limit);
+    return enter <= leave * SCENE_BOX_SLACK ? enter : 1e30f;
+}
+
+SceneHit intersectScene(const Scene& scene, float prev_x, float prev_y, float curr_x, float curr_y, int skipEdge) {
+    SceneHit hit = { 1.0f, -1 };
+    if (scene.nodes.empty()) return hit;
+    float dx = curr_x - prev_x;
+    float dy = curr_y - prev_y;
+    // A large finite inverse keeps 0 * inverse at 0 for axis-parallel segments
+    float invX = dx != 0.0f ? 1.0f / dx : 1e30f;
+    float invY = dy != 0.0f ? 1.0f / dy : 1e30f;
+    float offX = -prev_x * invX;
+    float offY = -prev_y * invY;
+
+    // Descend into the nearer child and defer the other one, which is skipped once a hit lies
+    // before its box. The root is not tested: its box holds every edge.
+    struct Pending {
+        uint32_t node;
+        float enter;
+    };
+    Pending stack[64];
+    int top = 0;
+    uint32_t current = 0;
+    for (;;) {
+        const SceneNode& node = scene.nodes[current];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (static_cast<int>(i) != skipEdge) {
+                    edgeHit(scene.edges[i], static_cast<int>(i), prev_x, prev_y, dx, dy, hit);
+                }
+            }
+        } else {
+            uint32_t a = current + 1;
+            uint32_t b = node.first;
+            float enterA = boxEntry(scene.nodes[a], offX, offY, invX, invY, hit.t);
+            float enterB = boxEntry(scene.nodes[b], offX, offY, invX, invY, hit.t);
+            bool swapped = enterB < enterA;
+            uint32_t nearNode = swapped ? b : a;
+            uint32_t farNode = swapped ? a : b;
+            float nearEnter = swapped ? enterB : enterA;
+            float farEnter = swapped ? enterA : enterB;
+            stack[top] = Pending{ farNode, farEnter };
+            top += farEnter <= hit.t * SCENE_BOX_SLACK;
+            if (nearEnter <= hit.t * SCENE_BOX_SLACK) {
+                current = nearNode;
+                continue;
+            }
+        }
+        // Next deferred node whose box still starts before the nearest hit
+        for (;;) {
+            if (top == 0) return hit;
+            Pending pending = stack[--top];
+            if (pending.enter <= hit.t * SCENE_BOX_SLACK) {
+                current = pending.node;
+                break;
+            }
+        }
+    }
+}
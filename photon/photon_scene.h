@@ -0,0 +1,76 @@
+#ifndef PHOTON_SCENE_H
+#define PHOTON_SCENE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SCENE_LEAF_EDGES 4 // Most edges in a BVH leaf
+#define SCENE_NODE_COST 1.0f // Cost of visiting a BVH node relative to testing an edge, for the build
+#define SCENE_MAX_BOUNCES 1000 // Reflections after which a flight is ended as absorbed
+
+enum SurfaceMaterial {
+    SURFACE_ABSORBING, // Stops the photon, as the plain box walls do
+    SURFACE_SPECULAR, // Mirror reflection
+    SURFACE_DIFFUSE // Lambertian reflection, cosine-distributed about the normal
+};
+
+// One straight edge of an obstacle or of the box
+struct SceneEdge {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+    SurfaceMaterial material;
+    float reflectance; // Chance that a reflector sends the photon back (the weight factor in weighted mode)
+};
+
+// Node of the bounding volume hierarchy. The first child of an inner node follows it in the
+// array; first holds the index of the second child. A leaf holds edges[first .. first + count).
+struct SceneNode {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    uint32_t first;
+    uint32_t count; // 0 for inner nodes
+};
+
+// Obstacles of a 2D box, with the edges sorted into BVH order, and the material of the box
+// walls. The walls stay out of the hierarchy: check_walls() finds them at no cost.
+struct Scene {
+    std::vector<SceneEdge> edges;
+    std::vector<SceneNode> nodes;
+    SurfaceMaterial wallMaterial;
+    float wallReflectance;
+
+    Scene() : wallMaterial(SURFACE_ABSORBING), wallReflectance(1.0f) {}
+};
+
+// Where a segment first crosses an edge: prev + t * (curr - prev); edge is -1 on a miss
+struct SceneHit {
+    float t;
+    int edge;
+};
+
+// Build the hierarchy over edges, with absorbing walls. The order of the edges does not matter:
+// the same set always gives the same scene.
+Scene buildScene(std::vector<SceneEdge> edges);
+
+// Read a scene description. Lines are "<shape> <material> [reflectance] x,y x,y ...", where the
+// shape is polygon (closed) or polyline (open, e.g. a two-point partition) and the material is
+// absorbing, specular or diffuse; "walls <material> [reflectance]" sets the box walls, which
+// absorb by default. Reflectance defaults to 1 and # starts a comment. Every point must lie in the
+// width x height box: the transport tests obstacles before the walls, so an edge outside would
+// turn back photons that already left.
+bool loadScene(const std::string& path, float width, float height, Scene& scene, std::string& error);
+
+// Reference linear scan over every edge, same result as the BVH query
+SceneHit intersectEdges(const std::vector<SceneEdge>& edges, float prev_x, float prev_y, float curr_x, float curr_y,
+                        int skipEdge);
+
+// Nearest edge crossed by the segment, visiting only the BVH nodes it passes through. skipEdge
+// (or -1) is ignored, so a flight leaving a surface does not hit it again at t = 0.
+SceneHit intersectScene(const Scene& scene, float prev_x, float prev_y, float curr_x, float curr_y, int skipEdge);
+
+#endif // PHOTON_SCENE_H
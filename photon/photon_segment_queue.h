@@ -0,0 +1,75 @@
+#ifndef PHOTON_SEGMENT_QUEUE_H
+#define PHOTON_SEGMENT_QUEUE_H
+
+#include "photon_transport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// One step of a photon as published to the render thread
+struct TraceSegment {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+    float angle; // Direction of the flight, in radians
+    PhotonFate fate; // Fate after the step
+};
+
+// Wait-free single-producer/single-consumer ring of segments. The producer only writes head and
+// the consumer only writes tail; each side keeps a cached copy of the other's index and reloads
+// it only when the ring looks full (or empty), so the shared cache lines are touched rarely.
+struct SegmentQueue {
+    explicit SegmentQueue(size_t capacity) // Rounded up to a power of two
+        : head(0), cachedTail(0), tail(0), cachedHead(0) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        ring.resize(size);
+        mask = size - 1;
+    }
+
+    // Producer: append all count segments, or none when they do not fit
+    bool tryPush(const TraceSegment* segments, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail + count > ring.size()) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail + count > ring.size()) return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            ring[(h + i) & mask] = segments[i];
+        }
+        head.store(h + count, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: take up to maxCount segments, oldest first
+    size_t pop(TraceSegment* out, size_t maxCount) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (cachedHead - t < maxCount) {
+            cachedHead = head.load(std::memory_order_acquire);
+        }
+        size_t count = std::min(cachedHead - t, maxCount);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = ring[(t + i) & mask];
+        }
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t capacity() const { return ring.size(); }
+
+private:
+    std::vector<TraceSegment> ring;
+    size_t mask;
+    char padBefore[64];
+    std::atomic<size_t> head; // Next slot to write, owned by the producer
+    size_t cachedTail; // Producer's view of tail
+    char padBetween[64]; // Keep the two sides on separate cache lines
+    std::atomic<size_t> tail; // Next slot to read, owned by the consumer
+    size_t cachedHead; // Consumer's view of head
+    char padAfter[64];
+};
+
+#endif // PHOTON_SEGMENT_QUEUE_H
@@ -0,0 +1,261 @@
+#include "photon_sensor_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define SENSOR_CELL_RADII 4.0f // Smallest cell edge in sensor radii
+
+bool segmentDiscHit(float prev_x, float prev_y, float B, float D, float a, float x_cent, float y_cent, float rr,
+                    float& t) {
+    float A = prev_x - x_cent;
+    float C = prev_y - y_cent;
+    float b = 2 * (A * B + C * D);
+    float c = A * A + C * C - rr;
+
+    float discriminant = b * b - 4 * a * c;
+    if (discriminant < 0) {
+        return false;
+    }
+
+    // 0 <= t <= 1 for t = n / (2a), tested without the divisions
+    float sqrt_discriminant = std::sqrt(discriminant);
+    float two_a = 2 * a;
+    float n1 = -b - sqrt_discriminant;
+    float n2 = -b + sqrt_discriminant;
+
+    // Entry point, or the exit point if the segment starts inside the disc
+    if (0 <= n1 && n1 <= two_a) {
+        t = n1 / two_a;
+    } else if (0 <= n2 && n2 <= two_a) {
+        t = n2 / two_a;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::tuple<std::pair<float, float>, int> check_sensors(float prev_x, float prev_y, float curr_x, float curr_y,
+                                                       const SensorCenters& centers, float r) {
+    float B = curr_x - prev_x;
+    float D = curr_y - prev_y;
+    float a = B * B + D * D;
+    float best_t = std::numeric_limits<float>::infinity();
+    int best = -2;
+
+    if (a > 0) {
+        for (size_t i = 0; i < centers.size(); ++i) {
+            float t;
+            if (segmentDiscHit(prev_x, prev_y, B, D, a, centers[i].first, centers[i].second, r * r, t) && t < best_t) {
+                best_t = t;
+                best = static_cast<int>(i);
+            }
+        }
+    }
+
+    if (best < 0) {
+        return { {0.0f, 0.0f}, -2 };
+    }
+    return { {prev_x + best_t * B, prev_y + best_t * D}, best };
+}
+
+SensorIndex buildSensorIndex(const SensorCenters& centers, float radius) {
+    SensorIndex index;
+    index.centers = centers;
+    index.radius = radius;
+    index.originX = 0.0f;
+    index.originY = 0.0f;
+    index.cellSize = 1.0f;
+    index.cellsX = 0;
+    index.cellsY = 0;
+    index.cellStart.assign(1, 0);
+
+    if (centers.empty()) {
+        return index;
+    }
+
+    float minX = centers[0].first, maxX = centers[0].first;
+    float minY = centers[0].second, maxY = centers[0].second;
+    for (const auto& c : centers) {
+        minX = std::min(minX, c.first);
+        maxX = std::max(maxX, c.first);
+        minY = std::min(minY, c.second);
+        maxY = std::max(maxY, c.second);
+    }
+    minX -= radius;
+    minY -= radius;
+    maxX += radius;
+    maxY += radius;
+
+    // About one sensor per cell, but never cells so small that a disc spans many of them
+    float area = (maxX - minX) * (maxY - minY);
+    index.cellSize = std::max(std::sqrt(area / centers.size()), SENSOR_CELL_RADII * radius);
+    index.originX = minX;
+    index.originY = minY;
+    index.cellsX = std::max(1, static_cast<int>(std::ceil((maxX - minX) / index.cellSize)));
+    index.cellsY = std::max(1, static_cast<int>(std::ceil((maxY - minY) / index.cellSize)));
+
+    // Register each disc in every cell its bounding box overlaps (with a little slack for rounding)
+    const float slack = 1e-4f * index.cellSize;
+    auto cellRange = [&](const std::pair<float, float>& c, int& x0, int& x1, int& y0, int& y1) {
+        x0 = std::max(0, static_cast<int>((c.first - radius - slack - minX) / index.cellSize));
+        x1 = std::min(index.cellsX - 1, static_cast<int>((c.first + radius + slack - minX) / index.cellSize));
+        y0 = std::max(0, static_cast<int>((c.second - radius - slack - minY) / index.cellSize));
+        y1 = std::min(index.cellsY - 1, static_cast<int>((c.second + radius + slack - minY) / index.cellSize));
+    };
+
+    std::vector<uint32_t> counts(static_cast<size_t>(index.cellsX) * index.cellsY + 1, 0);
+    for (const auto& c : centers) {
+        int x0, x1, y0, y1;
+        cellRange(c, x0, x1, y0, y1);
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                counts[cy * index.cellsX + cx + 1]++;
+            }
+        }
+    }
+    for (size_t i = 1; i < counts.size(); ++i) {
+        counts[i] += counts[i - 1];
+    }
+    index.cellStart = counts;
+    index.cellItems.resize(counts.back());
+
+    for (size_t i = 0; i < centers.size(); ++i) {
+        int x0, x1, y0, y1;
+        cellRange(centers[i], x0, x1, y0, y1);
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                index.cellItems[counts[cy * index.cellsX + cx]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+    return index;
+}
+
+std::tuple<std::pair<float, float>, int> check_sensors(float prev_x, float prev_y, float curr_x, float curr_y,
+                                                       const SensorIndex& sensors) {
+    const float inf = std::numeric_limits<float>::infinity();
+    if (sensors.centers.empty()) {
+        return { {0.0f, 0.0f}, -2 };
+    }
+
+    float B = curr_x - prev_x;
+    float D = curr_y - prev_y;
+    float a = B * B + D * D;
+    if (!(a > 0)) {
+        return { {0.0f, 0.0f}, -2 };
+    }
+    float rr = sensors.radius * sensors.radius;
+
+    // Clip the segment to the grid bounds
+    float minX = sensors.originX, maxX = minX + sensors.cellsX * sensors.cellSize;
+    float minY = sensors.originY, maxY = minY + sensors.cellsY * sensors.cellSize;
+    float t_enter = 0.0f, t_leave = 1.0f;
+    if (B != 0) {
+        float ta = (minX - prev_x) / B, tb = (maxX - prev_x) / B;
+        t_enter = std::max(t_enter, std::min(ta, tb));
+        t_leave = std::min(t_leave, std::max(ta, tb));
+    } else if (prev_x < minX || prev_x > maxX) {
+        return { {0.0f, 0.0f}, -2 };
+    }
+    if (D != 0) {
+        float ta = (minY - prev_y) / D, tb = (maxY - prev_y) / D;
+        t_enter = std::max(t_enter, std::min(ta, tb));
+        t_leave = std::min(t_leave, std::max(ta, tb));
+    } else if (prev_y < minY || prev_y > maxY) {
+        return { {0.0f, 0.0f}, -2 };
+    }
+    if (t_enter > t_leave) {
+        return { {0.0f, 0.0f}, -2 };
+    }
+
+    // Walk the cells along the segment (Amanatides & Woo)
+    float inv_cell = 1.0f / sensors.cellSize;
+    int cx = static_cast<int>((prev_x + t_enter * B - minX) * inv_cell);
+    int cy = static_cast<int>((prev_y + t_enter * D - minY) * inv_cell);
+    cx = std::min(std::max(cx, 0), sensors.cellsX - 1);
+    cy = std::min(std::max(cy, 0), sensors.cellsY - 1);
+
+    int step_x = B > 0 ? 1 : (B < 0 ? -1 : 0);
+    int step_y = D > 0 ? 1 : (D < 0 ? -1 : 0);
+    float t_delta_x = B != 0 ? sensors.cellSize / std::fabs(B) : inf;
+    float t_delta_y = D != 0 ? sensors.cellSize / std::fabs(D) : inf;
+    float t_max_x = B > 0 ? (minX + (cx + 1) * sensors.cellSize - prev_x) / B
+                  : B < 0 ? (minX + cx * sensors.cellSize - prev_x) / B : inf;
+    float t_max_y = D > 0 ? (minY + (cy + 1) * sensors.cellSize - prev_y) / D
+                  : D < 0 ? (minY + cy * sensors.cellSize - prev_y) / D : inf;
+
+    float best_t = inf;
+    int best = -2;
+    while (true) {
+        size_t cell = static_cast<size_t>(cy) * sensors.cellsX + cx;
+        for (uint32_t k = sensors.cellStart[cell]; k < sensors.cellStart[cell + 1]; ++k) {
+            uint32_t i = sensors.cellItems[k];
+            float t;
+            if (!segmentDiscHit(prev_x, prev_y, B, D, a, sensors.centers[i].first, sensors.centers[i].second, rr, t)) {
+                continue;
+            }
+            if (t < best_t || (t == best_t && static_cast<int>(i) < best)) {
+                best_t = t;
+                best = static_cast<int>(i);
+            }
+        }
+
+        // Later cells only hold intersections further along the segment
+        float t_exit = std::min(t_max_x, t_max_y);
+        if (best_t <= t_exit || t_exit > t_leave) {
+            break;
+        }
+        if (t_max_x < t_max_y) {
+            cx += step_x;
+            if (cx < 0 || cx >= sensors.cellsX) break;
+            t_max_x += t_delta_x;
+        } else {
+            cy += step_y;
+            if (cy < 0 || cy >= sensors.cellsY) break;
+            t_max_y += t_delta_y;
+        }
+    }
+
+    if (best < 0) {
+        return { {0.0f, 0.0f}, -2 };
+    }
+    return { {prev_x + best_t * B, prev_y + best_t * D}, best };
+}
+
+void sensorsInRect(const SensorIndex& sensors, float left, float right, float bottom, float top,
+                   std::vector<uint32_t>& out) {
+    out.clear();
+    if (sensors.centers.empty()) return;
+
+    float inv_cell = 1.0f / sensors.cellSize;
+    auto cellX = [&](float x) {
+        int c = static_cast<int>(std::floor((x - sensors.originX) * inv_cell));
+        return std::min(std::max(c, 0), sensors.cellsX - 1);
+    };
+    auto cellY = [&](float y) {
+        int c = static_cast<int>(std::floor((y - sensors.originY) * inv_cell));
+        return std::min(std::max(c, 0), sensors.cellsY - 1);
+    };
+    int x0 = cellX(left), x1 = cellX(right);
+    int y0 = cellY(bottom), y1 = cellY(top);
+    float rr = sensors.radius * sensors.radius;
+
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            size_t cell = static_cast<size_t>(cy) * sensors.cellsX + cx;
+            for (uint32_t k = sensors.cellStart[cell]; k < sensors.cellStart[cell + 1]; ++k) {
+                uint32_t i = sensors.cellItems[k];
+                float x = sensors.centers[i].first;
+                float y = sensors.centers[i].second;
+                // Point of the rectangle nearest the centre
+                float nx = std::min(std::max(x, left), right);
+                float ny = std::min(std::max(y, bottom), top);
+                if ((nx - x) * (nx - x) + (ny - y) * (ny - y) > rr) continue;
+                // A disc is listed in every cell it overlaps; report it from the one holding that
+                // nearest point, which is always among them
+                if (cellX(nx) == cx && cellY(ny) == cy) out.push_back(i);
+            }
+        }
+    }
+}
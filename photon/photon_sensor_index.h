@@ -0,0 +1,49 @@
+#ifndef PHOTON_SENSOR_INDEX_H
+#define PHOTON_SENSOR_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<float, float>> SensorCenters;
+
+// Uniform grid over the sensor discs, built once per layout. Each cell lists every disc
+// that overlaps it (compressed rows: the discs of cell c are cellItems[cellStart[c] .. cellStart[c + 1])).
+struct SensorIndex {
+    SensorCenters centers;
+    float radius;
+    float originX; // Lower-left corner of the grid
+    float originY;
+    float cellSize;
+    int cellsX;
+    int cellsY;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellItems;
+
+    std::size_t size() const { return centers.size(); }
+};
+
+SensorIndex buildSensorIndex(const SensorCenters& centers, float radius);
+
+// Segment (prev + t * (B, D), a = B^2 + D^2 > 0) against one disc: the smallest t in [0, 1]
+// where the segment touches it
+bool segmentDiscHit(float prev_x, float prev_y, float B, float D, float a, float x_cent, float y_cent, float rr,
+                    float& t);
+
+// Reference linear scan over every sensor, same result as the indexed query
+std::tuple<std::pair<float, float>, int> check_sensors(float prev_x, float prev_y, float curr_x, float curr_y,
+                                                       const SensorCenters& centers, float r);
+
+// Nearest sensor disc touched by the segment, walking only the grid cells it crosses.
+// Returns the point where the segment enters the disc and the sensor index, or -2 on a miss.
+std::tuple<std::pair<float, float>, int> check_sensors(float prev_x, float prev_y, float curr_x, float curr_y,
+                                                       const SensorIndex& sensors);
+
+// Sensors whose disc overlaps [left, right] x [bottom, top], each once, visiting only the grid
+// cells under the rectangle; out is cleared first
+void sensorsInRect(const SensorIndex& sensors, float left, float right, float bottom, float top,
+                   std::vector<uint32_t>& out);
+
+#endif // PHOTON_SENSOR_INDEX_H
@@ -0,0 +1,296 @@
+#include "photon_sensor_index3d.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define SENSOR_CELL_RADII 4.0f // Smallest cell edge in mean sensor radii
+#define SENSOR_MAX_CELLS (1 << 22) // Upper bound on the grid size
+
+Sensor3D makeSphereSensor(float x, float y, float z, float radius) {
+    Sensor3D sensor = { SENSOR_SPHERE, x, y, z, radius, 0.0f, 0.0f, 0.0f, 1.0f };
+    return sensor;
+}
+
+Sensor3D makeCylinderSensor(float x, float y, float z, float radius, float halfLength, float axisX, float axisY,
+                            float axisZ) {
+    float length = std::sqrt(axisX * axisX + axisY * axisY + axisZ * axisZ);
+    Sensor3D sensor = { SENSOR_CYLINDER, x, y, z, radius, halfLength,
+                        axisX / length, axisY / length, axisZ / length };
+    return sensor;
+}
+
+// Entry point of the inside interval [t_in, t_out], or its exit if the segment starts inside
+static bool firstCrossing(float t_in, float t_out, float& t) {
+    if (0 <= t_in && t_in <= 1) {
+        t = t_in;
+    } else if (0 <= t_out && t_out <= 1) {
+        t = t_out;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool segmentSensorHit(const Sensor3D& sensor, float px, float py, float pz, float dx, float dy, float dz, float& t) {
+    const float inf = std::numeric_limits<float>::infinity();
+    float wx = px - sensor.x;
+    float wy = py - sensor.y;
+    float wz = pz - sensor.z;
+    float rr = sensor.radius * sensor.radius;
+
+    if (sensor.shape == SENSOR_SPHERE) {
+        float a = dx * dx + dy * dy + dz * dz;
+        float b = wx * dx + wy * dy + wz * dz; // Half the linear coefficient
+        float c = wx * wx + wy * wy + wz * wz - rr;
+        float discriminant = b * b - a * c;
+        if (discriminant < 0 || !(a > 0)) {
+            return false;
+        }
+        float root = std::sqrt(discriminant);
+        return firstCrossing((-b - root) / a, (-b + root) / a, t);
+    }
+
+    // Cylinder: inside the infinite tube and between the caps
+    float wu = wx * sensor.axisX + wy * sensor.axisY + wz * sensor.axisZ;
+    float du = dx * sensor.axisX + dy * sensor.axisY + dz * sensor.axisZ;
+    float wpx = wx - wu * sensor.axisX, wpy = wy - wu * sensor.axisY, wpz = wz - wu * sensor.axisZ;
+    float dpx = dx - du * sensor.axisX, dpy = dy - du * sensor.axisY, dpz = dz - du * sensor.axisZ;
+
+    float a = dpx * dpx + dpy * dpy + dpz * dpz;
+    float b = wpx * dpx + wpy * dpy + wpz * dpz;
+    float c = wpx * wpx + wpy * wpy + wpz * wpz - rr;
+    float tube_in = -inf, tube_out = inf;
+    if (a > 0) {
+        float discriminant = b * b - a * c;
+        if (discriminant < 0) {
+            return false;
+        }
+        float root = std::sqrt(discriminant);
+        tube_in = (-b - root) / a;
+        tube_out = (-b + root) / a;
+    } else if (c > 0) {
+        return false; // Parallel to the axis, outside the tube
+    }
+
+    float cap_in = -inf, cap_out = inf;
+    if (du != 0) {
+        float ta = (-sensor.halfLength - wu) / du;
+        float tb = (sensor.halfLength - wu) / du;
+        cap_in = std::min(ta, tb);
+        cap_out = std::max(ta, tb);
+    } else if (std::fabs(wu) > sensor.halfLength) {
+        return false;
+    }
+
+    float t_in = std::max(tube_in, cap_in);
+    float t_out = std::min(tube_out, cap_out);
+    if (t_in > t_out) {
+        return false;
+    }
+    return firstCrossing(t_in, t_out, t);
+}
+
+// Half extents of the bounding box of a sensor
+static void sensorExtent(const Sensor3D& sensor, float& ex, float& ey, float& ez) {
+    if (sensor.shape == SENSOR_SPHERE) {
+        ex = ey = ez = sensor.radius;
+        return;
+    }
+    auto extent = [&](float u) {
+        return sensor.halfLength * std::fabs(u) + sensor.radius * std::sqrt(std::max(0.0f, 1.0f - u * u));
+    };
+    ex = extent(sensor.axisX);
+    ey = extent(sensor.axisY);
+    ez = extent(sensor.axisZ);
+}
+
+SensorHit3D check_sensors_3d(float prev_x, float prev_y, float prev_z, float curr_x, float curr_y, float curr_z,
+                             const Sensors3D& sensors) {
+    float dx = curr_x - prev_x;
+    float dy = curr_y - prev_y;
+    float dz = curr_z - prev_z;
+    float best_t = std::numeric_limits<float>::infinity();
+    int best = -2;
+    for (size_t i = 0; i < sensors.size(); ++i) {
+        float t;
+        if (segmentSensorHit(sensors[i], prev_x, prev_y, prev_z, dx, dy, dz, t) && t < best_t) {
+            best_t = t;
+            best = static_cast<int>(i);
+        }
+    }
+
+    SensorHit3D hit = { 0.0f, 0.0f, 0.0f, best };
+    if (best >= 0) {
+        hit.x = prev_x + best_t * dx;
+        hit.y = prev_y + best_t * dy;
+        hit.z = prev_z + best_t * dz;
+    }
+    return hit;
+}
+
+SensorIndex3D buildSensorIndex3D(const Sensors3D& sensors) {
+    SensorIndex3D index;
+    index.sensors = sensors;
+    index.originX = index.originY = index.originZ = 0.0f;
+    index.cellSize = 1.0f;
+    index.cellsX = index.cellsY = index.cellsZ = 0;
+    index.cellStart.assign(1, 0);
+
+    if (sensors.empty()) {
+        return index;
+    }
+
+    const float inf = std::numeric_limits<float>::infinity();
+    float minX = inf, minY = inf, minZ = inf, maxX = -inf, maxY = -inf, maxZ = -inf;
+    float radiusSum = 0.0f;
+    for (const Sensor3D& s : sensors) {
+        float ex, ey, ez;
+        sensorExtent(s, ex, ey, ez);
+        minX = std::min(minX, s.x - ex);
+        maxX = std::max(maxX, s.x + ex);
+        minY = std::min(minY, s.y - ey);
+        maxY = std::max(maxY, s.y + ey);
+        minZ = std::min(minZ, s.z - ez);
+        maxZ = std::max(maxZ, s.z + ez);
+        radiusSum += s.radius;
+    }
+
+    // About one sensor per cell, with cells no smaller than a few sensor radii
+    float volume = (maxX - minX) * (maxY - minY) * (maxZ - minZ);
+    float cellSize = std::max(std::cbrt(volume / sensors.size()), SENSOR_CELL_RADII * radiusSum / sensors.size());
+    auto cellsAlong = [&](float extent) { return std::max(1, static_cast<int>(std::ceil(extent / cellSize))); };
+    while (static_cast<double>(cellsAlong(maxX - minX)) * cellsAlong(maxY - minY) * cellsAlong(maxZ - minZ) >
+           SENSOR_MAX_CELLS) {
+        cellSize *= 1.25f;
+    }
+    index.cellSize = cellSize;
+    index.originX = minX;
+    index.originY = minY;
+    index.originZ = minZ;
+    index.cellsX = cellsAlong(maxX - minX);
+    index.cellsY = cellsAlong(maxY - minY);
+    index.cellsZ = cellsAlong(maxZ - minZ);
+
+    // Register each sensor in every cell its bounding box overlaps (with a little slack for rounding)
+    const float slack = 1e-4f * cellSize;
+    auto cellRange = [&](const Sensor3D& s, int range[6]) {
+        float ex, ey, ez;
+        sensorExtent(s, ex, ey, ez);
+        range[0] = std::max(0, static_cast<int>((s.x - ex - slack - minX) / cellSize));
+        range[1] = std::min(index.cellsX - 1, static_cast<int>((s.x + ex + slack - minX) / cellSize));
+        range[2] = std::max(0, static_cast<int>((s.y - ey - slack - minY) / cellSize));
+        range[3] = std::min(index.cellsY - 1, static_cast<int>((s.y + ey + slack - minY) / cellSize));
+        range[4] = std::max(0, static_cast<int>((s.z - ez - slack - minZ) / cellSize));
+        range[5] = std::min(index.cellsZ - 1, static_cast<int>((s.z + ez + slack - minZ) / cellSize));
+    };
+    auto cellOf = [&](int cx, int cy, int cz) {
+        return (static_cast<size_t>(cz) * index.cellsY + cy) * index.cellsX + cx;
+    };
+
+    std::vector<uint32_t> counts(static_cast<size_t>(index.cellsX) * index.cellsY * index.cellsZ + 1, 0);
+    for (const Sensor3D& s : sensors) {
+        int r[6];
+        cellRange(s, r);
+        for (int cz = r[4]; cz <= r[5]; ++cz) {
+            for (int cy = r[2]; cy <= r[3]; ++cy) {
+                for (int cx = r[0]; cx <= r[1]; ++cx) {
+                    counts[cellOf(cx, cy, cz) + 1]++;
+                }
+            }
+        }
+    }
+    for (size_t i = 1; i < counts.size(); ++i) {
+        counts[i] += counts[i - 1];
+    }
+    index.cellStart = counts;
+    index.cellItems.resize(counts.back());
+
+    for (size_t i = 0; i < sensors.size(); ++i) {
+        int r[6];
+        cellRange(sensors[i], r);
+        for (int cz = r[4]; cz <= r[5]; ++cz) {
+            for (int cy = r[2]; cy <= r[3]; ++cy) {
+                for (int cx = r[0]; cx <= r[1]; ++cx) {
+                    index.cellItems[counts[cellOf(cx, cy, cz)]++] = static_cast<uint32_t>(i);
+                }
+            }
+        }
+    }
+    return index;
+}
+
+SensorHit3D check_sensors_3d(float prev_x, float prev_y, float prev_z, float curr_x, float curr_y, float curr_z,
+                             const SensorIndex3D& index) {
+    const float inf = std::numeric_limits<float>::infinity();
+    SensorHit3D miss = { 0.0f, 0.0f, 0.0f, -2 };
+    if (index.sensors.empty()) {
+        return miss;
+    }
+
+    float p[3] = { prev_x, prev_y, prev_z };
+    float d[3] = { curr_x - prev_x, curr_y - prev_y, curr_z - prev_z };
+    float lo[3] = { index.originX, index.originY, index.originZ };
+    int cells[3] = { index.cellsX, index.cellsY, index.cellsZ };
+
+    // Clip the segment to the grid bounds
+    float t_enter = 0.0f, t_leave = 1.0f;
+    for (int k = 0; k < 3; ++k) {
+        float hi = lo[k] + cells[k] * index.cellSize;
+        if (d[k] != 0) {
+            float ta = (lo[k] - p[k]) / d[k], tb = (hi - p[k]) / d[k];
+            t_enter = std::max(t_enter, std::min(ta, tb));
+            t_leave = std::min(t_leave, std::max(ta, tb));
+        } else if (p[k] < lo[k] || p[k] > hi) {
+            return miss;
+        }
+    }
+    if (t_enter > t_leave) {
+        return miss;
+    }
+
+    // Walk the cells along the segment (Amanatides & Woo in three dimensions)
+    int c[3], step[3];
+    float t_max[3], t_delta[3];
+    for (int k = 0; k < 3; ++k) {
+        c[k] = static_cast<int>((p[k] + t_enter * d[k] - lo[k]) / index.cellSize);
+        c[k] = std::min(std::max(c[k], 0), cells[k] - 1);
+        step[k] = d[k] > 0 ? 1 : (d[k] < 0 ? -1 : 0);
+        t_delta[k] = d[k] != 0 ? index.cellSize / std::fabs(d[k]) : inf;
+        t_max[k] = d[k] > 0 ? (lo[k] + (c[k] + 1) * index.cellSize - p[k]) / d[k]
+                 : d[k] < 0 ? (lo[k] + c[k] * index.cellSize - p[k]) / d[k] : inf;
+    }
+
+    float best_t = inf;
+    int best = -2;
+    while (true) {
+        size_t cell = (static_cast<size_t>(c[2]) * index.cellsY + c[1]) * index.cellsX + c[0];
+        for (uint32_t k = index.cellStart[cell]; k < index.cellStart[cell + 1]; ++k) {
+            uint32_t i = index.cellItems[k];
+            float t;
+            if (!segmentSensorHit(index.sensors[i], p[0], p[1], p[2], d[0], d[1], d[2], t)) {
+                continue;
+            }
+            if (t < best_t || (t == best_t && static_cast<int>(i) < best)) {
+                best_t = t;
+                best = static_cast<int>(i);
+            }
+        }
+
+        // Later cells only hold intersections further along the segment
+        int axis = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+        float t_exit = t_max[axis];
+        if (best_t <= t_exit || t_exit > t_leave) {
+            break;
+        }
+        c[axis] += step[axis];
+        if (c[axis] < 0 || c[axis] >= cells[axis]) break;
+        t_max[axis] += t_delta[axis];
+    }
+
+    if (best < 0) {
+        return miss;
+    }
+    SensorHit3D hit = { p[0] + best_t * d[0], p[1] + best_t * d[1], p[2] + best_t * d[2], best };
+    return hit;
+}
@@ -0,0 +1,71 @@
+#ifndef PHOTON_SENSOR_INDEX3D_H
+#define PHOTON_SENSOR_INDEX3D_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum SensorShape {
+    SENSOR_SPHERE,
+    SENSOR_CYLINDER // Capped, along an arbitrary axis
+};
+
+// One sensor volume of the 3D transport
+struct Sensor3D {
+    SensorShape shape;
+    float x; // Center
+    float y;
+    float z;
+    float radius;
+    float halfLength; // Cylinders: half the length along the axis
+    float axisX; // Cylinders: unit axis
+    float axisY;
+    float axisZ;
+};
+
+typedef std::vector<Sensor3D> Sensors3D;
+
+Sensor3D makeSphereSensor(float x, float y, float z, float radius);
+Sensor3D makeCylinderSensor(float x, float y, float z, float radius, float halfLength, float axisX, float axisY,
+                            float axisZ); // The axis is normalised here
+
+// Uniform 3D grid over the sensor bounding boxes, the counterpart of SensorIndex
+// (the sensors of cell c are cellItems[cellStart[c] .. cellStart[c + 1])).
+struct SensorIndex3D {
+    Sensors3D sensors;
+    float originX; // Lower corner of the grid
+    float originY;
+    float originZ;
+    float cellSize;
+    int cellsX;
+    int cellsY;
+    int cellsZ;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellItems;
+
+    std::size_t size() const { return sensors.size(); }
+};
+
+SensorIndex3D buildSensorIndex3D(const Sensors3D& sensors);
+
+// Segment p + t * d, t in [0, 1], against one sensor: the entry t, or the exit t if the segment
+// starts inside (as segmentDiscHit() does in 2D)
+bool segmentSensorHit(const Sensor3D& sensor, float px, float py, float pz, float dx, float dy, float dz, float& t);
+
+// Where a segment first touches a sensor; sensor is -2 on a miss
+struct SensorHit3D {
+    float x;
+    float y;
+    float z;
+    int sensor;
+};
+
+// Reference linear scan over every sensor, same result as the indexed query
+SensorHit3D check_sensors_3d(float prev_x, float prev_y, float prev_z, float curr_x, float curr_y, float curr_z,
+                             const Sensors3D& sensors);
+
+// Nearest sensor touched by the segment, walking only the grid cells it crosses
+SensorHit3D check_sensors_3d(float prev_x, float prev_y, float prev_z, float curr_x, float curr_y, float curr_z,
+                             const SensorIndex3D& index);
+
+#endif // PHOTON_SENSOR_INDEX3D_H
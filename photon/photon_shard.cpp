@@ -0,0 +1,117 @@
+#include "photon_shard.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+ShardRange shardRange(uint64_t photonTotal, uint32_t shard, uint32_t shardCount) {
+    uint64_t chunks = (photonTotal + PHOTON_CHUNK - 1) / PHOTON_CHUNK;
+    uint64_t begin = std::min(photonTotal, chunks * shard / shardCount * PHOTON_CHUNK);
+    uint64_t end = std::min(photonTotal, chunks * (shard + 1) / shardCount * PHOTON_CHUNK);
+    ShardRange range = { begin, end - begin };
+    return range;
+}
+
+static std::string shardName(const std::string& dir, uint32_t shard, uint32_t shardCount, const char* suffix) {
+    std::ostringstream name;
+    if (!dir.empty()) {
+        name << dir << "/";
+    }
+    name << "shard-" << shard << "-of-" << shardCount << suffix;
+    return name.str();
+}
+
+std::string shardPath(const std::string& dir, uint32_t shard, uint32_t shardCount) {
+    return shardName(dir, shard, shardCount, ".tally");
+}
+
+bool claimShard(const std::string& dir, uint32_t shard, uint32_t shardCount) {
+    // "x" fails if the file exists; the create is atomic on local and NFS (v3 and later) directories
+    FILE* file = std::fopen(shardName(dir, shard, shardCount, ".claim").c_str(), "wx");
+    if (!file) return false;
+    std::fclose(file);
+    return true;
+}
+
+bool mergeShards(const std::vector<Checkpoint>& shards, Checkpoint& merged, std::string& error) {
+    if (shards.empty()) {
+        error = "no shards";
+        return false;
+    }
+
+    // Merge in photon order
+    std::vector<const Checkpoint*> order;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        order.push_back(&shards[i]);
+    }
+    std::sort(order.begin(), order.end(), [](const Checkpoint* a, const Checkpoint* b) {
+        return a->tallies.firstPhoton < b->tallies.firstPhoton;
+    });
+
+    merged = Checkpoint();
+    merged.config = order[0]->config;
+    merged.sensors = order[0]->sensors;
+    initBatchResult(merged.tallies, merged.sensors.size());
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        const Checkpoint& shard = *order[i];
+        std::ostringstream message;
+        uint64_t expected = merged.tallies.photons;
+        if (!sameTransportConfig(shard.config, merged.config) || shard.sensors != merged.sensors ||
+            shard.runPhotons != order[0]->runPhotons || shard.shardCount != order[0]->shardCount) {
+            message << "shard at photon " << shard.tallies.firstPhoton << " belongs to a different run";
+        } else if (shard.tallies.firstPhoton != expected) {
+            message << (shard.tallies.firstPhoton > expected ? "photons missing from " : "photons traced twice from ")
+                    << std::min(expected, shard.tallies.firstPhoton) << " to "
+                    << std::max(expected, shard.tallies.firstPhoton);
+        } else if (shard.tallies.photons < shard.photonTarget) {
+            message << "shard at photon " << shard.tallies.firstPhoton << " is unfinished ("
+                    << shard.tallies.photons << " of " << shard.photonTarget << " photons)";
+        }
+        if (!message.str().empty()) {
+            error = message.str();
+            return false;
+        }
+        mergeBatchResult(merged.tallies, shard.tallies);
+        merged.photonTarget += shard.photonTarget;
+    }
+
+    // The sorted ranges are contiguous from 0, so only the end of the run can be missing
+    uint64_t runPhotons = order[0]->runPhotons;
+    if (merged.tallies.photons != runPhotons) {
+        std::ostringstream message;
+        message << "photons missing from " << merged.tallies.photons << " to " << runPhotons << " (the run has "
+                << order[0]->shardCount << " slices)";
+        error = message.str();
+        return false;
+    }
+    merged.runPhotons = runPhotons;
+    merged.shardCount = 1; // The whole run, as if traced unsharded
+    return true;
+}
+
+void writeArrivals(std::ostream& out, const BatchResult& result) {
+    for (size_t i = 0; result.timeBins > 0 && i < result.sensorHits.size(); ++i) {
+        const double* histogram = arrivalHistogram(result, i);
+        out << "tof " << i;
+        for (int bin = 0; bin <= result.timeBins; ++bin) {
+            out << " " << histogram[bin];
+        }
+        out << "\n";
+    }
+}
+
+void writeTallies(std::ostream& out, const BatchResult& result, const SensorCenters& centers,
+                  const std::vector<SensorEstimate>& estimates) {
+    out << "photons " << result.photons << "\n";
+    out << "steps " << result.steps << "\n";
+    out << "wall " << result.wallLosses << "\n";
+    out << "absorbed " << result.absorbed << "\n";
+    // sensor <index> <x> <y> <hits> <detected fraction> <standard error>
+    for (size_t i = 0; i < result.sensorHits.size(); ++i) {
+        SensorEstimate estimate = estimates.empty() ? sensorEstimate(result, i) : estimates[i];
+        out << "sensor " << i << " " << centers[i].first << " " << centers[i].second << " "
+            << result.sensorHits[i] << " " << estimate.mean << " " << estimate.stdError << "\n";
+    }
+    writeArrivals(out, result);
+}
@@ -0,0 +1,47 @@
+#ifndef PHOTON_SHARD_H
+#define PHOTON_SHARD_H
+
+#include "photon_checkpoint.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Photons [first, first + count) of a run
+struct ShardRange {
+    uint64_t first;
+    uint64_t count;
+};
+
+// Slice shard of shardCount of a photonTotal run. Slices are disjoint, cover the run and start on
+// PHOTON_CHUNK boundaries; since every photon has its own random stream, a slice traced anywhere
+// gives the same photons as the same indices inside a single run.
+ShardRange shardRange(uint64_t photonTotal, uint32_t shard, uint32_t shardCount);
+
+// dir/shard-<shard>-of-<shardCount>.tally, the checkpoint of the slice (written and resumed like
+// any checkpoint)
+std::string shardPath(const std::string& dir, uint32_t shard, uint32_t shardCount);
+
+// Take the slice for this process by creating dir/shard-<shard>-of-<shardCount>.claim exclusively;
+// false when another process got there first. A claim whose process died stays behind: finish the
+// slice by running that shard explicitly, which resumes from its tally file.
+bool claimShard(const std::string& dir, uint32_t shard, uint32_t shardCount);
+
+// Merge shard tallies of one run into merged. The shards must share configuration, sensors and the
+// run's size (runPhotons N and shardCount), and their photon ranges must tile the whole [0, N)
+// without gaps or overlaps (in any order in the vector), so a missing last slice is an error too.
+// Counts are exact; the weight sums are added shard by shard, so in weighted mode they can
+// differ from a single run's in the last bits. False with a message in error otherwise.
+bool mergeShards(const std::vector<Checkpoint>& shards, Checkpoint& merged, std::string& error);
+
+// Text form of the tallies printed by PhotonBatch and PhotonMerge (photons, steps, wall, absorbed,
+// sensor and tof lines). The detected fractions and their errors come from estimates when given,
+// e.g. the replicate estimates of a quasi-Monte Carlo run, and from sensorEstimate() otherwise.
+void writeTallies(std::ostream& out, const BatchResult& result, const SensorCenters& centers,
+                  const std::vector<SensorEstimate>& estimates = std::vector<SensorEstimate>());
+
+// The tof lines alone: tof <sensor> <weight per bin, from t = 0 in steps of the bin width> <weight arriving later>
+void writeArrivals(std::ostream& out, const BatchResult& result);
+
+#endif // PHOTON_SHARD_H
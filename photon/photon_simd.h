@@ -0,0 +1,220 @@
+#ifndef PHOTON_SIMD_H
+#define PHOTON_SIMD_H
+
+#include "photon_math.h"
+
+#include <cstdint>
+
+// Thin wrappers over AVX-512 / AVX2 registers for the packet tracer. PHOTON_LANES is the
+// packet width; it is left undefined when neither instruction set is enabled at compile time
+// and the engine then uses the scalar path only.
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__)
+
+#define PHOTON_LANES 16
+
+struct vfloat { __m512 v; };
+struct vint { __m512i v; };
+struct vmask { __mmask16 m; };
+
+inline vfloat vset(float f) { vfloat r = { _mm512_set1_ps(f) }; return r; }
+inline vint vseti(int32_t i) { vint r = { _mm512_set1_epi32(i) }; return r; }
+inline vfloat vload(const float* p) { vfloat r = { _mm512_load_ps(p) }; return r; }
+inline vint vloadi(const int32_t* p) { vint r = { _mm512_load_si512(p) }; return r; }
+inline void vstore(float* p, vfloat a) { _mm512_store_ps(p, a.v); }
+inline void vstorei(int32_t* p, vint a) { _mm512_store_si512(p, a.v); }
+
+inline vfloat operator+(vfloat a, vfloat b) { vfloat r = { _mm512_add_ps(a.v, b.v) }; return r; }
+inline vfloat operator-(vfloat a, vfloat b) { vfloat r = { _mm512_sub_ps(a.v, b.v) }; return r; }
+inline vfloat operator*(vfloat a, vfloat b) { vfloat r = { _mm512_mul_ps(a.v, b.v) }; return r; }
+inline vfloat operator/(vfloat a, vfloat b) { vfloat r = { _mm512_div_ps(a.v, b.v) }; return r; }
+inline vfloat vsqrt(vfloat a) { vfloat r = { _mm512_sqrt_ps(a.v) }; return r; }
+inline vfloat vmin(vfloat a, vfloat b) { vfloat r = { _mm512_min_ps(a.v, b.v) }; return r; }
+
+inline vmask operator<(vfloat a, vfloat b) { vmask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; return r; }
+inline vmask operator<=(vfloat a, vfloat b) { vmask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; return r; }
+inline vmask operator>(vfloat a, vfloat b) { vmask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; return r; }
+inline vmask operator>=(vfloat a, vfloat b) { vmask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; return r; }
+inline vmask operator==(vint a, vint b) { vmask r = { _mm512_cmpeq_epi32_mask(a.v, b.v) }; return r; }
+
+inline vmask operator&(vmask a, vmask b) { vmask r = { static_cast<__mmask16>(a.m & b.m) }; return r; }
+inline vmask operator|(vmask a, vmask b) { vmask r = { static_cast<__mmask16>(a.m | b.m) }; return r; }
+inline vmask andNot(vmask a, vmask b) { vmask r = { static_cast<__mmask16>(a.m & ~b.m) }; return r; } // a & !b
+inline int maskBits(vmask a) { return a.m; }
+
+inline vfloat select(vmask m, vfloat a, vfloat b) { vfloat r = { _mm512_mask_blend_ps(m.m, b.v, a.v) }; return r; }
+inline vint select(vmask m, vint a, vint b) { vint r = { _mm512_mask_blend_epi32(m.m, b.v, a.v) }; return r; }
+
+inline vint operator+(vint a, vint b) { vint r = { _mm512_add_epi32(a.v, b.v) }; return r; }
+inline vint operator-(vint a, vint b) { vint r = { _mm512_sub_epi32(a.v, b.v) }; return r; }
+inline vint operator&(vint a, vint b) { vint r = { _mm512_and_si512(a.v, b.v) }; return r; }
+inline vint operator|(vint a, vint b) { vint r = { _mm512_or_si512(a.v, b.v) }; return r; }
+inline vint operator^(vint a, vint b) { vint r = { _mm512_xor_si512(a.v, b.v) }; return r; }
+inline vint srli(vint a, int n) { vint r = { _mm512_srli_epi32(a.v, n) }; return r; }
+inline vint truncInt(vfloat a) { vint r = { _mm512_cvttps_epi32(a.v) }; return r; }
+inline vfloat toFloat(vint a) { vfloat r = { _mm512_cvtepi32_ps(a.v) }; return r; }
+inline vfloat asFloat(vint a) { vfloat r = { _mm512_castsi512_ps(a.v) }; return r; }
+inline vint asInt(vfloat a) { vint r = { _mm512_castps_si512(a.v) }; return r; }
+
+// 32x32 -> 64 bit products of every lane, split into high and low halves
+inline void mulHiLo(vint a, uint32_t b, vint& hi, vint& lo) {
+    __m512i vb = _mm512_set1_epi32(static_cast<int32_t>(b));
+    __m512i even = _mm512_mul_epu32(a.v, vb);
+    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a.v, 32), vb);
+    lo.v = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+    hi.v = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+}
+
+#elif defined(__AVX2__)
+
+#define PHOTON_LANES 8
+
+struct vfloat { __m256 v; };
+struct vint { __m256i v; };
+struct vmask { __m256 m; };
+
+inline vfloat vset(float f) { vfloat r = { _mm256_set1_ps(f) }; return r; }
+inline vint vseti(int32_t i) { vint r = { _mm256_set1_epi32(i) }; return r; }
+inline vfloat vload(const float* p) { vfloat r = { _mm256_load_ps(p) }; return r; }
+inline vint vloadi(const int32_t* p) { vint r = { _mm256_load_si256(reinterpret_cast<const __m256i*>(p)) }; return r; }
+inline void vstore(float* p, vfloat a) { _mm256_store_ps(p, a.v); }
+inline void vstorei(int32_t* p, vint a) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), a.v); }
+
+inline vfloat operator+(vfloat a, vfloat b) { vfloat r = { _mm256_add_ps(a.v, b.v) }; return r; }
+inline vfloat operator-(vfloat a, vfloat b) { vfloat r = { _mm256_sub_ps(a.v, b.v) }; return r; }
+inline vfloat operator*(vfloat a, vfloat b) { vfloat r = { _mm256_mul_ps(a.v, b.v) }; return r; }
+inline vfloat operator/(vfloat a, vfloat b) { vfloat r = { _mm256_div_ps(a.v, b.v) }; return r; }
+inline vfloat vsqrt(vfloat a) { vfloat r = { _mm256_sqrt_ps(a.v) }; return r; }
+inline vfloat vmin(vfloat a, vfloat b) { vfloat r = { _mm256_min_ps(a.v, b.v) }; return r; }
+
+inline vmask operator<(vfloat a, vfloat b) { vmask r = { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; return r; }
+inline vmask operator<=(vfloat a, vfloat b) { vmask r = { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; return r; }
+inline vmask operator>(vfloat a, vfloat b) { vmask r = { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; return r; }
+inline vmask operator>=(vfloat a, vfloat b) { vmask r = { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; return r; }
+inline vmask operator==(vint a, vint b) { vmask r = { _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)) }; return r; }
+
+inline vmask operator&(vmask a, vmask b) { vmask r = { _mm256_and_ps(a.m, b.m) }; return r; }
+inline vmask operator|(vmask a, vmask b) { vmask r = { _mm256_or_ps(a.m, b.m) }; return r; }
+inline vmask andNot(vmask a, vmask b) { vmask r = { _mm256_andnot_ps(b.m, a.m) }; return r; } // a & !b
+inline int maskBits(vmask a) { return _mm256_movemask_ps(a.m); }
+
+inline vfloat select(vmask m, vfloat a, vfloat b) { vfloat r = { _mm256_blendv_ps(b.v, a.v, m.m) }; return r; }
+inline vint select(vmask m, vint a, vint b) {
+    vint r = { _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.m)) };
+    return r;
+}
+
+inline vint operator+(vint a, vint b) { vint r = { _mm256_add_epi32(a.v, b.v) }; return r; }
+inline vint operator-(vint a, vint b) { vint r = { _mm256_sub_epi32(a.v, b.v) }; return r; }
+inline vint operator&(vint a, vint b) { vint r = { _mm256_and_si256(a.v, b.v) }; return r; }
+inline vint operator|(vint a, vint b) { vint r = { _mm256_or_si256(a.v, b.v) }; return r; }
+inline vint operator^(vint a, vint b) { vint r = { _mm256_xor_si256(a.v, b.v) }; return r; }
+inline vint srli(vint a, int n) { vint r = { _mm256_srli_epi32(a.v, n) }; return r; }
+inline vint truncInt(vfloat a) { vint r = { _mm256_cvttps_epi32(a.v) }; return r; }
+inline vfloat toFloat(vint a) { vfloat r = { _mm256_cvtepi32_ps(a.v) }; return r; }
+inline vfloat asFloat(vint a) { vfloat r = { _mm256_castsi256_ps(a.v) }; return r; }
+inline vint asInt(vfloat a) { vint r = { _mm256_castps_si256(a.v) }; return r; }
+
+// 32x32 -> 64 bit products of every lane, split into high and low halves
+inline void mulHiLo(vint a, uint32_t b, vint& hi, vint& lo) {
+    __m256i vb = _mm256_set1_epi32(static_cast<int32_t>(b));
+    __m256i even = _mm256_mul_epu32(a.v, vb);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a.v, 32), vb);
+    lo.v = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    hi.v = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+#endif
+
+#ifdef PHOTON_LANES
+
+// Flips the sign bit, like scalar negation (0 - a would turn -0 into +0)
+inline vfloat operator-(vfloat a) { return asFloat(asInt(a) ^ vseti(static_cast<int32_t>(0x80000000))); }
+
+// Philox4x32-10 on every lane, matching philox4x32() in photon_rng.h
+inline void vphilox4x32(vint c[4], uint32_t k0, uint32_t k1) {
+    for (int round = 0; round < 10; ++round) {
+        vint hi0, lo0, hi1, lo1;
+        mulHiLo(c[0], 0xD2511F53u, hi0, lo0);
+        mulHiLo(c[2], 0xCD9E8D57u, hi1, lo1);
+        vint n0 = hi1 ^ c[1] ^ vseti(static_cast<int32_t>(k0));
+        vint n2 = hi0 ^ c[3] ^ vseti(static_cast<int32_t>(k1));
+        c[0] = n0;
+        c[1] = lo1;
+        c[2] = n2;
+        c[3] = lo0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+inline vfloat vuniformFloat(vint bits) {
+    return toFloat(srli(bits, 8)) * vset(1.0f / 16777216.0f);
+}
+
+inline vfloat vuniformOpenFloat(vint bits) {
+    return toFloat(srli(bits, 8) + vseti(1)) * vset(1.0f / 16777216.0f);
+}
+
+// Lane-wise photonLog()
+inline vfloat vlog(vfloat x) {
+    vint bits = asInt(x);
+    vint e = (srli(bits, 23) & vseti(0xff)) - vseti(126);
+    vfloat m = asFloat((bits & vseti(static_cast<int32_t>(0x807fffff))) | vseti(0x3f000000));
+
+    vmask small = m < vset(PHOTON_SQRTHF);
+    e = select(small, e - vseti(1), e);
+    m = select(small, m + m - vset(1.0f), m - vset(1.0f));
+
+    vfloat z = m * m;
+    vfloat y = vset(7.0376836292E-2f);
+    y = y * m - vset(1.1514610310E-1f);
+    y = y * m + vset(1.1676998740E-1f);
+    y = y * m - vset(1.2420140846E-1f);
+    y = y * m + vset(1.4249322787E-1f);
+    y = y * m - vset(1.6668057665E-1f);
+    y = y * m + vset(2.0000714765E-1f);
+    y = y * m - vset(2.4999993993E-1f);
+    y = y * m + vset(3.3333331174E-1f);
+    y = y * m * z;
+
+    vfloat fe = toFloat(e);
+    y = y + vset(-2.12194440e-4f) * fe;
+    y = y + vset(-0.5f) * z;
+    return m + y + vset(0.693359375f) * fe;
+}
+
+// Lane-wise photonSinCos2Pi()
+inline void vsincos2pi(vfloat u, vfloat& s, vfloat& c) {
+    vint q = truncInt(u * vset(4.0f) + vset(0.5f));
+    vfloat r = u - toFloat(q) * vset(0.25f);
+    vfloat x = r * vset(PHOTON_TWO_PI);
+    vfloat x2 = x * x;
+
+    vfloat ps = vset(-1.9515295891E-4f);
+    ps = ps * x2 + vset(8.3321608736E-3f);
+    ps = ps * x2 - vset(1.6666654611E-1f);
+    ps = ps * x2 * x + x;
+
+    vfloat pc = vset(2.443315711809948E-5f);
+    pc = pc * x2 - vset(1.388731625493765E-3f);
+    pc = pc * x2 + vset(4.166664568298827E-2f);
+    pc = pc * x2 * x2 - vset(0.5f) * x2 + vset(1.0f);
+
+    vint quadrant = q & vseti(3);
+    vmask swap = (quadrant & vseti(1)) == vseti(1);
+    vmask negSin = (quadrant & vseti(2)) == vseti(2);
+    vmask negCos = (quadrant == vseti(1)) | (quadrant == vseti(2));
+    vfloat sinv = select(swap, pc, ps);
+    vfloat cosv = select(swap, ps, pc);
+    s = select(negSin, -sinv, sinv);
+    c = select(negCos, -cosv, cosv);
+}
+
+#endif // PHOTON_LANES
+
+#endif // PHOTON_SIMD_H
@@ -0,0 +1,313 @@
+#include "photon_spectral.h"
+#include "photon_qmc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+// Per-path weight of a band in log form: logRatio * scatters - excess * pathLength
+struct BandCoefficients {
+    float logRatio; // log(mu_s,b / mu_s,ref)
+    float excess; // mu_s,b + mu_a,b - mu_s,ref
+};
+
+static bool parsePositive(const std::string& token, float& value) {
+    char* endPtr;
+    value = std::strtof(token.c_str(), &endPtr);
+    return *endPtr == '\0' && value > 0.0f && std::isfinite(value);
+}
+
+bool loadSpectralSetup(const std::string& path, SpectralSetup& setup, std::string& error) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        error = "cannot read " + path;
+        return false;
+    }
+
+    SpectralSetup loaded;
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind)) continue;
+        std::ostringstream where;
+        where << path << ":" << number << ": ";
+        std::vector<std::string> tokens;
+        std::string token;
+        while (fields >> token) tokens.push_back(token);
+
+        if (kind == "band") {
+            SpectralBand band;
+            if (tokens.size() != 3 || !parsePositive(tokens[0], band.wavelength) ||
+                !parsePositive(tokens[1], band.meanFreePath) || !parsePositive(tokens[2], band.absorptionLength)) {
+                error = where.str() + "expected band <wavelength> <meanFreePath> <absorptionLength>, all positive";
+                return false;
+            }
+            if (!loaded.emitters.empty()) {
+                error = where.str() + "bands must come before the emitters";
+                return false;
+            }
+            loaded.bands.push_back(band);
+        } else if (kind == "emitter") {
+            SpectralEmitter emitter;
+            char extra;
+            if (tokens.size() < 2 || std::sscanf(tokens[0].c_str(), "%f,%f%c", &emitter.x, &emitter.y, &extra) != 2) {
+                error = where.str() + "expected emitter x,y <power> <share per band ...>";
+                return false;
+            }
+            char* endPtr;
+            emitter.power = std::strtof(tokens[1].c_str(), &endPtr);
+            if (*endPtr != '\0' || !(emitter.power >= 0.0f)) {
+                error = where.str() + "power must be a number >= 0";
+                return false;
+            }
+            if (tokens.size() - 2 != loaded.bands.size()) {
+                error = where.str() + "expected one share per band (" + std::to_string(loaded.bands.size()) + ")";
+                return false;
+            }
+            float total = 0.0f;
+            for (size_t i = 2; i < tokens.size(); ++i) {
+                float share = std::strtof(tokens[i].c_str(), &endPtr);
+                if (*endPtr != '\0' || !(share >= 0.0f)) {
+                    error = where.str() + "bad share '" + tokens[i] + "', expected a number >= 0";
+                    return false;
+                }
+                emitter.spectrum.push_back(share);
+                total += share;
+            }
+            if (!(total > 0.0f)) {
+                error = where.str() + "an emitter needs a positive share in some band";
+                return false;
+            }
+            for (float& share : emitter.spectrum) share /= total;
+            loaded.emitters.push_back(emitter);
+        } else if (kind == "reference") {
+            if (tokens.size() != 1 || !parsePositive(tokens[0], loaded.referenceMeanFreePath)) {
+                error = where.str() + "expected reference <meanFreePath>";
+                return false;
+            }
+        } else {
+            error = where.str() + "unknown line '" + kind + "', expected band, emitter or reference";
+            return false;
+        }
+    }
+
+    if (loaded.bands.empty() || loaded.emitters.empty()) {
+        error = path + ": needs at least one band and one emitter";
+        return false;
+    }
+    setup = loaded;
+    return true;
+}
+
+// Trace photons [first, first + count) from white.emitter into parts: one per band, then the
+// spectrum mix
+static void traceSpectralRange(const TransportConfig& white, const SensorIndex& sensors,
+                               const std::vector<BandCoefficients>& coefficients, const std::vector<float>& spectrum,
+                               uint64_t first, uint64_t count, std::vector<BatchResult>& parts) {
+    size_t bandCount = coefficients.size();
+    for (BatchResult& part : parts) prepareBatchResult(part, white, sensors.size());
+
+    StepVariates variates;
+    bool sobol = white.sampling == SAMPLING_SOBOL;
+    SobolSampler sampler(white.seed);
+    const float logThreshold = std::log(white.rouletteThreshold);
+    std::vector<float> weights(bandCount);
+    for (uint64_t n = first; n < first + count; ++n) {
+        PhotonState photon = emitPhoton(white, n);
+        float survival = 1.0f; // Roulette factor shared by the bands
+        uint64_t steps = 0;
+        while (photon.fate == PHOTON_ACTIVE) {
+            uint32_t step = static_cast<uint32_t>(photon.scatters);
+            if (!variates.holds(n, step)) {
+                fillStepVariates(variates, white.seed, n, step);
+                if (sobol && step < SOBOL_STEPS) applySobolDraws(variates, sampler);
+            }
+            StepDraws draws = variates.draws(step);
+            stepPhoton(photon, white, sensors, draws);
+            steps++;
+
+            // Roulette once every band has faded, after a scatter: the analog transport leaves the
+            // roulette draw of the step unused, and reflections (which keep the step) never play
+            if (photon.fate == PHOTON_ACTIVE && photon.flight == 0.0f) {
+                float k = static_cast<float>(photon.scatters);
+                float best = -std::numeric_limits<float>::infinity();
+                for (const BandCoefficients& c : coefficients) {
+                    best = std::max(best, c.logRatio * k - c.excess * photon.pathLength);
+                }
+                if (best + std::log(survival) < logThreshold) {
+                    if (draws.roulette < white.rouletteSurvival) {
+                        survival /= white.rouletteSurvival;
+                    } else {
+                        photon.fate = PHOTON_ABSORBED;
+                    }
+                }
+            }
+        }
+
+        float mixedWeight = 0.0f;
+        for (size_t b = 0; b < bandCount; ++b) {
+            const BandCoefficients& c = coefficients[b];
+            weights[b] = photon.fate == PHOTON_ABSORBED ? 0.0f
+                       : survival * std::exp(c.logRatio * photon.scatters - c.excess * photon.pathLength);
+            mixedWeight += spectrum[b] * weights[b];
+        }
+        for (size_t i = 0; i <= bandCount; ++i) {
+            float weight = i < bandCount ? weights[i] : mixedWeight;
+            tallyPhoton(parts[i], photon.fate, photon.sensor, weight);
+            if (white.timeBins > 0 && photon.fate == PHOTON_SENSOR) {
+                tallyArrival(parts[i], white, photon.sensor, photon.pathLength, weight);
+            }
+            parts[i].steps += steps;
+        }
+    }
+    for (BatchResult& part : parts) part.photons += count;
+}
+
+SpectralResult traceSpectral(const TransportConfig& config, const SpectralSetup& setup, const SensorIndex& sensors,
+                             uint64_t photonsPerEmitter, unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t bandCount = setup.bands.size();
+    size_t emitterCount = setup.emitters.size();
+
+    SpectralResult result;
+    result.referenceMeanFreePath = setup.referenceMeanFreePath;
+    if (!(result.referenceMeanFreePath > 0.0f)) {
+        double logSum = 0.0;
+        for (const SpectralBand& band : setup.bands) logSum += std::log(band.meanFreePath);
+        result.referenceMeanFreePath = static_cast<float>(std::exp(logSum / std::max<size_t>(bandCount, 1)));
+    }
+    float referenceScatter = 1.0f / result.referenceMeanFreePath;
+    std::vector<BandCoefficients> coefficients;
+    for (const SpectralBand& band : setup.bands) {
+        float scatter = 1.0f / band.meanFreePath;
+        coefficients.push_back(BandCoefficients{ std::log(scatter / referenceScatter),
+                                                 scatter + 1.0f / band.absorptionLength - referenceScatter });
+    }
+
+    // The shared paths: scattering at the reference length, no absorption in the medium. The
+    // analog transport then never absorbs, since the absorption distance is infinite.
+    std::vector<TransportConfig> whites(emitterCount, config);
+    for (size_t e = 0; e < emitterCount; ++e) {
+        whites[e].mode = TRANSPORT_ANALOG;
+        whites[e].meanFreePath = result.referenceMeanFreePath;
+        whites[e].absorptionLength = std::numeric_limits<float>::infinity();
+        whites[e].emitterX = setup.emitters[e].x;
+        whites[e].emitterY = setup.emitters[e].y;
+        whites[e].fluenceCellsX = 0;
+        whites[e].fluenceCellsY = 0;
+    }
+
+    // Tallies of emitter e are mergers[e * (bandCount + 1) + i], the mix last
+    std::vector<std::unique_ptr<ChunkMerger>> mergers;
+    for (size_t i = 0; i < emitterCount * (bandCount + 1); ++i) {
+        mergers.emplace_back(new ChunkMerger(sensors.size()));
+    }
+
+    // Every emitter's chunks go into one queue, as in runSweep()
+    uint64_t chunksPerEmitter = (photonsPerEmitter + PHOTON_CHUNK - 1) / PHOTON_CHUNK;
+    uint64_t taskCount = chunksPerEmitter * emitterCount;
+    std::atomic<uint64_t> nextTask(0);
+    auto worker = [&]() {
+        std::vector<BatchResult> parts(bandCount + 1);
+        for (uint64_t task = nextTask++; task < taskCount; task = nextTask++) {
+            size_t e = static_cast<size_t>(task / chunksPerEmitter);
+            uint64_t chunk = task % chunksPerEmitter;
+            uint64_t offset = chunk * PHOTON_CHUNK;
+            uint64_t count = std::min<uint64_t>(PHOTON_CHUNK, photonsPerEmitter - offset);
+            for (BatchResult& part : parts) initBatchResult(part, sensors.size());
+            traceSpectralRange(whites[e], sensors, coefficients, setup.emitters[e].spectrum,
+                               e * photonsPerEmitter + offset, count, parts);
+            for (size_t i = 0; i <= bandCount; ++i) {
+                mergers[e * (bandCount + 1) + i]->add(chunk, parts[i]);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    for (size_t e = 0; e < emitterCount; ++e) {
+        for (size_t i = 0; i <= bandCount; ++i) {
+            BatchResult& tallies = mergers[e * (bandCount + 1) + i]->result;
+            tallies.firstPhoton = e * photonsPerEmitter;
+            if (i < bandCount) {
+                result.bands.push_back(std::move(tallies));
+            } else {
+                result.mixed.push_back(std::move(tallies));
+            }
+        }
+    }
+    return result;
+}
+
+static std::string formatNumber(float value) {
+    std::ostringstream text;
+    text << value;
+    return text.str();
+}
+
+void writeSpectralTable(std::ostream& out, const SpectralSetup& setup, const SpectralResult& result,
+                        const SensorCenters& layout) {
+    size_t bandCount = setup.bands.size();
+    size_t emitterCount = setup.emitters.size();
+
+    out << "emitter\tband\twavelength\tsensor\tx\ty\tphotons\tfraction\tstdError\n";
+    auto row = [&](const std::string& emitter, const std::string& band, const std::string& wavelength, size_t sensor,
+                   uint64_t photons, double fraction, double stdError) {
+        out << emitter << "\t" << band << "\t" << wavelength << "\t" << sensor << "\t" << layout[sensor].first << "\t"
+            << layout[sensor].second << "\t" << photons << "\t" << fraction << "\t" << stdError << "\n";
+    };
+
+    // Emitters are traced independently, so their variances add
+    uint64_t totalPhotons = 0;
+    for (const BatchResult& tallies : result.mixed) totalPhotons += tallies.photons;
+    for (size_t s = 0; s < layout.size(); ++s) {
+        for (size_t e = 0; e < emitterCount; ++e) {
+            for (size_t b = 0; b < bandCount; ++b) {
+                const BatchResult& tallies = result.bands[e * bandCount + b];
+                SensorEstimate estimate = sensorEstimate(tallies, s);
+                row(std::to_string(e), std::to_string(b), formatNumber(setup.bands[b].wavelength), s,
+                    tallies.photons, estimate.mean, estimate.stdError);
+            }
+            SensorEstimate estimate = sensorEstimate(result.mixed[e], s);
+            row(std::to_string(e), "all", "", s, result.mixed[e].photons, estimate.mean, estimate.stdError);
+        }
+        // Signal of all sources, by band and in total, in units of one unit-power emitter's photons
+        for (size_t b = 0; b < bandCount; ++b) {
+            double mean = 0.0, variance = 0.0;
+            for (size_t e = 0; e < emitterCount; ++e) {
+                double scale = setup.emitters[e].power * setup.emitters[e].spectrum[b];
+                SensorEstimate estimate = sensorEstimate(result.bands[e * bandCount + b], s);
+                mean += scale * estimate.mean;
+                variance += scale * scale * estimate.stdError * estimate.stdError;
+            }
+            row("all", std::to_string(b), formatNumber(setup.bands[b].wavelength), s, totalPhotons, mean,
+                std::sqrt(variance));
+        }
+        double mean = 0.0, variance = 0.0;
+        for (size_t e = 0; e < emitterCount; ++e) {
+            double scale = setup.emitters[e].power;
+            SensorEstimate estimate = sensorEstimate(result.mixed[e], s);
+            mean += scale * estimate.mean;
+            variance += scale * scale * estimate.stdError * estimate.stdError;
+        }
+        row("all", "all", "", s, totalPhotons, mean, std::sqrt(variance));
+    }
+}
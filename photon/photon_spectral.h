@@ -0,0 +1,65 @@
+#ifndef PHOTON_SPECTRAL_H
+#define PHOTON_SPECTRAL_H
+
+#include "photon_transport.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Optical properties of the medium in one wavelength band
+struct SpectralBand {
+    float wavelength; // Nanometers, a label for the tables
+    float meanFreePath;
+    float absorptionLength;
+};
+
+// A source in the 2D box and how its photons spread over the bands
+struct SpectralEmitter {
+    float x;
+    float y;
+    float power; // Relative photon output, for the combined signal
+    std::vector<float> spectrum; // Share of the emitter's photons in each band, summing to 1
+};
+
+struct SpectralSetup {
+    std::vector<SpectralBand> bands;
+    std::vector<SpectralEmitter> emitters;
+    float referenceMeanFreePath; // Scattering length the paths are sampled with, 0 = geometric mean of the bands
+
+    SpectralSetup() : referenceMeanFreePath(0.0f) {}
+};
+
+// Tallies of a spectral run. Counts (hits, wall losses, steps) are of the traced paths, which
+// every band shares; the weights carry each band's physics.
+struct SpectralResult {
+    std::vector<BatchResult> bands; // Emitter-major: bands[e * bandCount + b]
+    std::vector<BatchResult> mixed; // Per emitter, the bands weighted by its spectrum
+    float referenceMeanFreePath;
+};
+
+// Read a spectral setup. Lines are "band <wavelength> <meanFreePath> <absorptionLength>",
+// "emitter x,y <power> <share per band ...>" after all bands, and "reference <meanFreePath>";
+// # starts a comment. Shares are normalised to sum to 1.
+bool loadSpectralSetup(const std::string& path, SpectralSetup& setup, std::string& error);
+
+// Trace photonsPerEmitter photons from every emitter against sensors in one pass, tallying every
+// band from each path. Paths are sampled with the reference scattering length and no absorption;
+// band b then weighs a path of k scatters and length L by its likelihood ratio and survival,
+//   (mu_s,b / mu_s,ref)^k * exp(-(mu_s,b + mu_a,b - mu_s,ref) * L),
+// so the sensor, wall and scene queries of a path serve all bands, and the band estimates are
+// unbiased for the same physics as traceBatch(). Russian roulette ends a path once every band's
+// weight is below config.rouletteThreshold. The other fields of config (box, scene, sensors'
+// radius, phase function, sampling, time bins) apply to every band; emitter e traces the photon
+// streams [e * photonsPerEmitter, (e + 1) * photonsPerEmitter). Uses the scalar kernel; the
+// result does not depend on the thread count.
+SpectralResult traceSpectral(const TransportConfig& config, const SpectralSetup& setup, const SensorIndex& sensors,
+                             uint64_t photonsPerEmitter, unsigned threads = 0);
+
+// Tab-separated table, one row per emitter, band and sensor with the detected fraction of the
+// emitter's photons in that band and its standard error. Band "all" rows weigh the bands by the
+// emitter's spectrum; emitter "all" rows add the emitters by power.
+void writeSpectralTable(std::ostream& out, const SpectralSetup& setup, const SpectralResult& result,
+                        const SensorCenters& layout);
+
+#endif // PHOTON_SPECTRAL_H
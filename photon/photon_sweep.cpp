@@ -0,0 +1,125 @@
+#include "photon_sweep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+bool setSweepParameter(TransportConfig& config, const std::string& name, float value) {
+    if (name == "meanFreePath") config.meanFreePath = value;
+    else if (name == "absorptionLength") config.absorptionLength = value;
+    else if (name == "emitterX") config.emitterX = value;
+    else if (name == "emitterY") config.emitterY = value;
+    else if (name == "sensorRadius") config.sensorRadius = value;
+    else if (name == "anisotropy") setPhaseFunction(config, PHASE_HENYEY_GREENSTEIN, value);
+    else return false;
+    return true;
+}
+
+bool sweepGrid(const TransportConfig& base, const std::vector<std::pair<std::string, std::vector<float>>>& axes,
+               std::vector<TransportConfig>& points, std::string& error) {
+    points.assign(1, base);
+    for (const auto& axis : axes) {
+        std::vector<TransportConfig> expanded;
+        for (const auto& point : points) {
+            for (float value : axis.second) {
+                TransportConfig config = point;
+                setSweepParameter(config, axis.first, value);
+                expanded.push_back(config);
+            }
+        }
+        points.swap(expanded);
+    }
+    for (size_t p = 0; p < points.size(); ++p) {
+        if (!checkTransportConfig(points[p], error)) {
+            const TransportConfig& c = points[p];
+            std::ostringstream where;
+            where << "sweep point " << p << " (meanFreePath " << c.meanFreePath << ", absorptionLength "
+                  << c.absorptionLength << ", emitter " << c.emitterX << "," << c.emitterY << ", sensorRadius "
+                  << c.sensorRadius << ", anisotropy " << c.anisotropy << "): " << error;
+            error = where.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<SweepResult> runSweep(const std::vector<TransportConfig>& points, const SensorCenters& layout,
+                                  uint64_t photonsPerPoint, unsigned threads, TraceKernel kernel) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The sensor radius may differ between points, so each point gets its own index
+    std::vector<SensorIndex> indices;
+    std::vector<std::unique_ptr<ChunkMerger>> mergers;
+    std::vector<std::atomic<int64_t>> nanoseconds(points.size());
+    for (size_t p = 0; p < points.size(); ++p) {
+        indices.push_back(buildSensorIndex(layout, points[p].sensorRadius));
+        mergers.emplace_back(new ChunkMerger(layout.size()));
+        nanoseconds[p] = 0;
+    }
+
+    uint64_t chunksPerPoint = (photonsPerPoint + PHOTON_CHUNK - 1) / PHOTON_CHUNK;
+    uint64_t taskCount = chunksPerPoint * points.size();
+    std::atomic<uint64_t> nextTask(0);
+
+    auto worker = [&]() {
+        for (uint64_t task = nextTask++; task < taskCount; task = nextTask++) {
+            size_t p = static_cast<size_t>(task / chunksPerPoint);
+            uint64_t chunk = task % chunksPerPoint;
+            uint64_t first = chunk * PHOTON_CHUNK;
+            uint64_t count = std::min<uint64_t>(PHOTON_CHUNK, photonsPerPoint - first);
+
+            auto start = std::chrono::steady_clock::now();
+            BatchResult part;
+            initBatchResult(part, layout.size());
+            traceRange(points[p], indices[p], first, count, kernel, part);
+            mergers[p]->add(chunk, part);
+            nanoseconds[p] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    std::vector<SweepResult> results(points.size());
+    for (size_t p = 0; p < points.size(); ++p) {
+        results[p].config = points[p];
+        results[p].tallies = std::move(mergers[p]->result);
+        results[p].seconds = nanoseconds[p] * 1e-9;
+    }
+    return results;
+}
+
+void writeSweepTable(std::ostream& out, const std::vector<SweepResult>& results) {
+    size_t sensorCount = results.empty() ? 0 : results[0].tallies.sensorHits.size();
+
+    out << "point\tmeanFreePath\tabsorptionLength\temitterX\temitterY\tsensorRadius\tanisotropy"
+        << "\tphotons\tsteps\twall\tabsorbed\tseconds";
+    for (size_t i = 0; i < sensorCount; ++i) {
+        out << "\tsensor" << i;
+    }
+    out << "\n";
+
+    for (size_t p = 0; p < results.size(); ++p) {
+        const SweepResult& r = results[p];
+        out << p << "\t" << r.config.meanFreePath << "\t" << r.config.absorptionLength << "\t" << r.config.emitterX
+            << "\t" << r.config.emitterY << "\t" << r.config.sensorRadius << "\t" << r.config.anisotropy << "\t"
+            << r.tallies.photons << "\t" << r.tallies.steps << "\t" << r.tallies.wallLosses << "\t"
+            << r.tallies.absorbed << "\t" << r.seconds;
+        for (size_t i = 0; i < sensorCount; ++i) {
+            out << "\t" << sensorEstimate(r.tallies, i).mean;
+        }
+        out << "\n";
+    }
+}
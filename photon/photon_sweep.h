@@ -0,0 +1,36 @@
+#ifndef PHOTON_SWEEP_H
+#define PHOTON_SWEEP_H
+
+#include "photon_transport.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// One traced configuration of a parameter sweep
+struct SweepResult {
+    TransportConfig config;
+    BatchResult tallies;
+    double seconds; // Worker time spent on this point, summed over threads
+};
+
+// Set a sweepable parameter by name (meanFreePath, absorptionLength, emitterX, emitterY,
+// sensorRadius, anisotropy; the last selects Henyey-Greenstein scattering); false for an unknown name
+bool setSweepParameter(TransportConfig& config, const std::string& name, float value);
+
+// Every combination of the listed values, applied on top of base, into points. False when a
+// combination fails checkTransportConfig(); error then names the point and the reason.
+bool sweepGrid(const TransportConfig& base, const std::vector<std::pair<std::string, std::vector<float>>>& axes,
+               std::vector<TransportConfig>& points, std::string& error);
+
+// Trace photonsPerPoint photons for every configuration against the same sensor layout.
+// All points are cut into PHOTON_CHUNK tasks that the threads pull from one queue, so cheap and
+// expensive points share the cores until the whole sweep is done. Per-point results are
+// identical to traceBatch() with the same configuration.
+std::vector<SweepResult> runSweep(const std::vector<TransportConfig>& points, const SensorCenters& layout,
+                                  uint64_t photonsPerPoint, unsigned threads = 0, TraceKernel kernel = TRACE_PACKET);
+
+// Tab-separated table: one row per point with its parameters, tallies and per-sensor fractions
+void writeSweepTable(std::ostream& out, const std::vector<SweepResult>& results);
+
+#endif // PHOTON_SWEEP_H
@@ -0,0 +1,376 @@
+#include "photon_trail_renderer.h"
+#include "photon_gl_program.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Vertex shader: world coordinates in meters to normalized device coordinates
+static const char* trailVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec2 aPos;
+    uniform vec4 view; // left, right, bottom, top
+    void main() {
+        vec2 ndc = 2.0 * (aPos - view.xz) / (view.yw - view.xz) - 1.0;
+        gl_Position = vec4(ndc, 0.0, 1.0);
+    }
+)glsl";
+
+static const char* trailFragmentShaderSource = R"glsl(
+    #version 330 core
+    out vec4 FragColor;
+    uniform vec3 color;
+    void main() {
+        FragColor = vec4(color, 1.0);
+    }
+)glsl";
+
+// Vertex shader of the level-of-detail quad, with its texture coordinates
+static const char* densityVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec2 aPos;
+    layout (location = 1) in vec2 aCell;
+    uniform vec4 view; // left, right, bottom, top
+    out vec2 cell;
+    void main() {
+        vec2 ndc = 2.0 * (aPos - view.xz) / (view.yw - view.xz) - 1.0;
+        gl_Position = vec4(ndc, 0.0, 1.0);
+        cell = aCell;
+    }
+)glsl";
+
+// Lines of total length L dropped at random over an area A with width w cover 1 - exp(-L w / A)
+// of it; the mipmaps average L per texel, so the same holds at every zoom
+static const char* densityFragmentShaderSource = R"glsl(
+    #version 330 core
+    in vec2 cell;
+    out vec4 FragColor;
+    uniform sampler2D density;
+    uniform vec3 color;
+    uniform float coverageScale; // Line width over texel area
+    void main() {
+        float trail = texture(density, cell).r;
+        FragColor = vec4(color, 1.0 - exp(-coverageScale * trail));
+    }
+)glsl";
+
+// Walk the cells of a cellsX x cellsY grid with its corner at the origin along the segment
+// (Amanatides-Woo), calling visit(ix, iy, t0, t1) for the part of it in each cell
+template <typename Visit>
+static void walkCells(GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1, GLfloat cellWidth, GLfloat cellHeight,
+                      int cellsX, int cellsY, Visit visit) {
+    GLfloat dx = x1 - x0;
+    GLfloat dy = y1 - y0;
+    int ix = std::min(cellsX - 1, std::max(0, static_cast<int>(x0 / cellWidth)));
+    int iy = std::min(cellsY - 1, std::max(0, static_cast<int>(y0 / cellHeight)));
+    const GLfloat inf = std::numeric_limits<GLfloat>::infinity();
+    int stepX = dx > 0.0f ? 1 : -1;
+    int stepY = dy > 0.0f ? 1 : -1;
+    GLfloat tDeltaX = dx != 0.0f ? cellWidth / std::fabs(dx) : inf;
+    GLfloat tDeltaY = dy != 0.0f ? cellHeight / std::fabs(dy) : inf;
+    GLfloat tMaxX = dx != 0.0f ? ((ix + (dx > 0.0f)) * cellWidth - x0) / dx : inf;
+    GLfloat tMaxY = dy != 0.0f ? ((iy + (dy > 0.0f)) * cellHeight - y0) / dy : inf;
+
+    GLfloat t = 0.0f;
+    while (true) {
+        GLfloat next = std::min(1.0f, std::min(tMaxX, tMaxY));
+        visit(ix, iy, t, next);
+        t = next;
+        if (t >= 1.0f) break;
+        if (tMaxX < tMaxY) {
+            ix += stepX;
+            tMaxX += tDeltaX;
+        } else {
+            iy += stepY;
+            tMaxY += tDeltaY;
+        }
+        if (ix < 0 || ix >= cellsX || iy < 0 || iy >= cellsY) break; // Rounding at the wall
+    }
+}
+
+// Point the VAO at the current buffer
+static void bindTrailBuffer(TrailRenderer& trails) {
+    glBindVertexArray(trails.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, trails.vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool initTrailRenderer(TrailRenderer& trails, GLfloat width, GLfloat height, size_t initialChunks,
+                       size_t maxChunks) {
+    bool ok = true;
+    trails.program = buildProgram(trailVertexShaderSource, trailFragmentShaderSource, ok);
+    trails.viewLocation = glGetUniformLocation(trails.program, "view");
+    trails.colorLocation = glGetUniformLocation(trails.program, "color");
+    trails.densityProgram = buildProgram(densityVertexShaderSource, densityFragmentShaderSource, ok);
+    trails.densityViewLocation = glGetUniformLocation(trails.densityProgram, "view");
+    trails.densityColorLocation = glGetUniformLocation(trails.densityProgram, "color");
+    trails.densityScaleLocation = glGetUniformLocation(trails.densityProgram, "coverageScale");
+
+    // Whole tiles and texels over the box, so the last ones are not cut off
+    trails.width = width;
+    trails.height = height;
+    trails.tilesX = std::max(1, static_cast<int>(std::ceil(width / TRAIL_TILE_SIZE)));
+    trails.tilesY = std::max(1, static_cast<int>(std::ceil(height / TRAIL_TILE_SIZE)));
+    trails.tiles.assign(static_cast<size_t>(trails.tilesX) * trails.tilesY, TrailTile());
+    trails.dirtyTiles.clear();
+    trails.maxChunks = std::max<size_t>(maxChunks, 1);
+    trails.capacity = std::min(std::max<size_t>(initialChunks, 1), trails.maxChunks);
+    trails.chunksUsed = 0;
+    trails.oldestChunk = 0;
+    trails.chunkTiles.assign(trails.capacity, 0);
+    trails.uploaded.assign(trails.capacity * TRAIL_CHUNK_VERTICES * 2, 0.0f);
+    trails.densityX = std::max(1, static_cast<int>(std::ceil(width / TRAIL_DENSITY_CELL)));
+    trails.densityY = std::max(1, static_cast<int>(std::ceil(height / TRAIL_DENSITY_CELL)));
+    trails.density.assign(static_cast<size_t>(trails.densityX) * trails.densityY, 0.0f);
+    trails.densityDirty = false;
+    trails.drewDensity = false;
+
+    glGenVertexArrays(1, &trails.vao);
+    glGenBuffers(1, &trails.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, trails.vbo);
+    glBufferData(GL_ARRAY_BUFFER, trails.capacity * TRAIL_CHUNK_VERTICES * 2 * sizeof(GLfloat), NULL,
+                 GL_DYNAMIC_DRAW);
+    bindTrailBuffer(trails);
+
+    // Trilinear filtering over the mipmaps averages the trail length under each pixel
+    glGenTextures(1, &trails.densityTexture);
+    glBindTexture(GL_TEXTURE_2D, trails.densityTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, trails.densityX, trails.densityY, 0, GL_RED, GL_FLOAT,
+                 trails.density.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Triangle strip over the box: x, y, u, v per corner
+    GLfloat quad[16] = { 0.0f, 0.0f, 0.0f, 0.0f, width, 0.0f, 1.0f, 0.0f,
+                         0.0f, height, 0.0f, 1.0f, width, height, 1.0f, 1.0f };
+    glGenVertexArrays(1, &trails.densityVao);
+    glGenBuffers(1, &trails.densityVbo);
+    glBindVertexArray(trails.densityVao);
+    glBindBuffer(GL_ARRAY_BUFFER, trails.densityVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return ok;
+}
+
+// Add the length of a trail piece to the texels it crosses, or with sign -1 take it away again
+static void addDensity(TrailRenderer& trails, GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1, GLfloat sign) {
+    GLfloat dx = x1 - x0;
+    GLfloat dy = y1 - y0;
+    GLfloat length = sign * std::sqrt(dx * dx + dy * dy);
+    GLfloat texelWidth = trails.width / trails.densityX;
+    GLfloat texelHeight = trails.height / trails.densityY;
+    walkCells(x0, y0, x1, y1, texelWidth, texelHeight, trails.densityX, trails.densityY,
+              [&](int ix, int iy, GLfloat t0, GLfloat t1) {
+        GLfloat& texel = trails.density[static_cast<size_t>(iy) * trails.densityX + ix];
+        texel = std::max(0.0f, texel + (t1 - t0) * length); // Rounding must not leave a negative length
+    });
+    trails.densityDirty = true;
+}
+
+void addTrailSegment(TrailRenderer& trails, GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1) {
+    GLfloat dx = x1 - x0;
+    GLfloat dy = y1 - y0;
+
+    // One piece per tile crossed, so a long flight does not stretch a tile over the whole box
+    GLfloat tileWidth = trails.width / trails.tilesX;
+    GLfloat tileHeight = trails.height / trails.tilesY;
+    walkCells(x0, y0, x1, y1, tileWidth, tileHeight, trails.tilesX, trails.tilesY,
+              [&](int ix, int iy, GLfloat t0, GLfloat t1) {
+        if (t1 <= t0) return; // Through a corner
+        uint32_t index = static_cast<uint32_t>(iy * trails.tilesX + ix);
+        TrailTile& tile = trails.tiles[index];
+        if (tile.pending.empty()) trails.dirtyTiles.push_back(index);
+        // The texture gets the same pieces the blocks do, so a reused block takes away what it added
+        GLfloat px0 = t0 > 0.0f ? x0 + t0 * dx : x0;
+        GLfloat py0 = t0 > 0.0f ? y0 + t0 * dy : y0;
+        GLfloat px1 = t1 < 1.0f ? x0 + t1 * dx : x1;
+        GLfloat py1 = t1 < 1.0f ? y0 + t1 * dy : y1;
+        tile.pending.push_back(px0);
+        tile.pending.push_back(py0);
+        tile.pending.push_back(px1);
+        tile.pending.push_back(py1);
+        addDensity(trails, px0, py0, px1, py1, 1.0f);
+    });
+}
+
+// Make room for one more block, doubling the buffer (up to maxChunks) on the GPU side when it is full
+static void growBuffer(TrailRenderer& trails) {
+    if (trails.chunksUsed < trails.capacity) return;
+
+    size_t capacity = std::min(trails.capacity * 2, trails.maxChunks);
+    const size_t chunkBytes = TRAIL_CHUNK_VERTICES * 2 * sizeof(GLfloat);
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * chunkBytes, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, trails.vbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, trails.chunksUsed * chunkBytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &trails.vbo);
+    trails.vbo = vbo;
+    trails.capacity = capacity;
+    trails.chunkTiles.resize(capacity, 0);
+    trails.uploaded.resize(capacity * TRAIL_CHUNK_VERTICES * 2, 0.0f);
+    bindTrailBuffer(trails);
+}
+
+// Block for the next vertices of a tile: a new one while the buffer may grow, else the oldest
+// block in use. Blocks are handed out in buffer order and then reused in the same order, so the
+// oldest block is also the first of its tile.
+static GLint takeChunk(TrailRenderer& trails, uint32_t index) {
+    size_t chunk;
+    if (trails.chunksUsed < trails.maxChunks) {
+        growBuffer(trails);
+        chunk = trails.chunksUsed++;
+    } else {
+        chunk = trails.oldestChunk;
+        trails.oldestChunk = (chunk + 1) % trails.maxChunks;
+        TrailTile& owner = trails.tiles[trails.chunkTiles[chunk]];
+        size_t count = std::min<size_t>(owner.vertices, TRAIL_CHUNK_VERTICES); // Partly filled if it is the only one
+        const GLfloat* v = trails.uploaded.data() + chunk * TRAIL_CHUNK_VERTICES * 2;
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            addDensity(trails, v[2 * i], v[2 * i + 1], v[2 * i + 2], v[2 * i + 3], -1.0f);
+        }
+        owner.chunks.pop_front();
+        owner.vertices -= count;
+    }
+    trails.chunkTiles[chunk] = index;
+    return static_cast<GLint>(chunk * TRAIL_CHUNK_VERTICES);
+}
+
+// Append each dirty tile's staged vertices to its blocks, starting a new block when the last is full
+static void uploadPending(TrailRenderer& trails) {
+    for (uint32_t index : trails.dirtyTiles) {
+        TrailTile& tile = trails.tiles[index];
+        size_t count = tile.pending.size() / 2;
+        size_t done = 0;
+        while (done < count) {
+            size_t used = tile.vertices % TRAIL_CHUNK_VERTICES;
+            if (used == 0) {
+                tile.chunks.push_back(takeChunk(trails, index));
+            }
+            // Whole segments always fit, since blocks hold an even number of vertices
+            size_t n = std::min<size_t>(TRAIL_CHUNK_VERTICES - used, count - done);
+            glBindBuffer(GL_ARRAY_BUFFER, trails.vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, (tile.chunks.back() + used) * 2 * sizeof(GLfloat),
+                            n * 2 * sizeof(GLfloat), tile.pending.data() + done * 2);
+            std::copy(tile.pending.begin() + done * 2, tile.pending.begin() + (done + n) * 2,
+                      trails.uploaded.begin() + (tile.chunks.back() + used) * 2);
+            tile.vertices += n;
+            done += n;
+        }
+        tile.pending.clear();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    trails.dirtyTiles.clear();
+}
+
+static void drawDensity(TrailRenderer& trails, GLfloat left, GLfloat right, GLfloat bottom, GLfloat top,
+                        GLfloat pixelSize, GLfloat lineWidth, GLfloat r, GLfloat g, GLfloat b) {
+    glBindTexture(GL_TEXTURE_2D, trails.densityTexture);
+    if (trails.densityDirty) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, trails.densityX, trails.densityY, GL_RED, GL_FLOAT,
+                        trails.density.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        trails.densityDirty = false;
+    }
+
+    GLfloat texelArea = (trails.width / trails.densityX) * (trails.height / trails.densityY);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(trails.densityProgram);
+    glUniform4f(trails.densityViewLocation, left, right, bottom, top);
+    glUniform3f(trails.densityColorLocation, r, g, b);
+    glUniform1f(trails.densityScaleLocation, pixelSize * lineWidth / texelArea);
+    glBindVertexArray(trails.densityVao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (!blend) glDisable(GL_BLEND);
+}
+
+void drawTrails(TrailRenderer& trails, GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat pixelSize,
+                GLfloat lineWidth, GLfloat r, GLfloat g, GLfloat b) {
+    uploadPending(trails);
+    trails.drewDensity = false;
+    if (right < 0.0f || left > trails.width || top < 0.0f || bottom > trails.height) return;
+
+    // Tiles meeting the visible rectangle
+    GLfloat tileWidth = trails.width / trails.tilesX;
+    GLfloat tileHeight = trails.height / trails.tilesY;
+    int x0 = std::max(0, static_cast<int>(left / tileWidth));
+    int x1 = std::min(trails.tilesX - 1, static_cast<int>(right / tileWidth));
+    int y0 = std::max(0, static_cast<int>(bottom / tileHeight));
+    int y1 = std::min(trails.tilesY - 1, static_cast<int>(top / tileHeight));
+    size_t visible = 0;
+    for (int iy = y0; iy <= y1; ++iy) {
+        for (int ix = x0; ix <= x1; ++ix) {
+            visible += trails.tiles[static_cast<size_t>(iy) * trails.tilesX + ix].vertices;
+        }
+    }
+    if (visible == 0) return;
+
+    if (visible > TRAIL_LINE_BUDGET) {
+        drawDensity(trails, left, right, bottom, top, pixelSize, lineWidth, r, g, b);
+        trails.drewDensity = true;
+        return;
+    }
+
+    trails.drawFirst.clear();
+    trails.drawCount.clear();
+    for (int iy = y0; iy <= y1; ++iy) {
+        for (int ix = x0; ix <= x1; ++ix) {
+            const TrailTile& tile = trails.tiles[static_cast<size_t>(iy) * trails.tilesX + ix];
+            size_t remaining = tile.vertices;
+            for (size_t k = 0; k < tile.chunks.size(); ++k) {
+                size_t count = std::min<size_t>(remaining, TRAIL_CHUNK_VERTICES);
+                trails.drawFirst.push_back(tile.chunks[k]);
+                trails.drawCount.push_back(static_cast<GLsizei>(count));
+                remaining -= count;
+            }
+        }
+    }
+
+    glUseProgram(trails.program);
+    glUniform4f(trails.viewLocation, left, right, bottom, top);
+    glUniform3f(trails.colorLocation, r, g, b);
+
+    glBindVertexArray(trails.vao);
+    glMultiDrawArrays(GL_LINES, trails.drawFirst.data(), trails.drawCount.data(),
+                      static_cast<GLsizei>(trails.drawFirst.size()));
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void destroyTrailRenderer(TrailRenderer& trails) {
+    glDeleteVertexArrays(1, &trails.vao);
+    glDeleteBuffers(1, &trails.vbo);
+    glDeleteProgram(trails.program);
+    glDeleteVertexArrays(1, &trails.densityVao);
+    glDeleteBuffers(1, &trails.densityVbo);
+    glDeleteTextures(1, &trails.densityTexture);
+    glDeleteProgram(trails.densityProgram);
+    trails.tiles.clear();
+    trails.dirtyTiles.clear();
+    trails.density.clear();
+    trails.chunkTiles.clear();
+    trails.uploaded.clear();
+    trails.chunksUsed = 0;
+}
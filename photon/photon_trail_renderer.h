@@ -0,0 +1,80 @@
+#ifndef PHOTON_TRAIL_RENDERER_H
+#define PHOTON_TRAIL_RENDERER_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#define TRAIL_TILE_SIZE 2.0f // World meters per side of a culling tile
+#define TRAIL_CHUNK_VERTICES 1024 // Vertices per block of the buffer; every block belongs to one tile
+#define TRAIL_DENSITY_CELL 0.05f // World meters per texel of the level-of-detail texture
+#define TRAIL_LINE_BUDGET (1 << 21) // Most vertices drawn as lines in a frame before switching to the texture
+#define TRAIL_MAX_CHUNKS 4096 // Most blocks kept (32 MB of vertices); then the oldest block makes room
+
+// Trail pieces clipped to one tile of the box
+struct TrailTile {
+    std::deque<GLint> chunks; // First vertex of each of the tile's blocks in the buffer, in fill order
+    size_t vertices; // Uploaded vertices; only the last block can be partly filled
+    std::vector<GLfloat> pending; // x, y pairs waiting for upload
+
+    TrailTile() : vertices(0) {}
+};
+
+// Photon trails kept on the GPU. Each segment is clipped to a grid of tiles over the box and
+// staged on its tiles; at the next draw the staged vertices are appended to the tiles' blocks of
+// one shared buffer. The buffer doubles up to maxChunks blocks and then reuses them as a ring:
+// the oldest block is taken from its tile (and its trails from the texture below), so a long
+// session keeps the most recent history in fixed memory. A frame draws only the blocks of the
+// tiles that meet the visible rectangle, with one glMultiDrawArrays. When even those exceed
+// TRAIL_LINE_BUDGET vertices (far zoom over a long history), it draws instead a texture of trail
+// length per texel, mipmapped and shaded as the fraction of each pixel the lines would cover, so
+// the frame cost stops growing with the history. Uses only core-profile objects, so it also
+// works next to legacy drawing.
+struct TrailRenderer {
+    GLuint program;
+    GLuint vao;
+    GLuint vbo;
+    GLint viewLocation;
+    GLint colorLocation;
+    GLuint densityProgram;
+    GLuint densityVao;
+    GLuint densityVbo;
+    GLuint densityTexture;
+    GLint densityViewLocation;
+    GLint densityColorLocation;
+    GLint densityScaleLocation;
+    GLfloat width; // Box the trails lie in
+    GLfloat height;
+    int tilesX;
+    int tilesY;
+    std::vector<TrailTile> tiles;
+    std::vector<uint32_t> dirtyTiles; // Tiles with pending vertices
+    size_t capacity; // Blocks the buffer can hold
+    size_t maxChunks; // Most blocks the buffer grows to
+    size_t chunksUsed;
+    size_t oldestChunk; // Block reused next once all maxChunks are in use
+    std::vector<uint32_t> chunkTiles; // Tile each block belongs to
+    std::vector<GLfloat> uploaded; // Copy of the buffer, to take a reused block's trails out of density
+    int densityX;
+    int densityY;
+    std::vector<GLfloat> density; // Trail length per texel, rows from the bottom
+    bool densityDirty; // Texture behind density
+    std::vector<GLint> drawFirst; // Blocks of the visible tiles, reused every frame
+    std::vector<GLsizei> drawCount;
+    bool drewDensity; // Whether the last draw used the texture instead of the lines
+};
+
+bool initTrailRenderer(TrailRenderer& trails, GLfloat width, GLfloat height, size_t initialChunks = 256,
+                       size_t maxChunks = TRAIL_MAX_CHUNKS);
+void addTrailSegment(TrailRenderer& trails, GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1);
+// Upload pending segments and draw the trails in the world rectangle [left, right] x [bottom, top],
+// which is mapped to the viewport; pixelSize (world meters per pixel) and lineWidth (pixels) set
+// the coverage of the level-of-detail texture to match the lines
+void drawTrails(TrailRenderer& trails, GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat pixelSize,
+                GLfloat lineWidth, GLfloat r, GLfloat g, GLfloat b);
+void destroyTrailRenderer(TrailRenderer& trails);
+
+#endif // PHOTON_TRAIL_RENDERER_H
@@ -0,0 +1,550 @@
+#include "photon_transport.h"
+#include "photon_fluence.h"
+#include "photon_math.h"
+#include "photon_qmc.h"
+#include "photon_rng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+bool checkTransportConfig(const TransportConfig& config, std::string& error) {
+    // Written as !(x > 0) so NaN is rejected too
+    if (!(config.meanFreePath > 0.0f)) error = "meanFreePath must be positive";
+    else if (!(config.absorptionLength > 0.0f)) error = "absorptionLength must be positive";
+    else if (!(config.sensorRadius > 0.0f)) error = "sensorRadius must be positive";
+    else if (!(std::fabs(config.anisotropy) < 1.0f)) error = "anisotropy must lie strictly between -1 and 1";
+    else if (!insideBox(config, config.emitterX, config.emitterY)) error = "the emitter lies outside the box";
+    else return true;
+    return false;
+}
+
+SensorCenters makeSensorGrid(int N, float width, float height, float margin) {
+    SensorCenters centers;
+    centers.reserve(static_cast<size_t>(N) * N);
+
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) {
+            float spacingX = (width - 2 * margin) / (N - 1);
+            float spacingY = (height - 2 * margin) / (N - 1);
+            float x = margin + j * spacingX;
+            float y = margin + i * spacingY;
+            centers.emplace_back(x, y);
+        }
+    }
+    return centers;
+}
+
+std::tuple<bool, std::pair<float, float>> check_walls(float prev_x, float prev_y, float curr_x, float curr_y,
+                                                      float width, float height) {
+    const float left_wall = 0.0f;
+    const float right_wall = width;
+    const float bottom_wall = 0.0f;
+    const float top_wall = height;
+
+    // Walls are tested in a fixed order and the first valid intersection wins
+    if (curr_x < left_wall) {
+        float t = (left_wall - prev_x) / (curr_x - prev_x);
+        float y_intersect = prev_y + t * (curr_y - prev_y);
+        if (0 <= t && t <= 1 && bottom_wall <= y_intersect && y_intersect <= top_wall) {
+            return std::make_tuple(true, std::make_pair(left_wall, y_intersect));
+        }
+    }
+
+    if (curr_x > right_wall) {
+        float t = (right_wall - prev_x) / (curr_x - prev_x);
+        float y_intersect = prev_y + t * (curr_y - prev_y);
+        if (0 <= t && t <= 1 && bottom_wall <= y_intersect && y_intersect <= top_wall) {
+            return std::make_tuple(true, std::make_pair(right_wall, y_intersect));
+        }
+    }
+
+    if (curr_y < bottom_wall) {
+        float t = (bottom_wall - prev_y) / (curr_y - prev_y);
+        float x_intersect = prev_x + t * (curr_x - prev_x);
+        if (0 <= t && t <= 1 && left_wall <= x_intersect && x_intersect <= right_wall) {
+            return std::make_tuple(true, std::make_pair(x_intersect, bottom_wall));
+        }
+    }
+
+    if (curr_y > top_wall) {
+        float t = (top_wall - prev_y) / (curr_y - prev_y);
+        float x_intersect = prev_x + t * (curr_x - prev_x);
+        if (0 <= t && t <= 1 && left_wall <= x_intersect && x_intersect <= right_wall) {
+            return std::make_tuple(true, std::make_pair(x_intersect, top_wall));
+        }
+    }
+
+    return std::make_tuple(false, std::make_pair(0.0f, 0.0f));
+}
+
+void setPhaseFunction(TransportConfig& config, PhaseFunction phase, float anisotropy) {
+    config.phase = phase;
+    config.anisotropy = anisotropy;
+    config.phaseTable.reset();
+    if (phase != PHASE_ISOTROPIC) {
+        config.phaseTable = std::make_shared<const PhaseTable>(buildPhaseTable(phase, anisotropy));
+    }
+}
+
+PhotonState emitPhoton(const TransportConfig& config, uint64_t id) {
+    PhotonState photon;
+    photon.id = id;
+    photon.x = config.emitterX;
+    photon.y = config.emitterY;
+    photon.angle = 0.0f; // Drawn from the stream at the first step
+    photon.pathLength = 0.0f;
+    photon.scatters = 0;
+    photon.weight = 1.0f;
+    photon.sensor = -1;
+    photon.fate = PHOTON_ACTIVE;
+    photon.flight = 0.0f;
+    photon.flightAbsorbs = false;
+    photon.bounces = 0;
+    photon.surface = -1;
+    return photon;
+}
+
+void stepPhoton(PhotonState& photon, const TransportConfig& config, const SensorIndex& sensors) {
+    // Step k of a photon uses block k of its stream: scattering and absorption distances, the
+    // isotropic direction of this flight (the emission direction for k = 0) and the roulette draw
+    uint32_t step = static_cast<uint32_t>(photon.scatters);
+    StepDraws draws = stepDraws(config.seed, photon.id, step);
+    if (config.sampling == SAMPLING_SOBOL && step < SOBOL_STEPS) {
+        SobolSampler sampler(config.seed);
+        applySobolDraws(draws, sampler, photon.id, step);
+    }
+    stepPhoton(photon, config, sensors, draws);
+}
+
+// The photon reached the end of its flight inside the medium: absorption or a scatter
+static void endFlight(PhotonState& photon, const TransportConfig& config, const StepDraws& draws, bool absorbed) {
+    if (absorbed) {
+        photon.fate = PHOTON_ABSORBED;
+    } else if (config.mode == TRANSPORT_WEIGHTED) {
+        captureWeighted(photon, config, draws.roulette);
+    } else {
+        photon.scatters++;
+    }
+}
+
+// Flight from prev to next through the obstacles of config.scene, then the box walls with the
+// scene's wall material
+static void crossScene(PhotonState& photon, const TransportConfig& config, const SensorIndex& sensors,
+                       const StepDraws& draws, float prev_x, float prev_y, float next_x, float next_y, float samp_dist,
+                       bool absorbed) {
+    const Scene& scene = *config.scene;
+    float dx = next_x - prev_x;
+    float dy = next_y - prev_y;
+    SceneHit hit = intersectScene(scene, prev_x, prev_y, next_x, next_y, photon.surface);
+    bool onSurface = true;
+    float end_x, end_y, nx, ny, reflectance;
+    SurfaceMaterial material;
+    if (hit.edge >= 0) {
+        const SceneEdge& edge = scene.edges[hit.edge];
+        end_x = prev_x + hit.t * dx;
+        end_y = prev_y + hit.t * dy;
+        float ex = edge.x1 - edge.x0;
+        float ey = edge.y1 - edge.y0;
+        float norm = 1.0f / std::sqrt(ex * ex + ey * ey);
+        nx = -ey * norm;
+        ny = ex * norm;
+        material = edge.material;
+        reflectance = edge.reflectance;
+    } else {
+        // Obstacles lie inside the box, so the walls only matter when none was hit
+        auto wall_result = check_walls(prev_x, prev_y, next_x, next_y, config.boxWidth, config.boxHeight);
+        onSurface = std::get<0>(wall_result);
+        end_x = std::get<1>(wall_result).first;
+        end_y = std::get<1>(wall_result).second;
+        nx = end_x == 0.0f || end_x == config.boxWidth ? 1.0f : 0.0f;
+        ny = 1.0f - nx;
+        if (onSurface) hit.t = std::abs(dx) > std::abs(dy) ? (end_x - prev_x) / dx : (end_y - prev_y) / dy;
+        material = scene.wallMaterial;
+        reflectance = scene.wallReflectance;
+    }
+
+    // Sensors on the part of the flight before the surface. The whole flight is queried, as without
+    // a scene, so the entry point does not depend on where the flight was cut.
+    int sensor_index = -2;
+    std::tuple<std::pair<float, float>, int> sensor_result;
+    if (dx != 0.0f || dy != 0.0f) {
+        sensor_result = check_sensors(prev_x, prev_y, next_x, next_y, sensors);
+        sensor_index = std::get<1>(sensor_result);
+        if (sensor_index >= 0 && onSurface) {
+            float sx = std::get<0>(sensor_result).first - prev_x;
+            float sy = std::get<0>(sensor_result).second - prev_y;
+            float ex = end_x - prev_x;
+            float ey = end_y - prev_y;
+            if (sx * sx + sy * sy > ex * ex + ey * ey) sensor_index = -2;
+        }
+    }
+
+    if (sensor_index >= 0) {
+        photon.x = std::get<0>(sensor_result).first;
+        photon.y = std::get<0>(sensor_result).second;
+        photon.sensor = sensor_index;
+        photon.fate = PHOTON_SENSOR;
+        return;
+    }
+    if (!onSurface) {
+        photon.x = next_x;
+        photon.y = next_y;
+        photon.flight = 0.0f;
+        photon.bounces = 0;
+        photon.surface = -1;
+        endFlight(photon, config, draws, absorbed);
+        return;
+    }
+
+    photon.x = end_x;
+    photon.y = end_y;
+    if (material == SURFACE_ABSORBING || reflectance <= 0.0f) {
+        photon.fate = PHOTON_WALL;
+        return;
+    }
+    if (photon.bounces >= SCENE_MAX_BOUNCES) {
+        photon.fate = PHOTON_ABSORBED;
+        return;
+    }
+
+    // Reflection: survival (or the weight factor) and, off a diffuse surface, the new direction
+    // come from a block of their own, so the step draws stay as they are
+    PhiloxBlock block = photonBounceBlock(config.seed, photon.id, static_cast<uint32_t>(photon.scatters),
+                                          static_cast<uint32_t>(photon.bounces));
+    if (config.mode == TRANSPORT_WEIGHTED) {
+        photon.weight *= reflectance;
+    } else if (uniformFloat(block.v[0]) >= reflectance) {
+        photon.fate = PHOTON_WALL;
+        return;
+    }
+    float out_x, out_y;
+    if (material == SURFACE_SPECULAR) {
+        float along = 2.0f * (dx * nx + dy * ny);
+        out_x = dx - along * nx;
+        out_y = dy - along * ny;
+    } else {
+        // Lambertian in 2D: the sine of the angle to the normal is uniform in [-1, 1]
+        if (dx * nx + dy * ny > 0.0f) {
+            nx = -nx;
+            ny = -ny;
+        }
+        float sine = 2.0f * uniformFloat(block.v[1]) - 1.0f;
+        float cosine = std::sqrt(std::max(0.0f, 1.0f - sine * sine));
+        out_x = cosine * nx - sine * ny;
+        out_y = cosine * ny + sine * nx;
+    }
+    float angle = std::atan2(out_y, out_x);
+    photon.angle = angle < 0.0f ? angle + PHOTON_TWO_PI : angle;
+    // Keep a zero remainder positive, so the flight still ends with its interaction
+    photon.flight = std::max(samp_dist * (1.0f - hit.t), 1e-30f);
+    photon.flightAbsorbs = absorbed;
+    photon.bounces++;
+    photon.surface = hit.edge; // -1 off a wall, which the next flight cannot cross again
+}
+
+void stepPhoton(PhotonState& photon, const TransportConfig& config, const SensorIndex& sensors,
+                const StepDraws& draws) {
+    float prev_x = photon.x;
+    float prev_y = photon.y;
+    float cosAngle = draws.cosAngle;
+    float sinAngle = draws.sinAngle;
+    float samp_dist;
+    bool absorbed;
+    if (photon.flight > 0.0f) {
+        // The rest of a flight a reflection cut short, in the reflected direction
+        cosAngle = std::cos(photon.angle);
+        sinAngle = std::sin(photon.angle);
+        samp_dist = photon.flight;
+        absorbed = photon.flightAbsorbs;
+    } else {
+        if (config.phaseTable && photon.scatters > 0) {
+            // Turn the previous flight by a deflection drawn from the phase function; the emission is isotropic
+            float turns = photon.angle * (1.0f / PHOTON_TWO_PI) +
+                          samplePhase(config.phaseTable->deflection, draws.angle);
+            turns -= std::floor(turns);
+            photonSinCos2Pi(turns, sinAngle, cosAngle);
+            photon.angle = turns * PHOTON_TWO_PI;
+        } else {
+            photon.angle = draws.angle * PHOTON_TWO_PI;
+        }
+
+        // Sample distances for scattering and absorption
+        if (config.mode == TRANSPORT_WEIGHTED) {
+            // Every interaction is a scatter; absorption is accounted for in the weight
+            float mu_t = 1.0f / config.meanFreePath + 1.0f / config.absorptionLength;
+            samp_dist = draws.scatter / mu_t;
+            absorbed = false;
+        } else {
+            float samp_sca = config.meanFreePath * draws.scatter;
+            float samp_abs = config.absorptionLength * draws.absorb;
+            samp_dist = std::min(samp_sca, samp_abs);
+            absorbed = samp_dist == samp_abs;
+        }
+    }
+
+    float next_x = prev_x + samp_dist * cosAngle;
+    float next_y = prev_y + samp_dist * sinAngle;
+
+    if (config.scene) {
+        crossScene(photon, config, sensors, draws, prev_x, prev_y, next_x, next_y, samp_dist, absorbed);
+    } else {
+        // Sensors lie inside the box, so a sensor on the segment is always reached before the wall
+        auto sensor_result = check_sensors(prev_x, prev_y, next_x, next_y, sensors);
+        int sensor_index = std::get<1>(sensor_result);
+        auto wall_result = check_walls(prev_x, prev_y, next_x, next_y, config.boxWidth, config.boxHeight);
+
+        if (sensor_index >= 0) {
+            photon.x = std::get<0>(sensor_result).first;
+            photon.y = std::get<0>(sensor_result).second;
+            photon.sensor = sensor_index;
+            photon.fate = PHOTON_SENSOR;
+        } else if (std::get<0>(wall_result)) {
+            photon.x = std::get<1>(wall_result).first;
+            photon.y = std::get<1>(wall_result).second;
+            photon.fate = PHOTON_WALL;
+        } else {
+            photon.x = next_x;
+            photon.y = next_y;
+            endFlight(photon, config, draws, absorbed);
+        }
+    }
+    float dx = photon.x - prev_x;
+    float dy = photon.y - prev_y;
+    photon.pathLength += std::sqrt(dx * dx + dy * dy); // Spelled out so the packet kernel can match it exactly
+}
+
+void initBatchResult(BatchResult& result, size_t sensorCount) {
+    result = BatchResult();
+    result.sensorHits.assign(sensorCount, 0);
+    result.sensorWeight.assign(sensorCount, 0.0);
+    result.sensorWeightSq.assign(sensorCount, 0.0);
+}
+
+void prepareBatchResult(BatchResult& result, const TransportConfig& config, size_t sensorCount) {
+    if (result.sensorHits.size() != sensorCount) {
+        initBatchResult(result, sensorCount);
+    }
+    if (config.timeBins > 0 && result.timeBins != config.timeBins) {
+        result.timeBins = config.timeBins;
+        result.arrivalWeight.assign(sensorCount * (config.timeBins + 1), 0.0);
+    }
+    size_t cells = static_cast<size_t>(config.fluenceCellsX) * config.fluenceCellsY;
+    if (result.fluence.size() != cells) {
+        result.fluence.assign(cells, 0.0);
+    }
+}
+
+void tallyArrival(BatchResult& result, const TransportConfig& config, int sensor, float pathLength, float weight) {
+    // Compare before converting, so arrivals far past the last bin cannot overflow the int
+    float slot = pathLength / config.photonSpeed / config.timeBinWidth;
+    int bin = slot < config.timeBins ? static_cast<int>(slot) : config.timeBins;
+    result.arrivalWeight[sensor * (config.timeBins + 1) + bin] += weight;
+}
+
+void tallyPhoton(BatchResult& result, PhotonFate fate, int sensor, float weight) {
+    switch (fate) {
+    case PHOTON_SENSOR:
+        result.sensorHits[sensor]++;
+        result.sensorWeight[sensor] += weight;
+        result.sensorWeightSq[sensor] += static_cast<double>(weight) * weight;
+        break;
+    case PHOTON_WALL:
+        result.wallLosses++;
+        result.wallWeight += weight;
+        break;
+    default:
+        result.absorbed++;
+        break;
+    }
+}
+
+void tracePhotonRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t first, uint64_t count,
+                      BatchResult& result) {
+    prepareBatchResult(result, config, sensors.size());
+
+    // The draws come in blocks of consecutive steps, generated together
+    StepVariates variates;
+    bool trackFluence = !result.fluence.empty();
+    bool sobol = config.sampling == SAMPLING_SOBOL;
+    SobolSampler sampler(config.seed);
+    for (uint64_t n = first; n < first + count; ++n) {
+        PhotonState photon = emitPhoton(config, n);
+        while (photon.fate == PHOTON_ACTIVE) {
+            uint32_t step = static_cast<uint32_t>(photon.scatters);
+            if (!variates.holds(n, step)) {
+                fillStepVariates(variates, config.seed, n, step);
+                if (sobol && step < SOBOL_STEPS) applySobolDraws(variates, sampler);
+            }
+            float prev_x = photon.x;
+            float prev_y = photon.y;
+            float weight = photon.weight; // The weight carried along the flight
+            stepPhoton(photon, config, sensors, variates.draws(step));
+            if (trackFluence) {
+                tallyTrack(result.fluence, config, prev_x, prev_y, photon.x, photon.y, weight);
+            }
+            result.steps++;
+        }
+        tallyPhoton(result, photon.fate, photon.sensor, photon.weight);
+        if (config.timeBins > 0 && photon.fate == PHOTON_SENSOR) {
+            tallyArrival(result, config, photon.sensor, photon.pathLength, photon.weight);
+        }
+        if (result.recordEvents) {
+            int32_t target = photon.fate == PHOTON_SENSOR ? photon.sensor
+                           : photon.fate == PHOTON_WALL ? EVENT_WALL : EVENT_ABSORBED;
+            result.events.push(photon.id, target, photon.x, photon.y, photon.pathLength,
+                               static_cast<uint32_t>(photon.scatters), photon.weight);
+        }
+    }
+    result.photons += count;
+}
+
+void mergeBatchResult(BatchResult& into, const BatchResult& from) {
+    if (into.sensorHits.size() < from.sensorHits.size()) {
+        into.sensorHits.resize(from.sensorHits.size(), 0);
+        into.sensorWeight.resize(from.sensorHits.size(), 0.0);
+        into.sensorWeightSq.resize(from.sensorHits.size(), 0.0);
+    }
+    into.photons += from.photons;
+    into.steps += from.steps;
+    into.wallLosses += from.wallLosses;
+    into.absorbed += from.absorbed;
+    into.wallWeight += from.wallWeight;
+    for (size_t i = 0; i < from.sensorHits.size(); ++i) {
+        into.sensorHits[i] += from.sensorHits[i];
+        into.sensorWeight[i] += from.sensorWeight[i];
+        into.sensorWeightSq[i] += from.sensorWeightSq[i];
+    }
+    if (from.timeBins > 0) {
+        if (into.timeBins != from.timeBins) {
+            into.timeBins = from.timeBins;
+            into.arrivalWeight.assign(from.arrivalWeight.size(), 0.0);
+        }
+        for (size_t i = 0; i < from.arrivalWeight.size(); ++i) {
+            into.arrivalWeight[i] += from.arrivalWeight[i];
+        }
+    }
+    if (!from.fluence.empty()) {
+        if (into.fluence.size() != from.fluence.size()) {
+            into.fluence.assign(from.fluence.size(), 0.0);
+        }
+        for (size_t i = 0; i < from.fluence.size(); ++i) {
+            into.fluence[i] += from.fluence[i];
+        }
+    }
+}
+
+SensorEstimate sensorEstimate(const BatchResult& result, size_t sensor) {
+    SensorEstimate estimate = { 0.0, 0.0 };
+    double n = static_cast<double>(result.photons);
+    if (n < 1) return estimate;
+
+    // Every photon contributes its detected weight (0 for most) to the mean
+    double sum = result.sensorWeight[sensor];
+    estimate.mean = sum / n;
+    if (n > 1) {
+        double variance = std::max(0.0, (result.sensorWeightSq[sensor] - sum * estimate.mean) / (n - 1));
+        estimate.stdError = std::sqrt(variance / n);
+    }
+    return estimate;
+}
+
+ChunkMerger::ChunkMerger(size_t sensorCount, const TraceHooks* hooks) : hooks(hooks), nextChunk(0) {
+    initBatchResult(result, sensorCount);
+}
+
+void ChunkMerger::add(uint64_t chunk, BatchResult& part) {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished[chunk] = std::move(part);
+    for (auto it = finished.find(nextChunk); it != finished.end(); it = finished.find(nextChunk)) {
+        mergeBatchResult(result, it->second);
+        if (hooks && hooks->events) {
+            hooks->events->append(it->second.events);
+        }
+        if (hooks && hooks->merged) {
+            hooks->merged(result);
+        }
+        finished.erase(it);
+        nextChunk++;
+    }
+}
+
+void traceRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t first, uint64_t count,
+                TraceKernel kernel, BatchResult& result) {
+    if (kernel == TRACE_PACKET) {
+        tracePacketRange(config, sensors, first, count, result);
+    } else {
+        tracePhotonRange(config, sensors, first, count, result);
+    }
+}
+
+BatchResult traceBatch(const TransportConfig& config, const SensorIndex& sensors, uint64_t photonCount,
+                       unsigned threads, TraceKernel kernel, const TraceHooks& hooks) {
+    return traceBatchRange(config, sensors, 0, photonCount, threads, kernel, hooks);
+}
+
+void traceChunks(uint64_t firstPhoton, uint64_t photonCount, unsigned threads, size_t sensorCount,
+                 ChunkMerger& merger, const std::function<void(uint64_t, uint64_t, BatchResult&)>& trace) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Workers pull fixed-size chunks of the photon index space, so the work is balanced
+    // while each photon still draws from its own stream
+    std::atomic<uint64_t> nextChunk(0);
+    uint64_t chunkCount = (photonCount + PHOTON_CHUNK - 1) / PHOTON_CHUNK;
+    bool recordEvents = merger.hooks && merger.hooks->events;
+
+    auto worker = [&]() {
+        for (uint64_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+            uint64_t offset = chunk * PHOTON_CHUNK;
+            uint64_t first = firstPhoton + offset;
+            uint64_t count = std::min<uint64_t>(PHOTON_CHUNK, photonCount - offset);
+            BatchResult part;
+            initBatchResult(part, sensorCount);
+            if (recordEvents) {
+                part.recordEvents = true;
+                part.events.reserve(count);
+            }
+            trace(first, count, part);
+            merger.add(chunk, part);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+BatchResult traceBatchRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t firstPhoton,
+                            uint64_t photonCount, unsigned threads, TraceKernel kernel, const TraceHooks& hooks) {
+    ChunkMerger merger(sensors.size(), &hooks);
+    traceChunks(firstPhoton, photonCount, threads, sensors.size(), merger,
+                [&](uint64_t first, uint64_t count, BatchResult& part) {
+                    traceRange(config, sensors, first, count, kernel, part);
+                });
+    return std::move(merger.result);
+}
+
+void continueBatch(const TransportConfig& config, const SensorIndex& sensors, BatchResult& tallies,
+                   uint64_t photonCount, unsigned threads, TraceKernel kernel, const TraceHooks& hooks) {
+    if (tallies.sensorHits.size() != sensors.size()) {
+        uint64_t rangeStart = tallies.firstPhoton;
+        initBatchResult(tallies, sensors.size());
+        tallies.firstPhoton = rangeStart;
+    }
+    uint64_t firstPhoton = tallies.firstPhoton + tallies.photons;
+    ChunkMerger merger(sensors.size(), &hooks);
+    std::swap(merger.result, tallies);
+    traceChunks(firstPhoton, photonCount, threads, sensors.size(), merger,
+                [&](uint64_t first, uint64_t count, BatchResult& part) {
+                    traceRange(config, sensors, first, count, kernel, part);
+                });
+    std::swap(tallies, merger.result);
+}
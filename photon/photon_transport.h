@@ -0,0 +1,275 @@
+#ifndef PHOTON_TRANSPORT_H
+#define PHOTON_TRANSPORT_H
+
+#include "photon_events.h"
+#include "photon_phase.h"
+#include "photon_sampler.h"
+#include "photon_scene.h"
+#include "photon_sensor_index.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#define PHOTON_CHUNK 16384 // Photons handed to a worker thread at a time
+
+// Define M_PI if it is not defined
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+enum TransportMode {
+    TRANSPORT_ANALOG, // A photon is killed at the first absorption sample
+    TRANSPORT_WEIGHTED // Implicit capture: each event scales the weight by the scattering albedo,
+                       // Russian roulette ends low-weight packets
+};
+
+enum SamplingMode {
+    SAMPLING_PSEUDO, // Every draw from the photon's Philox stream
+    SAMPLING_SOBOL // Scrambled Sobol points for the first steps of each photon (2D transport, see photon_qmc.h)
+};
+
+// Optical properties and geometry of one transport run (defaults match the windowed demo)
+struct TransportConfig {
+    float boxWidth; // Width of the box in meters
+    float boxHeight; // Height of the box in meters
+    float emitterX;
+    float emitterY;
+    float sensorRadius; // Radius of the sensors
+    float meanFreePath; // Mean free path for scattering in meters
+    float absorptionLength; // Mean free path for absorption in meters
+    float absorptionProbability; // Probability of absorption at each scattering event
+    float photonSpeed; // Speed of the photon beam
+    uint64_t seed; // Key of the per-photon random streams
+    TransportMode mode;
+    float rouletteThreshold; // Weight below which a packet plays Russian roulette
+    float rouletteSurvival; // Chance to survive the roulette (the weight is divided by it)
+    float boxDepth; // Depth of the box in meters, used by the 3D transport only
+    float emitterZ;
+    int timeBins; // Arrival-time histogram bins per sensor, 0 = no histograms
+    float timeBinWidth; // Width of a histogram bin in seconds (arrival time = path length / photonSpeed)
+    PhaseFunction phase; // Set the phase function with setPhaseFunction(), which also builds its table
+    float anisotropy; // Henyey-Greenstein g, the mean cosine of the deflection
+    int fluenceCellsX; // Fluence grid over the box (see photon_fluence.h), 0 = no grid
+    int fluenceCellsY;
+    SamplingMode sampling; // The seed also selects the scrambling of the Sobol points
+    std::shared_ptr<const PhaseTable> phaseTable; // NULL for isotropic scattering
+    std::shared_ptr<const Scene> scene; // Obstacles and wall materials of the 2D box, NULL for the empty box
+
+    TransportConfig()
+        : boxWidth(25.0f), boxHeight(33.0f), emitterX(12.0f), emitterY(17.0f),
+          sensorRadius(0.075f), meanFreePath(7.0f), absorptionLength(11.0f),
+          absorptionProbability(0.1f), photonSpeed(1.0f), seed(5489u),
+          mode(TRANSPORT_ANALOG), rouletteThreshold(0.01f), rouletteSurvival(0.1f),
+          boxDepth(25.0f), emitterZ(12.5f), timeBins(0), timeBinWidth(1.0f),
+          phase(PHASE_ISOTROPIC), anisotropy(0.0f), fluenceCellsX(0), fluenceCellsY(0),
+          sampling(SAMPLING_PSEUDO) {}
+};
+
+enum PhotonFate {
+    PHOTON_ACTIVE, // Still moving
+    PHOTON_SENSOR, // Stopped on a sensor
+    PHOTON_WALL, // Left the box through a wall, or stopped on an absorbing surface of the scene
+    PHOTON_ABSORBED // Absorbed in the medium (or lost the roulette)
+};
+
+// State of a single photon between scatter steps
+struct PhotonState {
+    uint64_t id; // Photon index, selects the random stream
+    float x;
+    float y;
+    float angle; // Current angle of movement
+    float pathLength; // Distance travelled so far
+    int scatters; // Number of scattering events so far
+    float weight; // Packet weight, always 1 in analog mode
+    int sensor; // Index of the sensor that stopped the photon, or -1
+    PhotonFate fate;
+    float flight; // Distance left of a flight a reflection cut short, 0 when the next step starts a new flight
+    bool flightAbsorbs; // Whether that flight ends in an absorption (analog mode)
+    int bounces; // Reflections so far in the current flight
+    int surface; // Scene edge the photon just reflected from, or -1
+};
+
+enum TraceKernel {
+    TRACE_SCALAR, // One photon at a time through stepPhoton()
+    TRACE_PACKET // PHOTON_LANES photons at a time in SIMD registers (same results)
+};
+
+// Tallies of a batch of photons traced to completion
+struct BatchResult {
+    uint64_t firstPhoton; // Index of the first photon tallied; past 0 for a shard of a larger run
+    uint64_t photons;
+    uint64_t steps; // Total number of scatter steps
+    uint64_t wallLosses;
+    uint64_t absorbed;
+    double wallWeight; // Weight that left through the walls
+    std::vector<uint64_t> sensorHits; // One entry per sensor
+    std::vector<double> sensorWeight; // Detected weight per sensor (the hit count in analog mode)
+    std::vector<double> sensorWeightSq; // Sum over photons of the squared detected weight
+    int timeBins; // Histogram bins per sensor; row i of arrivalWeight holds timeBins + 1 entries,
+                  // the last one collecting everything that arrived later
+    std::vector<double> arrivalWeight; // Detected weight per sensor and arrival-time bin
+    std::vector<double> fluence; // Weighted track length per fluence grid cell, empty without a grid
+    bool recordEvents; // Keep the terminal event of every photon in events
+    PhotonEvents events;
+
+    BatchResult()
+        : firstPhoton(0), photons(0), steps(0), wallLosses(0), absorbed(0), wallWeight(0.0), timeBins(0),
+          recordEvents(false) {}
+};
+
+// Fraction of emitted photons detected by a sensor, with its Monte Carlo standard error
+struct SensorEstimate {
+    double mean;
+    double stdError;
+};
+
+// Select the phase function of the scatters and tabulate it (about 10 ms; copies of the
+// config share the table)
+void setPhaseFunction(TransportConfig& config, PhaseFunction phase, float anisotropy);
+
+// Whether (x, y) lies strictly inside the box, where an emitter has to sit
+inline bool insideBox(const TransportConfig& config, float x, float y) {
+    return x > 0.0f && x < config.boxWidth && y > 0.0f && y < config.boxHeight;
+}
+
+// Check the optical properties, sensor radius and emitter of a 2D run: positive path lengths and
+// radius, |anisotropy| < 1 and the emitter inside the box; false with the reason in error otherwise
+bool checkTransportConfig(const TransportConfig& config, std::string& error);
+
+#define SENSOR_MARGIN 0.5f // Distance from the outer sensors to the walls in the tools' default layout
+
+// Regular NxN grid of sensors inside a width x height box, keeping margin from the edges
+SensorCenters makeSensorGrid(int N, float width, float height, float margin);
+
+std::tuple<bool, std::pair<float, float>> check_walls(float prev_x, float prev_y, float curr_x, float curr_y,
+                                                      float width, float height);
+
+// Create photon number id at the emitter with an isotropic direction
+PhotonState emitPhoton(const TransportConfig& config, uint64_t id);
+
+// Advance a photon by one scatter step; the photon ends at the next vertex of its path. With a
+// scene, a reflection also ends the step: the photon stops on the surface with the rest of its
+// flight in photon.flight, and the following step carries on from there without new draws.
+void stepPhoton(PhotonState& photon, const TransportConfig& config, const SensorIndex& sensors);
+
+// Same with the draws of this step supplied by the caller (see photon_sampler.h)
+void stepPhoton(PhotonState& photon, const TransportConfig& config, const SensorIndex& sensors,
+                const StepDraws& draws);
+
+// A weighted packet (2D or 3D photon state) reached the end of its flight in the medium: implicit
+// capture scales its weight by the scattering albedo, then Russian roulette with the step's
+// roulette draw ends a low-weight packet or boosts the survivor, keeping the estimate unbiased
+template <typename Photon>
+inline void captureWeighted(Photon& photon, const TransportConfig& config, float roulette) {
+    float albedo = config.absorptionLength / (config.meanFreePath + config.absorptionLength);
+    photon.weight *= albedo;
+    if (photon.weight < config.rouletteThreshold) {
+        if (roulette < config.rouletteSurvival) {
+            photon.weight /= config.rouletteSurvival;
+        } else {
+            photon.weight = 0.0f;
+            photon.fate = PHOTON_ABSORBED;
+        }
+    }
+    if (photon.fate == PHOTON_ACTIVE) {
+        photon.scatters++;
+    }
+}
+
+// Trace photons [first, first + count) to completion and add them to result
+void tracePhotonRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t first, uint64_t count,
+                      BatchResult& result);
+
+// Same as tracePhotonRange() but advances a packet of photons together with AVX2/AVX-512;
+// falls back to tracePhotonRange() when the engine was built without either, in weighted mode,
+// with an anisotropic phase function, with a fluence grid, with Sobol sampling and with a scene
+void tracePacketRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t first, uint64_t count,
+                      BatchResult& result);
+
+// Photons per packet in tracePacketRange(), 1 without SIMD support
+int packetLanes();
+
+// Empty tallies for sensorCount sensors
+void initBatchResult(BatchResult& result, size_t sensorCount);
+
+// Size result for tracing with config against sensorCount sensors, unless it already is
+void prepareBatchResult(BatchResult& result, const TransportConfig& config, size_t sensorCount);
+
+// Add one finished photon to the tallies
+void tallyPhoton(BatchResult& result, PhotonFate fate, int sensor, float weight);
+
+// Add a sensor hit after pathLength to the sensor's arrival-time histogram
+void tallyArrival(BatchResult& result, const TransportConfig& config, int sensor, float pathLength, float weight);
+
+// Row of the arrival-time histogram of one sensor (timeBins + 1 entries)
+inline const double* arrivalHistogram(const BatchResult& result, size_t sensor) {
+    return &result.arrivalWeight[sensor * (result.timeBins + 1)];
+}
+
+void mergeBatchResult(BatchResult& into, const BatchResult& from);
+
+SensorEstimate sensorEstimate(const BatchResult& result, size_t sensor);
+
+// Optional outputs of a batch run, fed as chunks are merged
+struct TraceHooks {
+    EventStreamWriter* events; // Receives the terminal event of every photon
+    std::function<void(const BatchResult&)> merged; // Sees the running tallies after every merged chunk;
+                                                    // called under the merge lock, so keep it short
+
+    TraceHooks() : events(NULL) {}
+};
+
+// Folds the tallies of PHOTON_CHUNK-sized chunks into one result in chunk order, whatever
+// order they finish in, so floating-point sums do not depend on the thread count. Chunk events
+// go to the hooks in the same order and are then dropped.
+struct ChunkMerger {
+    BatchResult result; // May be preset to continue earlier tallies
+    const TraceHooks* hooks;
+
+    explicit ChunkMerger(size_t sensorCount, const TraceHooks* hooks = NULL);
+    void add(uint64_t chunk, BatchResult& part); // Takes over part; thread safe
+
+private:
+    std::mutex mutex;
+    std::map<uint64_t, BatchResult> finished;
+    uint64_t nextChunk;
+};
+
+// tracePacketRange() or tracePhotonRange()
+void traceRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t first, uint64_t count,
+                TraceKernel kernel, BatchResult& result);
+
+// Trace photons [firstPhoton, firstPhoton + photonCount) on threads threads (0 = all cores): each
+// PHOTON_CHUNK-sized chunk is traced by trace(first, count, part) into fresh tallies and handed to merger
+void traceChunks(uint64_t firstPhoton, uint64_t photonCount, unsigned threads, size_t sensorCount,
+                 ChunkMerger& merger, const std::function<void(uint64_t, uint64_t, BatchResult&)>& trace);
+
+// Trace photonCount photons to completion without any rendering, on threads threads
+// (0 = all cores). Chunk tallies are merged in photon order, so the result for a given seed
+// does not depend on the thread count, nor (in analog mode) on the kernel. With hooks.events set
+// the terminal event of every photon is streamed to it, chunk by chunk in photon order (within a
+// chunk the packet kernel records photons in the order they finish).
+BatchResult traceBatch(const TransportConfig& config, const SensorIndex& sensors, uint64_t photonCount,
+                       unsigned threads = 1, TraceKernel kernel = TRACE_PACKET, const TraceHooks& hooks = TraceHooks());
+
+// Same as traceBatch() for photons [firstPhoton, firstPhoton + photonCount), so a run can be continued
+BatchResult traceBatchRange(const TransportConfig& config, const SensorIndex& sensors, uint64_t firstPhoton,
+                            uint64_t photonCount, unsigned threads = 1, TraceKernel kernel = TRACE_PACKET,
+                            const TraceHooks& hooks = TraceHooks());
+
+// Trace the next photonCount photons after the photons [tallies.firstPhoton, tallies.firstPhoton +
+// tallies.photons) already in tallies and merge them in.
+// Chunks are merged one by one onto the existing sums, so splitting a run into several calls at
+// chunk boundaries gives exactly the result of one traceBatch() call.
+void continueBatch(const TransportConfig& config, const SensorIndex& sensors, BatchResult& tallies,
+                   uint64_t photonCount, unsigned threads = 1, TraceKernel kernel = TRACE_PACKET,
+                   const TraceHooks& hooks = TraceHooks());
+
+#endif // PHOTON_TRANSPORT_H
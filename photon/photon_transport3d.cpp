@@ -0,0 +1,193 @@
+#include "photon_transport3d.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Sensors3D makeSensorLattice(int N, SensorShape shape, float radius, const TransportConfig& config, float margin) {
+    Sensors3D sensors;
+    auto along = [&](int i, float extent) {
+        return N > 1 ? margin + i * (extent - 2 * margin) / (N - 1) : extent / 2;
+    };
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) {
+            float x = along(j, config.boxWidth);
+            float y = along(i, config.boxHeight);
+            if (shape == SENSOR_CYLINDER) {
+                float halfLength = config.boxDepth / 2 - margin;
+                sensors.push_back(makeCylinderSensor(x, y, config.boxDepth / 2, radius, halfLength, 0, 0, 1));
+                continue;
+            }
+            for (int k = 0; k < N; ++k) {
+                sensors.push_back(makeSphereSensor(x, y, along(k, config.boxDepth), radius));
+            }
+        }
+    }
+    return sensors;
+}
+
+bool check_walls_3d(float prev_x, float prev_y, float prev_z, float curr_x, float curr_y, float curr_z,
+                    float width, float height, float depth, float& wall_x, float& wall_y, float& wall_z) {
+    if (0 <= curr_x && curr_x <= width && 0 <= curr_y && curr_y <= height && 0 <= curr_z && curr_z <= depth) {
+        return false;
+    }
+
+    // The photon starts inside, so the first face the segment crosses is where it leaves
+    float d[3] = { curr_x - prev_x, curr_y - prev_y, curr_z - prev_z };
+    float p[3] = { prev_x, prev_y, prev_z };
+    float hi[3] = { width, height, depth };
+    float t = 1.0f;
+    int axis = -1;
+    for (int k = 0; k < 3; ++k) {
+        float tk = d[k] > 0 ? (hi[k] - p[k]) / d[k] : d[k] < 0 ? -p[k] / d[k] : std::numeric_limits<float>::infinity();
+        if (tk < t) {
+            t = tk;
+            axis = k;
+        }
+    }
+    t = std::max(t, 0.0f);
+    float out[3];
+    for (int k = 0; k < 3; ++k) {
+        out[k] = std::min(std::max(p[k] + t * d[k], 0.0f), hi[k]);
+    }
+    if (axis >= 0) {
+        out[axis] = d[axis] > 0 ? hi[axis] : 0.0f; // Exactly on the face
+    }
+    wall_x = out[0];
+    wall_y = out[1];
+    wall_z = out[2];
+    return true;
+}
+
+PhotonState3D emitPhoton3D(const TransportConfig& config, uint64_t id) {
+    PhotonState3D photon;
+    photon.id = id;
+    photon.x = config.emitterX;
+    photon.y = config.emitterY;
+    photon.z = config.emitterZ;
+    photon.dirX = 0.0f; // Drawn from the stream at the first step
+    photon.dirY = 0.0f;
+    photon.dirZ = 1.0f;
+    photon.pathLength = 0.0f;
+    photon.scatters = 0;
+    photon.weight = 1.0f;
+    photon.sensor = -1;
+    photon.fate = PHOTON_ACTIVE;
+    return photon;
+}
+
+void stepPhoton3D(PhotonState3D& photon, const TransportConfig& config, const SensorIndex3D& sensors,
+                  const StepDraws& draws) {
+    float prev_x = photon.x;
+    float prev_y = photon.y;
+    float prev_z = photon.z;
+
+    float samp_dist;
+    bool absorbed;
+    if (config.mode == TRANSPORT_WEIGHTED) {
+        float mu_t = 1.0f / config.meanFreePath + 1.0f / config.absorptionLength;
+        samp_dist = draws.scatter / mu_t;
+        absorbed = false;
+    } else {
+        float samp_sca = config.meanFreePath * draws.scatter;
+        float samp_abs = config.absorptionLength * draws.absorb;
+        samp_dist = std::min(samp_sca, samp_abs);
+        absorbed = samp_dist == samp_abs;
+    }
+
+    if (config.phaseTable && photon.scatters > 0) {
+        // Deflect the previous flight: the polar draw picks the deflection cosine from the phase
+        // function, the azimuth turns it around the old direction
+        float mu = samplePhase(config.phaseTable->cosine, 0.5f * (1.0f - draws.cosPolar));
+        float s = std::sqrt(std::max(0.0f, 1.0f - mu * mu));
+        float ux = photon.dirX;
+        float uy = photon.dirY;
+        float uz = photon.dirZ;
+        if (std::fabs(uz) > 0.99999f) {
+            photon.dirX = s * draws.cosAngle;
+            photon.dirY = s * draws.sinAngle;
+            photon.dirZ = uz > 0.0f ? mu : -mu;
+        } else {
+            float t = std::sqrt(1.0f - uz * uz);
+            photon.dirX = s * (ux * uz * draws.cosAngle - uy * draws.sinAngle) / t + ux * mu;
+            photon.dirY = s * (uy * uz * draws.cosAngle + ux * draws.sinAngle) / t + uy * mu;
+            photon.dirZ = -s * draws.cosAngle * t + uz * mu;
+        }
+    } else {
+        // Isotropic direction: uniform azimuth and uniform cos(polar)
+        photon.dirX = draws.sinPolar * draws.cosAngle;
+        photon.dirY = draws.sinPolar * draws.sinAngle;
+        photon.dirZ = draws.cosPolar;
+    }
+    float next_x = prev_x + samp_dist * photon.dirX;
+    float next_y = prev_y + samp_dist * photon.dirY;
+    float next_z = prev_z + samp_dist * photon.dirZ;
+
+    // Sensors lie inside the box, so a sensor on the segment is always reached before the wall
+    SensorHit3D hit = check_sensors_3d(prev_x, prev_y, prev_z, next_x, next_y, next_z, sensors);
+    float wall_x, wall_y, wall_z;
+
+    if (hit.sensor >= 0) {
+        photon.x = hit.x;
+        photon.y = hit.y;
+        photon.z = hit.z;
+        photon.sensor = hit.sensor;
+        photon.fate = PHOTON_SENSOR;
+    } else if (check_walls_3d(prev_x, prev_y, prev_z, next_x, next_y, next_z, config.boxWidth, config.boxHeight,
+                              config.boxDepth, wall_x, wall_y, wall_z)) {
+        photon.x = wall_x;
+        photon.y = wall_y;
+        photon.z = wall_z;
+        photon.fate = PHOTON_WALL;
+    } else {
+        photon.x = next_x;
+        photon.y = next_y;
+        photon.z = next_z;
+        if (absorbed) {
+            photon.fate = PHOTON_ABSORBED;
+        } else if (config.mode == TRANSPORT_WEIGHTED) {
+            captureWeighted(photon, config, draws.roulette);
+        } else {
+            photon.scatters++;
+        }
+    }
+    float dx = photon.x - prev_x;
+    float dy = photon.y - prev_y;
+    float dz = photon.z - prev_z;
+    photon.pathLength += std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+void tracePhotonRange3D(const TransportConfig& config, const SensorIndex3D& sensors, uint64_t first, uint64_t count,
+                        BatchResult& result) {
+    prepareBatchResult(result, config, sensors.size());
+
+    StepVariates variates;
+    for (uint64_t n = first; n < first + count; ++n) {
+        PhotonState3D photon = emitPhoton3D(config, n);
+        while (photon.fate == PHOTON_ACTIVE) {
+            uint32_t step = static_cast<uint32_t>(photon.scatters);
+            if (!variates.holds(n, step)) {
+                fillStepVariates3D(variates, config.seed, n, step);
+            }
+            stepPhoton3D(photon, config, sensors, variates.draws3D(step));
+            result.steps++;
+        }
+        tallyPhoton(result, photon.fate, photon.sensor, photon.weight);
+        if (config.timeBins > 0 && photon.fate == PHOTON_SENSOR) {
+            tallyArrival(result, config, photon.sensor, photon.pathLength, photon.weight);
+        }
+    }
+    result.photons += count;
+}
+
+BatchResult traceBatch3D(const TransportConfig& config, const SensorIndex3D& sensors, uint64_t photonCount,
+                         unsigned threads, const TraceHooks& hooks) {
+    TraceHooks volumeHooks = hooks;
+    volumeHooks.events = NULL;
+    ChunkMerger merger(sensors.size(), &volumeHooks);
+    traceChunks(0, photonCount, threads, sensors.size(), merger,
+                [&](uint64_t first, uint64_t count, BatchResult& part) {
+                    tracePhotonRange3D(config, sensors, first, count, part);
+                });
+    return std::move(merger.result);
+}
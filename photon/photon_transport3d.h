@@ -0,0 +1,50 @@
+#ifndef PHOTON_TRANSPORT3D_H
+#define PHOTON_TRANSPORT3D_H
+
+#include "photon_sensor_index3d.h"
+#include "photon_transport.h"
+
+// Volumetric transport in the box [0, boxWidth] x [0, boxHeight] x [0, boxDepth] of a
+// TransportConfig, with the emitter at (emitterX, emitterY, emitterZ). Optical properties, modes,
+// seeds and tallies are shared with the 2D engine; only the geometry and the direction sampling
+// differ. Step k of a photon uses the same Philox block as in 2D for the distances, the azimuth and
+// the roulette draw, plus the second block of the step for the polar angle.
+
+struct PhotonState3D {
+    uint64_t id;
+    float x;
+    float y;
+    float z;
+    float dirX; // Direction of the last flight
+    float dirY;
+    float dirZ;
+    float pathLength;
+    int scatters;
+    float weight;
+    int sensor; // Index of the sensor that stopped the photon, or -1
+    PhotonFate fate;
+};
+
+// N x N x N spheres, or N x N cylinders along z spanning the depth, margin away from the walls
+Sensors3D makeSensorLattice(int N, SensorShape shape, float radius, const TransportConfig& config, float margin);
+
+// Exit point of the segment from the box when it leaves it, the 3D counterpart of check_walls()
+bool check_walls_3d(float prev_x, float prev_y, float prev_z, float curr_x, float curr_y, float curr_z,
+                    float width, float height, float depth, float& wall_x, float& wall_y, float& wall_z);
+
+PhotonState3D emitPhoton3D(const TransportConfig& config, uint64_t id);
+
+// Advance a photon by one scatter step with the draws of that step (see stepDraws3D())
+void stepPhoton3D(PhotonState3D& photon, const TransportConfig& config, const SensorIndex3D& sensors,
+                  const StepDraws& draws);
+
+// Trace photons [first, first + count) to completion and add them to result
+void tracePhotonRange3D(const TransportConfig& config, const SensorIndex3D& sensors, uint64_t first, uint64_t count,
+                        BatchResult& result);
+
+// traceBatch() for the volume: chunked, threaded and merged in photon order. Events are not
+// recorded in 3D (the event file has no z column), so hooks.events is ignored.
+BatchResult traceBatch3D(const TransportConfig& config, const SensorIndex3D& sensors, uint64_t photonCount,
+                         unsigned threads = 1, const TraceHooks& hooks = TraceHooks());
+
+#endif // PHOTON_TRANSPORT3D_H
@@ -0,0 +1,495 @@
+#include "photon_transport.h"
+#include "photon_checkpoint.h"
+#include "photon_convergence.h"
+#include "photon_fluence.h"
+#include "photon_qmc.h"
+#include "photon_shard.h"
+#include "photon_spectral.h"
+#include "photon_sweep.h"
+#include "photon_transport3d.h"
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+
+static void printUsage()
+{
+    std::cout << "Usage: photon_batch [options]\n"
+              << "  --photons N      photons to trace (default 1000000)\n"
+              << "  --seed S         random stream key\n"
+              << "  --threads T      worker threads, 0 = all cores (default)\n"
+              << "  --kernel K       scalar or packet (default)\n"
+              << "  --sensors N      N x N sensor grid, N >= 2 (default 10)\n"
+              << "  --weighted       weighted packets with Russian roulette\n"
+              << "  --sampling S     pseudo (default) or sobol: scrambled Sobol points for the first steps of each\n"
+              << "                   photon, the seed picks the scrambling\n"
+              << "  --replicates R   split --photons (a multiple of R) into R runs with seeds S .. S + R - 1 and take\n"
+              << "                   the sensor errors from the spread of their estimates (use with --sampling sobol)\n"
+              << "  --rel-error E    trace until every watched sensor has relative error <= E (0.01, 0 = off)\n"
+              << "  --ci-width W     trace until every watched sensor's 95% interval is <= W wide\n"
+              << "  --watch I,J,...  sensors that must converge, 0 .. N * N - 1 (default all)\n"
+              << "  --max-photons N  photon cap for a converging run\n"
+              << "  --grid P=V,V,... sweep parameter P over the values, repeatable; --photons per point\n"
+              << "                   (meanFreePath, absorptionLength, emitterX, emitterY, sensorRadius, anisotropy)\n"
+              << "  --spectral FILE  emitters and wavelength bands (lines \"band <wavelength> <meanFreePath>\n"
+              << "                   <absorptionLength>\", \"emitter x,y <power> <share per band ...>\" and\n"
+              << "                   \"reference <meanFreePath>\"), all traced in one pass; --photons per emitter\n"
+              << "  --out FILE       write the sweep or spectral table to FILE instead of stdout\n"
+              << "  --events FILE    write every terminal photon event to FILE (binary, see photon_events.h)\n"
+              << "  --time-bins N    per-sensor arrival-time histograms with N bins (default 0 = off)\n"
+              << "  --bin-width T    histogram bin width in seconds (default 1)\n"
+              << "  --speed V        photon speed in meters per second (default 1)\n"
+              << "  --checkpoint F   save the run state to F periodically; resume from F if it exists\n"
+              << "                   (the checkpoint's configuration replaces the other options)\n"
+              << "  --checkpoint-every S  seconds between checkpoints (default 60)\n"
+              << "  --shards N       split the --photons run into N slices, each tallied to its own file, and\n"
+              << "                   trace every slice not yet claimed by another process (merge with photon_merge)\n"
+              << "  --shard K        trace only slice K (0 .. N-1), e.g. to finish the slice of a crashed process\n"
+              << "  --shard-dir D    directory of the slice tally and claim files, shared by the processes\n"
+              << "                   (default .)\n"
+              << "  --fluence FILE   tally the fluence on a grid over the box and write it to FILE as raw floats\n"
+              << "                   (fluence per photon, rows from y = 0, x fastest)\n"
+              << "  --fluence-cells X,Y  fluence grid size (default 125,165, 0.2 m cells)\n"
+              << "  --emitter X,Y    emitter position (default 12,17)\n"
+              << "  --radius R       sensor radius (default 0.075)\n"
+              << "  --anisotropy G   Henyey-Greenstein scattering with mean deflection cosine G (default isotropic)\n"
+              << "  --scene FILE     obstacles and wall materials (lines \"polygon|polyline\n"
+              << "                   absorbing|specular|diffuse [reflectance] x,y x,y ...\" and\n"
+              << "                   \"walls <material> [reflectance]\")\n"
+              << "  --3d             volumetric transport in a box of the given --depth (default 25)\n"
+              << "  --depth D        box depth for --3d; the emitter sits at half the depth\n"
+              << "  --shape S        3D sensors: sphere (N x N x N lattice, default) or cylinder\n"
+              << "                   (N x N tubes along z)\n";
+}
+
+// Trace result up to photonTarget photons. With a checkpoint path the merged tallies are saved every
+// checkpointEvery seconds (on another thread) and once more at the end, so a finished run stays
+// resumable: starting it again only prints the tallies. A slice of a sharded run passes the size
+// of the whole run, which its checkpoints record for photon_merge.
+static void traceCheckpointed(const TransportConfig& config, const SensorCenters& layout, const SensorIndex& sensors,
+                              BatchResult& result, uint64_t photonTarget, unsigned threads, TraceKernel kernel,
+                              EventStreamWriter& events, const std::string& checkpointPath, double checkpointEvery,
+                              uint64_t runPhotons = 0, uint32_t shardCount = 1)
+{
+    TraceHooks hooks;
+    hooks.events = events.isOpen() ? &events : NULL;
+
+    std::unique_ptr<CheckpointWriter> checkpoints;
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    auto snapshot = [&](const BatchResult& tallies) {
+        Checkpoint checkpoint;
+        checkpoint.config = config;
+        checkpoint.sensors = layout;
+        checkpoint.tallies = tallies;
+        checkpoint.photonTarget = photonTarget;
+        checkpoint.runPhotons = runPhotons > 0 ? runPhotons : result.firstPhoton + photonTarget;
+        checkpoint.shardCount = shardCount;
+        checkpoint.eventBytes = events.sync();
+        if (!events.good()) return; // The event file is broken, so no checkpoint may point into it
+        checkpoint.eventCount = events.eventCount();
+        checkpoints->submit(checkpoint);
+    };
+    if (!checkpointPath.empty()) {
+        checkpoints.reset(new CheckpointWriter(checkpointPath));
+        hooks.merged = [&](const BatchResult& tallies) {
+            auto now = std::chrono::steady_clock::now();
+            if (std::chrono::duration<double>(now - lastCheckpoint).count() >= checkpointEvery) {
+                lastCheckpoint = now;
+                snapshot(tallies);
+            }
+        };
+    }
+
+    continueBatch(config, sensors, result, photonTarget - result.photons, threads, kernel, hooks);
+    if (checkpoints) {
+        snapshot(result);
+        checkpoints->flush();
+        if (checkpoints->failures() > 0) {
+            std::cerr << checkpoints->failures() << " checkpoints could not be written to " << checkpointPath
+                      << std::endl;
+        }
+    }
+}
+
+// Trace slices of a photonCount run into tally files under dir: slice shard, or with shard < 0
+// every slice that no other process has claimed yet. A slice whose tally file exists resumes from it.
+static int runShards(const TransportConfig& config, const SensorCenters& layout, uint64_t photonCount, int shard,
+                     uint32_t shardCount, const std::string& dir, unsigned threads, TraceKernel kernel,
+                     double checkpointEvery)
+{
+    EventStreamWriter noEvents;
+    for (uint32_t k = 0; k < shardCount; ++k) {
+        if (shard >= 0 ? k != static_cast<uint32_t>(shard) : !claimShard(dir, k, shardCount)) continue;
+
+        std::string path = shardPath(dir, k, shardCount);
+        ShardRange range = shardRange(photonCount, k, shardCount);
+        Checkpoint state;
+        if (loadCheckpoint(path, state)) {
+            std::cerr << "Resuming " << path << " at photon " << state.tallies.firstPhoton + state.tallies.photons
+                      << std::endl;
+        } else {
+            state.config = config;
+            state.sensors = layout;
+            state.photonTarget = range.count;
+            state.runPhotons = photonCount;
+            state.shardCount = shardCount;
+            initBatchResult(state.tallies, layout.size());
+            state.tallies.firstPhoton = range.first;
+        }
+        uint64_t resumedPhotons = state.tallies.photons;
+
+        auto start = std::chrono::steady_clock::now();
+        SensorIndex sensors = buildSensorIndex(state.sensors, state.config.sensorRadius);
+        traceCheckpointed(state.config, state.sensors, sensors, state.tallies, state.photonTarget, threads, kernel,
+                          noEvents, path, checkpointEvery, state.runPhotons, state.shardCount);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // shard <index> <first photon> <photons> <seconds> <photons/s>
+        std::cout << "shard " << k << " " << state.tallies.firstPhoton << " " << state.tallies.photons << " "
+                  << seconds << " " << (state.tallies.photons - resumedPhotons) / seconds << std::endl;
+    }
+    return 0;
+}
+
+// Volumetric run: same tallies as the 2D run, sensors reported with their centers in 3D
+static int runVolume(const TransportConfig& config, int sensorsPerSide, SensorShape shape, uint64_t photonCount,
+                     unsigned threads)
+{
+    SensorIndex3D sensors = buildSensorIndex3D(
+        makeSensorLattice(sensorsPerSide, shape, config.sensorRadius, config, SENSOR_MARGIN));
+
+    auto start = std::chrono::steady_clock::now();
+    BatchResult result = traceBatch3D(config, sensors, photonCount, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "photons " << result.photons << "\n";
+    std::cout << "steps " << result.steps << "\n";
+    std::cout << "wall " << result.wallLosses << "\n";
+    std::cout << "absorbed " << result.absorbed << "\n";
+    // sensor <index> <x> <y> <z> <hits> <detected fraction> <standard error>
+    for (size_t i = 0; i < result.sensorHits.size(); ++i) {
+        const Sensor3D& sensor = sensors.sensors[i];
+        SensorEstimate estimate = sensorEstimate(result, i);
+        std::cout << "sensor " << i << " " << sensor.x << " " << sensor.y << " " << sensor.z << " "
+                  << result.sensorHits[i] << " " << estimate.mean << " " << estimate.stdError << "\n";
+    }
+    writeArrivals(std::cout, result);
+    std::cout << "seconds " << seconds << " (" << result.photons / seconds << " photons/s)" << std::endl;
+    return 0;
+}
+
+// Headless photon transport: traces a batch of photons and prints the tallies
+int main(int argc, char** argv)
+{
+    TransportConfig config;
+    uint64_t photonCount = 1000000;
+    unsigned threads = 0; // All cores
+    TraceKernel kernel = TRACE_PACKET;
+    int sensorsPerSide = 10;
+    ConvergenceCriteria criteria;
+    bool converge = false;
+    std::vector<std::pair<std::string, std::vector<float>>> sweepAxes;
+    std::string sweepOut;
+    std::string eventsPath;
+    std::string checkpointPath;
+    double checkpointEvery = 60.0;
+    uint32_t shardCount = 0;
+    int shard = -1; // Every unclaimed slice
+    std::string shardDir = ".";
+    std::string fluencePath;
+    std::string scenePath;
+    std::string spectralPath;
+    int replicates = 1;
+    bool volume = false;
+    SensorShape shape = SENSOR_SPHERE;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--photons" && hasValue) photonCount = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--seed" && hasValue) config.seed = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::strtoul(argv[++i], NULL, 10));
+        else if (arg == "--kernel" && hasValue) {
+            kernel = std::strcmp(argv[++i], "scalar") == 0 ? TRACE_SCALAR : TRACE_PACKET;
+        } else if (arg == "--sensors" && hasValue) sensorsPerSide = std::atoi(argv[++i]);
+        else if (arg == "--weighted") config.mode = TRANSPORT_WEIGHTED;
+        else if (arg == "--sampling" && hasValue) {
+            config.sampling = std::strcmp(argv[++i], "sobol") == 0 ? SAMPLING_SOBOL : SAMPLING_PSEUDO;
+        } else if (arg == "--replicates" && hasValue) replicates = std::atoi(argv[++i]);
+        else if (arg == "--rel-error" && hasValue) {
+            criteria.targetRelativeError = std::atof(argv[++i]);
+            converge = true;
+        } else if (arg == "--ci-width" && hasValue) {
+            criteria.targetInterval = std::atof(argv[++i]);
+            converge = true;
+        } else if (arg == "--watch" && hasValue) {
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                char* endPtr;
+                long sensor = std::strtol(item.c_str(), &endPtr, 10);
+                if (endPtr == item.c_str() || *endPtr != '\0' || sensor < 0) {
+                    printUsage();
+                    return -1;
+                }
+                criteria.sensors.push_back(sensor > INT_MAX ? INT_MAX : static_cast<int>(sensor)); // Checked below
+            }
+            converge = true;
+        } else if (arg == "--max-photons" && hasValue) criteria.maxPhotons = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--grid" && hasValue) {
+            std::string spec = argv[++i];
+            size_t eq = spec.find('=');
+            TransportConfig probe;
+            if (eq == std::string::npos || !setSweepParameter(probe, spec.substr(0, eq), 0)) {
+                printUsage();
+                return -1;
+            }
+            std::stringstream list(spec.substr(eq + 1));
+            std::string item;
+            std::vector<float> values;
+            while (std::getline(list, item, ',')) values.push_back(static_cast<float>(std::atof(item.c_str())));
+            sweepAxes.push_back(std::make_pair(spec.substr(0, eq), values));
+        } else if (arg == "--out" && hasValue) sweepOut = argv[++i];
+        else if (arg == "--events" && hasValue) eventsPath = argv[++i];
+        else if (arg == "--time-bins" && hasValue) config.timeBins = std::atoi(argv[++i]);
+        else if (arg == "--bin-width" && hasValue) config.timeBinWidth = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--speed" && hasValue) config.photonSpeed = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--checkpoint" && hasValue) checkpointPath = argv[++i];
+        else if (arg == "--checkpoint-every" && hasValue) checkpointEvery = std::atof(argv[++i]);
+        else if (arg == "--shards" && hasValue) shardCount = static_cast<uint32_t>(std::strtoul(argv[++i], NULL, 10));
+        else if (arg == "--shard" && hasValue) shard = std::atoi(argv[++i]);
+        else if (arg == "--shard-dir" && hasValue) shardDir = argv[++i];
+        else if (arg == "--anisotropy" && hasValue) {
+            setPhaseFunction(config, PHASE_HENYEY_GREENSTEIN, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--fluence" && hasValue) {
+            fluencePath = argv[++i];
+            if (config.fluenceCellsX == 0) {
+                config.fluenceCellsX = 125;
+                config.fluenceCellsY = 165;
+            }
+        } else if (arg == "--fluence-cells" && hasValue) {
+            if (std::sscanf(argv[++i], "%d,%d", &config.fluenceCellsX, &config.fluenceCellsY) != 2 ||
+                config.fluenceCellsX <= 0 || config.fluenceCellsY <= 0) {
+                printUsage();
+                return -1;
+            }
+        } else if (arg == "--emitter" && hasValue) {
+            if (std::sscanf(argv[++i], "%f,%f", &config.emitterX, &config.emitterY) != 2) {
+                printUsage();
+                return -1;
+            }
+        } else if (arg == "--radius" && hasValue) config.sensorRadius = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--scene" && hasValue) scenePath = argv[++i];
+        else if (arg == "--spectral" && hasValue) spectralPath = argv[++i];
+        else if (arg == "--3d") volume = true;
+        else if (arg == "--depth" && hasValue) {
+            config.boxDepth = static_cast<float>(std::atof(argv[++i]));
+            config.emitterZ = config.boxDepth / 2;
+        } else if (arg == "--shape" && hasValue) {
+            shape = std::strcmp(argv[++i], "cylinder") == 0 ? SENSOR_CYLINDER : SENSOR_SPHERE;
+        } else {
+            printUsage();
+            return -1;
+        }
+    }
+
+    // A 2D grid spaces its sensors over N - 1 gaps; a 3D lattice centres a single sensor
+    if (sensorsPerSide < (volume ? 1 : 2)) {
+        printUsage();
+        return -1;
+    }
+    std::string error;
+    if (!checkTransportConfig(config, error)) {
+        std::cerr << "Invalid settings: " << error << std::endl;
+        return -1;
+    }
+
+    if (!scenePath.empty()) {
+        Scene scene;
+        if (!loadScene(scenePath, config.boxWidth, config.boxHeight, scene, error)) {
+            std::cerr << "Cannot load the scene: " << error << std::endl;
+            return -1;
+        }
+        config.scene = std::make_shared<const Scene>(std::move(scene));
+    }
+    if (replicates < 1) {
+        printUsage();
+        return -1;
+    }
+    if (replicates > 1 && (converge || !sweepAxes.empty() || !eventsPath.empty() || !checkpointPath.empty() ||
+                           shardCount > 0 || shard >= 0 || volume)) {
+        std::cerr << "--replicates only works for plain 2D runs of a fixed --photons count" << std::endl;
+        return -1;
+    }
+    if (photonCount % replicates != 0) {
+        // Each replicate traces the same number of photons, so the total printed is the one asked for
+        std::cerr << "--photons must be a multiple of --replicates" << std::endl;
+        return -1;
+    }
+    if (config.sampling == SAMPLING_SOBOL && converge) {
+        // The stopping rule trusts the per-photon variance, which does not describe Sobol sampling
+        std::cerr << "Convergence targets need pseudo-random sampling; use --replicates for Sobol error bars"
+                  << std::endl;
+        return -1;
+    }
+
+    if (volume) {
+        if (converge || !sweepAxes.empty() || !eventsPath.empty() || !checkpointPath.empty() || shardCount > 0 ||
+            shard >= 0 || config.fluenceCellsX > 0 || config.sampling != SAMPLING_PSEUDO || config.scene ||
+            !spectralPath.empty()) {
+            std::cerr << "--3d runs support neither sweeps, convergence, events, checkpoints, shards, fluence grids, "
+                      << "Sobol sampling, scenes nor spectral setups" << std::endl;
+            return -1;
+        }
+        return runVolume(config, sensorsPerSide, shape, photonCount, threads);
+    }
+
+    SensorCenters layout = makeSensorGrid(sensorsPerSide, config.boxWidth, config.boxHeight, SENSOR_MARGIN);
+    for (int sensor : criteria.sensors) {
+        if (static_cast<size_t>(sensor) >= layout.size()) {
+            printUsage();
+            return -1;
+        }
+    }
+
+    if (!spectralPath.empty()) {
+        if (config.mode == TRANSPORT_WEIGHTED || converge || replicates > 1 || !sweepAxes.empty() ||
+            !eventsPath.empty() || !checkpointPath.empty() || shardCount > 0 || shard >= 0 || !fluencePath.empty()) {
+            // The bands' weights replace the transport mode, and one pass tallies many runs
+            std::cerr << "--spectral runs support neither --weighted, convergence, replicates, sweeps, events, "
+                      << "checkpoints, shards nor fluence grids" << std::endl;
+            return -1;
+        }
+        SpectralSetup setup;
+        if (!loadSpectralSetup(spectralPath, setup, error)) {
+            std::cerr << "Cannot load the spectral setup: " << error << std::endl;
+            return -1;
+        }
+        for (const SpectralEmitter& emitter : setup.emitters) {
+            if (!insideBox(config, emitter.x, emitter.y)) {
+                std::cerr << "Emitter " << emitter.x << "," << emitter.y << " lies outside the box" << std::endl;
+                return -1;
+            }
+        }
+        SensorIndex sensors = buildSensorIndex(layout, config.sensorRadius);
+        auto start = std::chrono::steady_clock::now();
+        SpectralResult result = traceSpectral(config, setup, sensors, photonCount, threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (sweepOut.empty()) {
+            writeSpectralTable(std::cout, setup, result, layout);
+        } else {
+            std::ofstream file(sweepOut);
+            writeSpectralTable(file, setup, result, layout);
+        }
+        std::cerr << setup.emitters.size() << " emitters x " << setup.bands.size() << " bands in " << seconds
+                  << " seconds" << std::endl;
+        return 0;
+    }
+
+    if (!sweepAxes.empty()) {
+        if (!fluencePath.empty()) {
+            std::cerr << "Sweeps do not write fluence grids" << std::endl;
+            return -1;
+        }
+        std::vector<TransportConfig> points;
+        if (!sweepGrid(config, sweepAxes, points, error)) {
+            std::cerr << "Invalid " << error << std::endl;
+            return -1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::vector<SweepResult> results = runSweep(points, layout, photonCount, threads, kernel);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (sweepOut.empty()) {
+            writeSweepTable(std::cout, results);
+        } else {
+            std::ofstream file(sweepOut);
+            writeSweepTable(file, results);
+        }
+        std::cerr << results.size() << " points in " << seconds << " seconds" << std::endl;
+        return 0;
+    }
+
+    if (shardCount > 0 || shard >= 0) {
+        if (shard >= static_cast<int>(shardCount) || converge || !eventsPath.empty() || !checkpointPath.empty() ||
+            !fluencePath.empty()) {
+            std::cerr << "--shard needs --shards above it; sharded runs checkpoint to their tally files (fluence "
+                      << "grids included, written by photon_merge) and support neither convergence nor events"
+                      << std::endl;
+            return -1;
+        }
+        return runShards(config, layout, photonCount, shard, shardCount, shardDir, threads, kernel, checkpointEvery);
+    }
+
+    // Pick up an interrupted run where its last checkpoint left off
+    BatchResult result;
+    Checkpoint resumed;
+    if (!checkpointPath.empty() && loadCheckpoint(checkpointPath, resumed)) {
+        if (converge) {
+            std::cerr << "Checkpoints only work for runs with a fixed --photons count" << std::endl;
+            return -1;
+        }
+        config = resumed.config;
+        layout = resumed.sensors;
+        photonCount = resumed.photonTarget;
+        result = resumed.tallies;
+        std::cerr << "Resuming " << checkpointPath << " at photon " << result.photons << " of " << photonCount
+                  << std::endl;
+    } else if (!checkpointPath.empty() && converge) {
+        std::cerr << "Checkpoints only work for runs with a fixed --photons count" << std::endl;
+        return -1;
+    }
+    uint64_t resumedPhotons = result.photons;
+
+    SensorIndex sensors = buildSensorIndex(layout, config.sensorRadius);
+
+    EventStreamWriter events;
+    if (!eventsPath.empty()) {
+        uint32_t sensorCount = static_cast<uint32_t>(sensors.size());
+        bool opened = resumed.eventBytes > 0 ? events.reopen(eventsPath, resumed.eventBytes, resumed.eventCount)
+                                             : events.open(eventsPath, config.seed, sensorCount);
+        if (!opened) {
+            std::cerr << "Cannot write " << eventsPath << std::endl;
+            return -1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<SensorEstimate> estimates; // From the tallies unless replicated
+    if (converge) {
+        TraceHooks hooks;
+        hooks.events = events.isOpen() ? &events : NULL;
+        ConvergenceResult run = traceUntilConverged(config, sensors, criteria, threads, kernel, hooks);
+        result = run.tallies;
+        std::cout << "converged " << (run.converged ? "yes" : "no") << " after " << run.rounds << " rounds, "
+                  << "worst relative error " << run.worstRelativeError << "\n";
+    } else if (replicates > 1) {
+        ReplicateResult run = traceReplicates(config, sensors, photonCount / replicates, replicates, threads, kernel);
+        result = run.tallies;
+        estimates = run.estimates;
+    } else {
+        traceCheckpointed(config, layout, sensors, result, photonCount, threads, kernel, events, checkpointPath,
+                          checkpointEvery);
+    }
+    bool eventsWritten = events.close();
+    if (!eventsWritten) {
+        std::cerr << "Cannot write " << eventsPath << "; the event file is incomplete" << std::endl;
+    }
+    if (!fluencePath.empty() && !writeFluenceRaw(fluencePath, result, config)) {
+        std::cerr << "Cannot write " << fluencePath << std::endl;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    writeTallies(std::cout, result, layout);
+    std::cout << "seconds " << seconds << " (" << (result.photons - resumedPhotons) / seconds << " photons/s)"
+              << std::endl;
+
+    return eventsWritten ? 0 : -1;
+}
@@ -0,0 +1,427 @@
+#include "photon_transport.h"
+#include "photon_math.h"
+#include "photon_rng.h"
+#include "photon_spectral.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SEGMENTS 4096 // Test segments cycled through by the geometry benchmarks
+
+// One measured configuration
+struct BenchRow {
+    std::string name;
+    std::string parameter;
+    double nsPerOp; // Median over the repeats
+    double opsPerSecond;
+    double photonsPerSecond; // 0 for benchmarks that do not trace photons
+};
+
+struct BenchOptions {
+    double minSeconds; // Minimum duration of one timed repeat
+    int repeats;
+    std::string filter; // Only benchmarks whose name contains this
+    unsigned maxThreads;
+    uint64_t photons; // Photons per traced repeat
+};
+
+static volatile float sink; // Results land here so the timed loops cannot be optimised away
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Time body(n) for n operations: grow n until one call lasts minSeconds, then keep the
+// median ns/op of the repeats
+static double timeOps(const BenchOptions& options, const std::function<void(uint64_t)>& body)
+{
+    uint64_t n = 1;
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        body(n);
+        double seconds = secondsSince(start);
+        if (seconds >= options.minSeconds) break;
+        double scale = seconds > 0.0 ? 1.4 * options.minSeconds / seconds : 10.0;
+        n = static_cast<uint64_t>(n * std::min(10.0, std::max(2.0, scale)));
+    }
+
+    std::vector<double> samples;
+    for (int r = 0; r < options.repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        body(n);
+        samples.push_back(secondsSince(start) * 1e9 / n);
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Random segments inside and around the default box, with the lengths of real scatter steps
+static std::vector<float> makeSegments(const TransportConfig& config)
+{
+    std::vector<float> segments;
+    for (uint32_t i = 0; i < SEGMENTS; ++i) {
+        PhiloxBlock block = philox4x32(i, 0, 0, 0, 0x5eed, 0);
+        float x = uniformFloat(block.v[0]) * config.boxWidth;
+        float y = uniformFloat(block.v[1]) * config.boxHeight;
+        float s, c;
+        photonSinCos2Pi(uniformFloat(block.v[2]), s, c);
+        float length = -config.meanFreePath * photonLog(uniformOpenFloat(block.v[3]));
+        segments.push_back(x);
+        segments.push_back(y);
+        segments.push_back(x + length * c);
+        segments.push_back(y + length * s);
+    }
+    return segments;
+}
+
+static void benchWalls(const BenchOptions& options, std::vector<BenchRow>& rows)
+{
+    TransportConfig config;
+    std::vector<float> segments = makeSegments(config);
+    double ns = timeOps(options, [&](uint64_t n) {
+        float total = 0.0f;
+        for (uint64_t i = 0; i < n; ++i) {
+            const float* s = &segments[(i % SEGMENTS) * 4];
+            auto hit = check_walls(s[0], s[1], s[2], s[3], config.boxWidth, config.boxHeight);
+            total += std::get<1>(hit).first;
+        }
+        sink = total;
+    });
+    rows.push_back(BenchRow{ "check_walls", "", ns, 1e9 / ns, 0.0 });
+}
+
+static void benchSensors(const BenchOptions& options, std::vector<BenchRow>& rows)
+{
+    TransportConfig config;
+    std::vector<float> segments = makeSegments(config);
+    const int sides[] = { 1, 3, 10, 32, 100 };
+    for (int side : sides) {
+        SensorCenters centers = side > 1 ? makeSensorGrid(side, config.boxWidth, config.boxHeight, SENSOR_MARGIN)
+                                         : SensorCenters(1, std::make_pair(config.boxWidth / 2, config.boxHeight / 2));
+        SensorIndex index = buildSensorIndex(centers, config.sensorRadius);
+        std::string parameter = std::to_string(centers.size()) + " sensors";
+
+        double ns = timeOps(options, [&](uint64_t n) {
+            int total = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                const float* s = &segments[(i % SEGMENTS) * 4];
+                total += std::get<1>(check_sensors(s[0], s[1], s[2], s[3], index));
+            }
+            sink = static_cast<float>(total);
+        });
+        rows.push_back(BenchRow{ "check_sensors", parameter, ns, 1e9 / ns, 0.0 });
+
+        // The linear scan is the reference the grid replaced; skip it where it takes too long to matter
+        if (centers.size() > 1024) continue;
+        ns = timeOps(options, [&](uint64_t n) {
+            int total = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                const float* s = &segments[(i % SEGMENTS) * 4];
+                total += std::get<1>(check_sensors(s[0], s[1], s[2], s[3], centers, config.sensorRadius));
+            }
+            sink = static_cast<float>(total);
+        });
+        rows.push_back(BenchRow{ "check_sensors_linear", parameter, ns, 1e9 / ns, 0.0 });
+    }
+}
+
+// Absorbing round pillars of 64 edges each at random places in the default box
+static Scene makePillarScene(const TransportConfig& config, int edges)
+{
+    std::vector<SceneEdge> pillars;
+    for (uint32_t p = 0; p < static_cast<uint32_t>(edges / 64); ++p) {
+        PhiloxBlock block = philox4x32(p, 0, 0, 0, 0x5ce2e, 0);
+        float x = 1.0f + uniformFloat(block.v[0]) * (config.boxWidth - 2.0f);
+        float y = 1.0f + uniformFloat(block.v[1]) * (config.boxHeight - 2.0f);
+        float radius = 0.1f + 0.4f * uniformFloat(block.v[2]);
+        for (int k = 0; k < 64; ++k) {
+            float s0, c0, s1, c1;
+            photonSinCos2Pi(k / 64.0f, s0, c0);
+            photonSinCos2Pi((k + 1) / 64.0f, s1, c1);
+            SceneEdge edge = { x + radius * c0, y + radius * s0, x + radius * c1, y + radius * s1,
+                               SURFACE_ABSORBING, 1.0f };
+            pillars.push_back(edge);
+        }
+    }
+    return buildScene(pillars);
+}
+
+// Nearest obstacle edge on a segment, through the BVH and by the linear scan, then whole
+// histories in the largest scene
+static void benchScene(const BenchOptions& options, std::vector<BenchRow>& rows)
+{
+    TransportConfig config;
+    std::vector<float> segments = makeSegments(config);
+    const int sizes[] = { 64, 512, 4096 };
+    for (int edges : sizes) {
+        Scene scene = makePillarScene(config, edges);
+        std::string parameter = std::to_string(edges) + " edges";
+        double ns = timeOps(options, [&](uint64_t n) {
+            int total = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                const float* s = &segments[(i % SEGMENTS) * 4];
+                total += intersectScene(scene, s[0], s[1], s[2], s[3], -1).edge;
+            }
+            sink = static_cast<float>(total);
+        });
+        rows.push_back(BenchRow{ "scene_query", parameter, ns, 1e9 / ns, 0.0 });
+
+        if (edges > 512) continue;
+        ns = timeOps(options, [&](uint64_t n) {
+            int total = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                const float* s = &segments[(i % SEGMENTS) * 4];
+                total += intersectEdges(scene.edges, s[0], s[1], s[2], s[3], -1).edge;
+            }
+            sink = static_cast<float>(total);
+        });
+        rows.push_back(BenchRow{ "scene_query_linear", parameter, ns, 1e9 / ns, 0.0 });
+    }
+
+    SensorIndex sensors = buildSensorIndex(makeSensorGrid(10, config.boxWidth, config.boxHeight, SENSOR_MARGIN),
+                                           config.sensorRadius);
+    config.scene = std::make_shared<const Scene>(makePillarScene(config, 4096));
+    uint64_t first = 0;
+    double ns = timeOps(options, [&](uint64_t n) {
+        BatchResult result;
+        traceRange(config, sensors, first, n, TRACE_SCALAR, result);
+        first += n;
+        sink = static_cast<float>(result.steps);
+    });
+    rows.push_back(BenchRow{ "photon_history", "scalar, 4096 edges", ns, 1e9 / ns, 1e9 / ns });
+}
+
+// The per-step draws of stepPhoton(): one Philox block, two logarithms and a direction
+static void benchSampling(const BenchOptions& options, std::vector<BenchRow>& rows)
+{
+    TransportConfig config;
+    double ns = timeOps(options, [&](uint64_t n) {
+        float total = 0.0f;
+        for (uint64_t i = 0; i < n; ++i) {
+            PhiloxBlock block = photonStepBlock(config.seed, i, 0);
+            float s, c;
+            photonSinCos2Pi(uniformFloat(block.v[2]), s, c);
+            float sca = -config.meanFreePath * photonLog(uniformOpenFloat(block.v[0]));
+            float absorption = -config.absorptionLength * photonLog(uniformOpenFloat(block.v[1]));
+            total += std::min(sca, absorption) * c + s;
+        }
+        sink = total;
+    });
+    rows.push_back(BenchRow{ "sampling", "philox+log+sincos", ns, 1e9 / ns, 0.0 });
+
+    ns = timeOps(options, [&](uint64_t n) {
+        uint32_t total = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            total += photonStepBlock(config.seed, i, 0).v[0];
+        }
+        sink = static_cast<float>(total);
+    });
+    rows.push_back(BenchRow{ "sampling", "philox", ns, 1e9 / ns, 0.0 });
+
+    // The same draws in blocks of consecutive steps, as the scalar kernel consumes them
+    StepVariates variates;
+    ns = timeOps(options, [&](uint64_t n) {
+        float total = 0.0f;
+        for (uint64_t i = 0; i < n; i += PHOTON_VARIATE_BLOCK) {
+            fillStepVariates(variates, config.seed, i, 0);
+            for (int j = 0; j < PHOTON_VARIATE_BLOCK; ++j) {
+                total += std::min(config.meanFreePath * variates.scatter[j],
+                                  config.absorptionLength * variates.absorb[j]) * variates.cosAngle[j] +
+                         variates.sinAngle[j];
+            }
+        }
+        sink = total;
+    });
+    rows.push_back(BenchRow{ "sampling", "bulk block", ns, 1e9 / ns, 0.0 });
+}
+
+// Whole photon histories: both kernels on one thread, in both transport modes
+static void benchHistories(const BenchOptions& options, std::vector<BenchRow>& rows)
+{
+    SensorIndex sensors = buildSensorIndex(makeSensorGrid(10, 25.0f, 33.0f, SENSOR_MARGIN), 0.075f);
+    const TraceKernel kernels[] = { TRACE_SCALAR, TRACE_PACKET };
+    const TransportMode modes[] = { TRANSPORT_ANALOG, TRANSPORT_WEIGHTED };
+    for (TransportMode mode : modes) {
+        for (TraceKernel kernel : kernels) {
+            if (mode == TRANSPORT_WEIGHTED && kernel == TRACE_PACKET) continue; // Falls back to scalar
+            TransportConfig config;
+            config.mode = mode;
+            uint64_t first = 0;
+            double ns = timeOps(options, [&](uint64_t n) {
+                BatchResult result;
+                traceRange(config, sensors, first, n, kernel, result);
+                first += n; // Fresh photons every call
+                sink = static_cast<float>(result.steps);
+            });
+            std::string parameter = std::string(kernel == TRACE_PACKET ? "packet" : "scalar") +
+                                    (mode == TRANSPORT_WEIGHTED ? " weighted" : " analog");
+            rows.push_back(BenchRow{ "photon_history", parameter, ns, 1e9 / ns, 1e9 / ns });
+        }
+    }
+}
+
+// traceBatch() throughput on 1, 2, 4, ... threads
+static void benchScaling(const BenchOptions& options, std::vector<BenchRow>& rows)
+{
+    TransportConfig config;
+    SensorIndex sensors = buildSensorIndex(makeSensorGrid(10, config.boxWidth, config.boxHeight, SENSOR_MARGIN),
+                                           config.sensorRadius);
+    std::vector<unsigned> counts;
+    for (unsigned t = 1; t < options.maxThreads; t *= 2) counts.push_back(t);
+    counts.push_back(options.maxThreads);
+
+    for (unsigned threads : counts) {
+        std::vector<double> samples;
+        for (int r = 0; r < options.repeats; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            BatchResult result = traceBatch(config, sensors, options.photons, threads, TRACE_PACKET);
+            samples.push_back(secondsSince(start) * 1e9 / options.photons);
+            sink = static_cast<float>(result.steps);
+        }
+        std::sort(samples.begin(), samples.end());
+        double ns = samples[samples.size() / 2];
+        rows.push_back(BenchRow{ "trace_batch", std::to_string(threads) + " threads", ns, 1e9 / ns, 1e9 / ns });
+    }
+}
+
+// Eight wavelength bands of one emitter: one spectral pass against a separate analog run per band.
+// An op is one photon in one band.
+static void benchSpectral(const BenchOptions& options, std::vector<BenchRow>& rows)
+{
+    TransportConfig config;
+    SensorIndex sensors = buildSensorIndex(makeSensorGrid(10, config.boxWidth, config.boxHeight, SENSOR_MARGIN),
+                                           config.sensorRadius);
+    SpectralSetup setup;
+    SpectralEmitter emitter = { config.emitterX, config.emitterY, 1.0f, std::vector<float>() };
+    for (int b = 0; b < 8; ++b) {
+        setup.bands.push_back(SpectralBand{ 400.0f + 40.0f * b, 4.0f + b, 8.0f + 2.0f * b });
+        emitter.spectrum.push_back(1.0f / 8);
+    }
+    setup.emitters.push_back(emitter);
+    const double bands = static_cast<double>(setup.bands.size());
+
+    double ns = timeOps(options, [&](uint64_t n) {
+        SpectralResult result = traceSpectral(config, setup, sensors, n, 1);
+        sink = static_cast<float>(result.mixed[0].steps);
+    }) / bands;
+    rows.push_back(BenchRow{ "spectral", "8 bands, one pass", ns, 1e9 / ns, 1e9 / ns });
+
+    uint64_t first = 0;
+    ns = timeOps(options, [&](uint64_t n) {
+        for (const SpectralBand& band : setup.bands) {
+            TransportConfig run = config;
+            run.meanFreePath = band.meanFreePath;
+            run.absorptionLength = band.absorptionLength;
+            BatchResult result;
+            traceRange(run, sensors, first, n, TRACE_SCALAR, result);
+            sink = static_cast<float>(result.steps);
+        }
+        first += n;
+    }) / bands;
+    rows.push_back(BenchRow{ "spectral", "8 bands, separate", ns, 1e9 / ns, 1e9 / ns });
+}
+
+static void printText(const std::vector<BenchRow>& rows)
+{
+    double base = 0.0;
+    for (const BenchRow& row : rows) {
+        std::cout << row.name;
+        for (size_t i = row.name.size(); i < 22; ++i) std::cout << ' ';
+        std::cout << row.parameter;
+        for (size_t i = row.parameter.size(); i < 20; ++i) std::cout << ' ';
+        std::cout << row.nsPerOp << " ns/op";
+        if (row.photonsPerSecond > 0.0) std::cout << "  " << row.photonsPerSecond << " photons/s";
+        if (row.name == "trace_batch") {
+            if (base == 0.0) base = row.photonsPerSecond;
+            std::cout << "  speedup " << row.photonsPerSecond / base;
+        }
+        std::cout << "\n";
+    }
+}
+
+// One JSON object per line, so results of several versions can simply be concatenated
+static void printJson(const std::vector<BenchRow>& rows, const BenchOptions& options)
+{
+    for (const BenchRow& row : rows) {
+        std::cout << "{\"bench\":\"" << row.name << "\",\"param\":\"" << row.parameter << "\",\"ns_per_op\":"
+                  << row.nsPerOp << ",\"ops_per_s\":" << row.opsPerSecond << ",\"photons_per_s\":"
+                  << row.photonsPerSecond << ",\"lanes\":" << packetLanes() << ",\"repeats\":" << options.repeats
+                  << "}\n";
+    }
+}
+
+static void printUsage()
+{
+    std::cout << "Usage: photon_bench [options]\n"
+              << "  --filter NAME    only benchmarks whose name contains NAME\n"
+              << "                   (check_walls, check_sensors, scene_query, sampling, photon_history, trace_batch,\n"
+              << "                   spectral)\n"
+              << "  --min-time S     minimum seconds per timed repeat (default 0.2)\n"
+              << "  --repeats N      timed repeats, the median is reported (default 5)\n"
+              << "  --threads T      highest thread count for trace_batch (default all cores)\n"
+              << "  --photons N      photons per trace_batch repeat (default 2000000)\n"
+              << "  --json           one JSON object per result instead of a table\n";
+}
+
+// Microbenchmarks of the transport hot path
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.minSeconds = 0.2;
+    options.repeats = 5;
+    options.maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    options.photons = 2000000;
+    bool json = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) options.filter = argv[++i];
+        else if (arg == "--min-time" && hasValue) options.minSeconds = std::atof(argv[++i]);
+        else if (arg == "--repeats" && hasValue) options.repeats = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue) options.maxThreads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--photons" && hasValue) options.photons = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--json") json = true;
+        else {
+            printUsage();
+            return -1;
+        }
+    }
+
+    struct Bench {
+        const char* name;
+        void (*run)(const BenchOptions&, std::vector<BenchRow>&);
+    };
+    const Bench benches[] = {
+        { "check_walls", benchWalls },
+        { "check_sensors", benchSensors },
+        { "scene_query", benchScene },
+        { "sampling", benchSampling },
+        { "photon_history", benchHistories },
+        { "trace_batch", benchScaling },
+        { "spectral", benchSpectral },
+    };
+
+    std::vector<BenchRow> rows;
+    for (const Bench& bench : benches) {
+        if (!options.filter.empty() && std::string(bench.name).find(options.filter) == std::string::npos) continue;
+        size_t done = rows.size();
+        bench.run(options, rows);
+        if (!json) {
+            std::vector<BenchRow> fresh(rows.begin() + done, rows.end());
+            printText(fresh);
+            std::cout.flush();
+        }
+    }
+    if (json) printJson(rows, options);
+
+    return 0;
+}
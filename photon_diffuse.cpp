@@ -0,0 +1,150 @@
+#include "photon_diffusion.h"
+#include "photon_fluence.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define CHECK_MIN_HITS 100 // Sensors with fewer Monte Carlo hits are left out of the comparison
+
+static void printUsage()
+{
+    std::cout << "Usage: photon_diffuse [options]\n"
+              << "  Per-sensor detected fractions from the diffusion approximation (see photon_diffusion.h)\n"
+              << "  --cells X,Y            grid of the solver (default 250,330, 0.1 m cells)\n"
+              << "  --mean-free-path L     scattering mean free path (default 7)\n"
+              << "  --absorption-length L  absorption mean free path (default 11)\n"
+              << "  --anisotropy G         Henyey-Greenstein mean deflection cosine (default 0)\n"
+              << "  --emitter X,Y          emitter position (default 12,17)\n"
+              << "  --sensors N            N x N sensor grid, N >= 2 (default 10)\n"
+              << "  --radius R             sensor radius (default 0.075)\n"
+              << "  --fluence FILE         write the fluence as raw floats, as photon_batch --fluence does\n"
+              << "  --check N              also trace N photons with the Monte Carlo engine and compare\n"
+              << "  --weighted             weighted Monte Carlo for --check\n"
+              << "  --seed S, --threads T  Monte Carlo stream key and worker threads (0 = all cores, default)\n";
+}
+
+int main(int argc, char** argv)
+{
+    TransportConfig config;
+    int cellsX = 250;
+    int cellsY = 330;
+    int sensorsPerSide = 10;
+    uint64_t checkPhotons = 0;
+    unsigned threads = 0;
+    float anisotropy = 0.0f;
+    std::string fluencePath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--cells" && hasValue) {
+            if (std::sscanf(argv[++i], "%d,%d", &cellsX, &cellsY) != 2 || cellsX < 2 || cellsY < 2) {
+                printUsage();
+                return -1;
+            }
+        } else if (arg == "--mean-free-path" && hasValue) {
+            config.meanFreePath = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--absorption-length" && hasValue) {
+            config.absorptionLength = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--anisotropy" && hasValue) anisotropy = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--emitter" && hasValue) {
+            if (std::sscanf(argv[++i], "%f,%f", &config.emitterX, &config.emitterY) != 2) {
+                printUsage();
+                return -1;
+            }
+        } else if (arg == "--sensors" && hasValue) sensorsPerSide = std::atoi(argv[++i]);
+        else if (arg == "--radius" && hasValue) config.sensorRadius = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--fluence" && hasValue) fluencePath = argv[++i];
+        else if (arg == "--check" && hasValue) checkPhotons = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--weighted") config.mode = TRANSPORT_WEIGHTED;
+        else if (arg == "--seed" && hasValue) config.seed = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::strtoul(argv[++i], NULL, 10));
+        else {
+            printUsage();
+            return -1;
+        }
+    }
+    if (sensorsPerSide < 2) {
+        printUsage();
+        return -1;
+    }
+    if (anisotropy != 0.0f) {
+        setPhaseFunction(config, PHASE_HENYEY_GREENSTEIN, anisotropy);
+    }
+    std::string error;
+    if (!checkTransportConfig(config, error)) {
+        std::cerr << "Invalid settings: " << error << std::endl;
+        return -1;
+    }
+
+    SensorCenters layout = makeSensorGrid(sensorsPerSide, config.boxWidth, config.boxHeight, SENSOR_MARGIN);
+    auto start = std::chrono::steady_clock::now();
+    DiffusionResult diffusion = solveDiffusion(config, layout, cellsX, cellsY);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!fluencePath.empty()) {
+        std::vector<float> values(diffusion.fluence.begin(), diffusion.fluence.end());
+        FILE* file = std::fopen(fluencePath.c_str(), "wb");
+        bool ok = file && std::fwrite(values.data(), sizeof(float), values.size(), file) == values.size();
+        if (!file || std::fclose(file) != 0 || !ok) {
+            std::cerr << "Cannot write " << fluencePath << std::endl;
+        }
+    }
+
+    BatchResult mc;
+    double mcSeconds = 0.0;
+    if (checkPhotons > 0) {
+        // Same grid for the Monte Carlo fluence, so the total track lengths can be compared
+        TransportConfig traced = config;
+        traced.fluenceCellsX = cellsX;
+        traced.fluenceCellsY = cellsY;
+        SensorIndex sensors = buildSensorIndex(layout, config.sensorRadius);
+        auto mcStart = std::chrono::steady_clock::now();
+        mc = traceBatch(traced, sensors, checkPhotons, threads);
+        mcSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mcStart).count();
+    }
+
+    std::cout << "diffusion-coefficient " << diffusionCoefficient(config) << "\n";
+    std::cout << "iterations " << diffusion.iterations << " residual " << diffusion.residual << "\n";
+    // sensor <index> <x> <y> <diffusion fraction> [<Monte Carlo fraction> <standard error>]
+    double squares = 0.0;
+    int compared = 0;
+    for (size_t i = 0; i < layout.size(); ++i) {
+        std::cout << "sensor " << i << " " << layout[i].first << " " << layout[i].second << " "
+                  << diffusion.sensorFraction[i];
+        if (checkPhotons > 0) {
+            SensorEstimate estimate = sensorEstimate(mc, i);
+            std::cout << " " << estimate.mean << " " << estimate.stdError;
+            if (mc.sensorHits[i] >= CHECK_MIN_HITS) {
+                double relative = diffusion.sensorFraction[i] / estimate.mean - 1.0;
+                squares += relative * relative;
+                compared++;
+            }
+        }
+        std::cout << "\n";
+    }
+    if (checkPhotons > 0) {
+        double cellArea = static_cast<double>(config.boxWidth) / cellsX * config.boxHeight / cellsY;
+        double diffusionTrack = 0.0;
+        for (size_t c = 0; c < diffusion.fluence.size(); ++c) {
+            diffusionTrack += diffusion.fluence[c] * cellArea;
+        }
+        double mcTrack = 0.0;
+        for (size_t c = 0; c < mc.fluence.size(); ++c) {
+            mcTrack += mc.fluence[c];
+        }
+        mcTrack /= static_cast<double>(mc.photons);
+        std::cout << "check " << compared << " sensors with " << CHECK_MIN_HITS << "+ hits, rms relative difference "
+                  << (compared > 0 ? std::sqrt(squares / compared) : 0.0) << "\n";
+        std::cout << "check track length per photon " << diffusionTrack << " diffusion, " << mcTrack
+                  << " Monte Carlo\n";
+        std::cout << "monte-carlo-seconds " << mcSeconds << "\n";
+    }
+    std::cout << "seconds " << seconds << std::endl;
+    return 0;
+}
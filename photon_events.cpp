@@ -0,0 +1,80 @@
+#include "photon_events.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage()
+{
+    std::cout << "Usage: photon_events FILE [--dump] [--sensor I]\n"
+              << "  Summarises an event file written by photon_batch --events\n"
+              << "  --dump       print every event as text instead\n"
+              << "  --sensor I   only events of sensor I\n";
+}
+
+// Scans an event file block by block through the memory map
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printUsage();
+        return -1;
+    }
+    bool dump = false;
+    bool filter = false;
+    int32_t sensor = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--dump") == 0) dump = true;
+        else if (std::strcmp(argv[i], "--sensor") == 0 && i + 1 < argc) {
+            filter = true;
+            sensor = std::atoi(argv[++i]);
+        } else {
+            printUsage();
+            return -1;
+        }
+    }
+
+    EventStreamReader reader;
+    if (!reader.open(argv[1])) {
+        std::cerr << "Cannot read " << argv[1] << std::endl;
+        return -1;
+    }
+
+    // Per target: sensors, then wall and absorbed
+    size_t sensorCount = reader.header().sensorCount;
+    std::vector<uint64_t> count(sensorCount + 2, 0);
+    std::vector<double> pathSum(sensorCount + 2, 0.0);
+    std::vector<double> scatterSum(sensorCount + 2, 0.0);
+
+    for (size_t b = 0; b < reader.blockCount(); ++b) {
+        EventBlockView block = reader.block(b);
+        for (uint32_t e = 0; e < block.count; ++e) {
+            if (filter && block.target[e] != sensor) continue;
+            if (dump) {
+                std::cout << block.id[e] << " " << block.target[e] << " " << block.x[e] << " " << block.y[e] << " "
+                          << block.pathLength[e] << " " << block.scatters[e] << " " << block.weight[e] << "\n";
+                continue;
+            }
+            size_t slot = block.target[e] >= 0 ? static_cast<size_t>(block.target[e])
+                        : block.target[e] == EVENT_WALL ? sensorCount : sensorCount + 1;
+            if (slot >= count.size()) continue;
+            count[slot]++;
+            pathSum[slot] += block.pathLength[e];
+            scatterSum[slot] += block.scatters[e];
+        }
+    }
+    if (dump) return 0;
+
+    std::cout << "events " << reader.eventCount() << " in " << reader.blockCount() << " blocks, seed "
+              << reader.header().seed << "\n";
+    // <target> <events> <mean path length> <mean scatters>
+    for (size_t slot = 0; slot < count.size(); ++slot) {
+        if (count[slot] == 0) continue;
+        if (slot < sensorCount) std::cout << "sensor " << slot;
+        else std::cout << (slot == sensorCount ? "wall" : "absorbed");
+        std::cout << " " << count[slot] << " " << pathSum[slot] / count[slot] << " " << scatterSum[slot] / count[slot]
+                  << "\n";
+    }
+    return 0;
+}
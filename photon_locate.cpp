@@ -0,0 +1,132 @@
+#include "photon_locate.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static void printUsage()
+{
+    std::cout << "Usage: photon_locate [options]\n"
+              << "  Estimates the emitter position from observed sensor hit counts\n"
+              << "  --hits FILE          photon_batch output (the hits of its sensor lines) or one count per line,\n"
+              << "                       in sensor order (default stdin)\n"
+              << "  --table FILE         forward-response table cache (default photon_response.table); built and\n"
+              << "                       saved when missing or made for other settings\n"
+              << "  --grid X,Y           emitter positions of the table, at the cell centres (default 25,33)\n"
+              << "  --table-photons N    photons traced per table position (default 200000)\n"
+              << "  --threads T          worker threads for building the table, 0 = all cores (default)\n"
+              << "  --seed S, --sensors N, --weighted, --radius R, --anisotropy G\n"
+              << "                       transport settings, as for photon_batch\n";
+}
+
+// Hit counts from photon_batch output ("sensor <index> <x> <y> <hits> ...") or a plain list
+static bool readHits(std::istream& in, std::vector<double>& hits)
+{
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first)) continue;
+        if (first == "sensor") {
+            size_t index;
+            float x, y;
+            double count;
+            if (!(fields >> index >> x >> y >> count) || index != hits.size()) return false;
+            hits.push_back(count);
+        } else if (first.find_first_not_of("0123456789.eE+-") == std::string::npos) {
+            hits.push_back(std::atof(first.c_str()));
+        }
+    }
+    return !hits.empty();
+}
+
+int main(int argc, char** argv)
+{
+    TransportConfig config;
+    unsigned threads = 0;
+    int sensorsPerSide = 10;
+    int cellsX = 25;
+    int cellsY = 33;
+    uint64_t tablePhotons = 200000;
+    std::string tablePath = "photon_response.table";
+    std::string hitsPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--hits" && hasValue) hitsPath = argv[++i];
+        else if (arg == "--table" && hasValue) tablePath = argv[++i];
+        else if (arg == "--grid" && hasValue) {
+            if (std::sscanf(argv[++i], "%d,%d", &cellsX, &cellsY) != 2 || cellsX < 2 || cellsY < 2) {
+                printUsage();
+                return -1;
+            }
+        } else if (arg == "--table-photons" && hasValue) {
+            tablePhotons = std::strtoull(argv[++i], NULL, 10);
+            if (tablePhotons < 1) {
+                printUsage();
+                return -1;
+            }
+        } else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::strtoul(argv[++i], NULL, 10));
+        else if (arg == "--seed" && hasValue) config.seed = std::strtoull(argv[++i], NULL, 10);
+        else if (arg == "--sensors" && hasValue) sensorsPerSide = std::atoi(argv[++i]);
+        else if (arg == "--weighted") config.mode = TRANSPORT_WEIGHTED;
+        else if (arg == "--radius" && hasValue) config.sensorRadius = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--anisotropy" && hasValue) {
+            setPhaseFunction(config, PHASE_HENYEY_GREENSTEIN, static_cast<float>(std::atof(argv[++i])));
+        } else {
+            printUsage();
+            return -1;
+        }
+    }
+    if (sensorsPerSide < 2) {
+        printUsage();
+        return -1;
+    }
+    std::string error;
+    if (!checkTransportConfig(config, error)) {
+        std::cerr << "Invalid settings: " << error << std::endl;
+        return -1;
+    }
+
+    std::vector<double> hits;
+    std::ifstream hitsFile;
+    if (!hitsPath.empty()) {
+        hitsFile.open(hitsPath.c_str());
+        if (!hitsFile) {
+            std::cerr << "Cannot read " << hitsPath << std::endl;
+            return -1;
+        }
+    }
+    if (!readHits(hitsPath.empty() ? std::cin : hitsFile, hits)) {
+        std::cerr << "No hit counts in the input" << std::endl;
+        return -1;
+    }
+
+    SensorCenters layout = makeSensorGrid(sensorsPerSide, config.boxWidth, config.boxHeight, SENSOR_MARGIN);
+    if (hits.size() != layout.size()) {
+        std::cerr << "Got " << hits.size() << " hit counts for " << layout.size() << " sensors" << std::endl;
+        return -1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool built = false;
+    ResponseTable table =
+        cachedResponseTable(tablePath, config, layout, cellsX, cellsY, tablePhotons, threads, TRACE_PACKET, built);
+    std::chrono::steady_clock::time_point loaded = std::chrono::steady_clock::now();
+    EmitterEstimate estimate = locateEmitter(table, hits);
+    std::chrono::steady_clock::time_point located = std::chrono::steady_clock::now();
+
+    std::cout << "emitter " << estimate.x << " " << estimate.y << "\n";
+    std::cout << "intensity " << estimate.intensity << "\n";
+    std::cout << "log-likelihood " << estimate.logLikelihood << "\n";
+    std::cout << (built ? "table-built-seconds " : "table-load-seconds ")
+              << std::chrono::duration<double>(loaded - start).count() << "\n";
+    std::cout << "locate-seconds " << std::chrono::duration<double>(located - loaded).count() << std::endl;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "photon_fluence.h"
+#include "photon_shard.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage()
+{
+    std::cout << "Usage: photon_merge [--out FILE] TALLY... | --shard-dir D --shards N [--out FILE]\n"
+              << "  Merges the slice tally files of a sharded photon_batch run and prints the tallies\n"
+              << "  --shard-dir D  directory holding shard-K-of-N.tally for every K\n"
+              << "  --shards N     number of slices the run was split into\n"
+              << "  --out FILE     also save the merged tallies as a checkpoint (mergeable again)\n"
+              << "  --fluence FILE write the merged fluence grid as raw floats (runs with --fluence-cells)\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> paths;
+    std::string shardDir;
+    uint32_t shardCount = 0;
+    std::string outPath;
+    std::string fluencePath;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--shard-dir") == 0 && hasValue) shardDir = argv[++i];
+        else if (std::strcmp(argv[i], "--shards") == 0 && hasValue) {
+            shardCount = static_cast<uint32_t>(std::strtoul(argv[++i], NULL, 10));
+        } else if (std::strcmp(argv[i], "--out") == 0 && hasValue) outPath = argv[++i];
+        else if (std::strcmp(argv[i], "--fluence") == 0 && hasValue) fluencePath = argv[++i];
+        else if (argv[i][0] != '-') paths.push_back(argv[i]);
+        else {
+            printUsage();
+            return -1;
+        }
+    }
+    for (uint32_t k = 0; k < shardCount; ++k) {
+        paths.push_back(shardPath(shardDir, k, shardCount));
+    }
+    if (paths.empty()) {
+        printUsage();
+        return -1;
+    }
+
+    std::vector<Checkpoint> shards(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!loadCheckpoint(paths[i], shards[i])) {
+            std::cerr << "Cannot read " << paths[i] << std::endl;
+            return -1;
+        }
+    }
+
+    Checkpoint merged;
+    std::string error;
+    if (!mergeShards(shards, merged, error)) {
+        std::cerr << "Cannot merge: " << error << std::endl;
+        return -1;
+    }
+    if (!outPath.empty() && !saveCheckpoint(outPath, merged)) {
+        std::cerr << "Cannot write " << outPath << std::endl;
+        return -1;
+    }
+
+    if (!fluencePath.empty() && !writeFluenceRaw(fluencePath, merged.tallies, merged.config)) {
+        std::cerr << "Cannot write " << fluencePath << std::endl;
+        return -1;
+    }
+
+    writeTallies(std::cout, merged.tallies, merged.sensors);
+    return 0;
+}